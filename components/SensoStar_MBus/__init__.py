@@ -1,28 +1,186 @@
 import esphome.codegen as cg
 import esphome.config_validation as cv
 from esphome.components import uart, output # output for LED output
-from esphome.const import CONF_ID
+from esphome.components import time, web_server_base
+from esphome.components.web_server_base import CONF_WEB_SERVER_BASE_ID
+from esphome.const import (
+    CONF_ADDRESS,
+    CONF_BAUD_RATE,
+    CONF_ID,
+    CONF_PATH,
+    CONF_PORT,
+    CONF_PRIORITY,
+    CONF_SIZE,
+    CONF_TIME_ID,
+)
+from esphome.core import CORE
 
 DEPENDENCIES = ["uart"]
 
+
+def AUTO_LOAD():
+    # socket only for the optional TCP gateway
+    config = (CORE.raw_config or {}).get("SensoStar_MBus") or {}
+    return ["socket"] if CONF_GATEWAY in config else []
+
+
 CONF_SENSOSTAR_ID = "sensostar_id"
+CONF_METER_ID = "meter_id"
 CONF_DATA_LED = "data_led" # data_led output
+CONF_METERS = "meters"
+CONF_SECONDARY_ADDRESS = "secondary_address"
+CONF_SCHEDULING = "scheduling"
+CONF_HISTORY = "history"
+CONF_FLASH_BLOCKS = "flash_blocks"
+CONF_HISTORY_EXPORT = "history_export"
+CONF_DEBUG_STATS = "debug_stats"
+CONF_SELECTIVE_READOUT = "selective_readout"
+CONF_TRACE = "trace"
+CONF_GATEWAY = "gateway"
+CONF_ADAPTIVE_POLLING = "adaptive_polling"
+CONF_MIN_INTERVAL = "min_interval"
+CONF_MAX_INTERVAL = "max_interval"
+CONF_FLOW_THRESHOLD = "flow_threshold"
+CONF_POWER_THRESHOLD = "power_threshold"
+CONF_TEMPERATURE_DIFF_THRESHOLD = "temperature_diff_threshold"
+CONF_DAILY_BUDGET = "daily_budget"
 
 sensostar = cg.esphome_ns.namespace("sensostar")
 SensoStarComponent = sensostar.class_(
     "SensoStarComponent", cg.PollingComponent, uart.UARTDevice
 )
+SensoStarMeter = sensostar.class_("SensoStarMeter")
+Quantity = sensostar.namespace("mbus").enum("Quantity", is_class=True)
+
+# Rates selectable with the M-Bus baud rate switch (CI 0xB8 - 0xBF)
+MBUS_BAUD_RATES = [300, 600, 1200, 2400, 4800, 9600, 19200, 38400]
+
+# Must match HISTORY_BLOCK_SIZE in history_codec.h
+HISTORY_BLOCK_SIZE = 256
+# the default NVS partition is 20 KB and also holds WiFi and all other preferences,
+# each block takes about 10 of its 32 byte entries
+MAX_FLASH_BLOCKS = 16
+MAX_FLASH_BLOCKS_TOTAL = 32
+
+SCHEDULING_ROUND_ROBIN = "round_robin"
+SCHEDULING_PRIORITY = "priority"
+
+
+def secondary_address(value):
+    """8 digit identification number, an F matches any digit."""
+    value = cv.string_strict(value).upper()
+    if len(value) != 8 or any(c not in "0123456789F" for c in value):
+        raise cv.Invalid(
+            "Secondary address must be 8 digits (0-9, F as wildcard), e.g. 12345678"
+        )
+    return int(value, 16)
+
+
+HISTORY_SCHEMA = cv.Schema(
+    {
+        # allocated in PSRAM when available
+        cv.Optional(CONF_SIZE, default=16384): cv.int_range(
+            min=HISTORY_BLOCK_SIZE, max=HISTORY_BLOCK_SIZE * 65535
+        ),
+        # newest blocks kept in flash, 0 = RAM only
+        cv.Optional(CONF_FLASH_BLOCKS, default=0): cv.int_range(min=0, max=MAX_FLASH_BLOCKS),
+    }
+)
+
+def validate_adaptive_polling(config):
+    if config[CONF_MIN_INTERVAL] > config[CONF_MAX_INTERVAL]:
+        raise cv.Invalid(f"{CONF_MIN_INTERVAL} must not be longer than {CONF_MAX_INTERVAL}")
+    return config
+
+
+# changes per minute, a threshold of 0 ignores the reading
+ADAPTIVE_POLLING_SCHEMA = cv.All(
+    cv.Schema(
+        {
+            cv.Optional(CONF_MIN_INTERVAL, default="10s"): cv.positive_time_period_milliseconds,
+            cv.Optional(CONF_MAX_INTERVAL, default="5min"): cv.positive_time_period_milliseconds,
+            cv.Optional(CONF_FLOW_THRESHOLD, default=0.1): cv.positive_float,            # m3/h
+            cv.Optional(CONF_POWER_THRESHOLD, default=1000): cv.positive_float,          # W
+            cv.Optional(CONF_TEMPERATURE_DIFF_THRESHOLD, default=2): cv.positive_float,  # K
+            # polls per day the meter battery allows, 0 = unlimited
+            cv.Optional(CONF_DAILY_BUDGET, default=0): cv.positive_int,
+        }
+    ),
+    validate_adaptive_polling,
+)
 
-CONFIG_SCHEMA = (
+HISTORY_EXPORT_SCHEMA = cv.Schema(
+    {
+        cv.GenerateID(CONF_WEB_SERVER_BASE_ID): cv.use_id(web_server_base.WebServerBase),
+        cv.Optional(CONF_PATH, default="/sensostar/history.csv"): cv.string_strict,
+    }
+)
+
+GATEWAY_SCHEMA = cv.Schema(
+    {
+        cv.Optional(CONF_PORT, default=10001): cv.port,
+    }
+)
+
+METER_SCHEMA = cv.All(
+    cv.Schema(
+        {
+            cv.GenerateID(): cv.declare_id(SensoStarMeter),
+            cv.Optional(CONF_ADDRESS): cv.hex_uint8_t,
+            cv.Optional(CONF_SECONDARY_ADDRESS): secondary_address,
+            cv.Optional(CONF_PRIORITY, default=0): cv.uint8_t,
+            cv.Optional(CONF_HISTORY): HISTORY_SCHEMA,
+            # request only the records of the configured sensors, shorter responses. Experimental: which
+            # record the meter sends for each item of the request is assumed, not documented
+            cv.Optional(CONF_SELECTIVE_READOUT, default=False): cv.boolean,
+            # own poll schedule following the readings instead of the update interval
+            cv.Optional(CONF_ADAPTIVE_POLLING): ADAPTIVE_POLLING_SCHEMA,
+        }
+    ),
+    cv.has_at_most_one_key(CONF_ADDRESS, CONF_SECONDARY_ADDRESS),
+)
+
+def validate_flash_blocks(config):
+    total = sum(
+        meter_config[CONF_HISTORY][CONF_FLASH_BLOCKS]
+        for meter_config in config[CONF_METERS]
+        if CONF_HISTORY in meter_config
+    )
+    if total > MAX_FLASH_BLOCKS_TOTAL:
+        raise cv.Invalid(
+            f"{CONF_FLASH_BLOCKS} of all meters add up to {total}, at most {MAX_FLASH_BLOCKS_TOTAL} fit into flash"
+        )
+    return config
+
+
+CONFIG_SCHEMA = cv.All(
     cv.Schema(
         {
             cv.GenerateID(): cv.declare_id(SensoStarComponent),
             # make data_led available for .yaml file
             cv.Optional(CONF_DATA_LED): cv.use_id(output.BinaryOutput),
+            # a single meter at the point-to-point address 0xFE unless configured otherwise
+            cv.Optional(CONF_METERS, default=[{}]): cv.ensure_list(METER_SCHEMA),
+            cv.Optional(CONF_SCHEDULING, default=SCHEDULING_ROUND_ROBIN): cv.one_of(
+                SCHEDULING_ROUND_ROBIN, SCHEDULING_PRIORITY, lower=True
+            ),
+            # negotiated with each meter after its init sequence, falls back to 2400
+            cv.Optional(CONF_BAUD_RATE, default=2400): cv.one_of(*MBUS_BAUD_RATES, int=True),
+            # UNIX timestamps for the history instead of uptime
+            cv.Optional(CONF_TIME_ID): cv.use_id(time.RealTimeClock),
+            # streams the history of all meters as CSV
+            cv.Optional(CONF_HISTORY_EXPORT): HISTORY_EXPORT_SCHEMA,
+            # log bus counters and timing histograms every update, also enabled by the statistics sensors
+            cv.Optional(CONF_DEBUG_STATS, default=False): cv.boolean,
+            # log every request, received chunk, baud switch and timeout for replay
+            cv.Optional(CONF_TRACE, default=False): cv.boolean,
+            # raw M-Bus frames over TCP for other tools, sharing the bus with the poll cycle
+            cv.Optional(CONF_GATEWAY): GATEWAY_SCHEMA,
         }
     )
     .extend(uart.UART_DEVICE_SCHEMA)
-    .extend(cv.polling_component_schema("30s"))
+    .extend(cv.polling_component_schema("30s")),
+    validate_flash_blocks,
 )
 
 
@@ -34,4 +192,66 @@ async def to_code(config):
     # data_led
     if data_led_id := config.get(CONF_DATA_LED):
         data_led = await cg.get_variable(data_led_id)
-        cg.add(var.set_data_led(data_led)) # Calls the set_data_led method you define in .h/.cpp
\ No newline at end of file
+        cg.add(var.set_data_led(data_led)) # Calls the set_data_led method you define in .h/.cpp
+
+    for meter_config in config[CONF_METERS]:
+        meter = cg.new_Pvariable(meter_config[CONF_ID])
+        if CONF_ADDRESS in meter_config:
+            cg.add(meter.set_address(meter_config[CONF_ADDRESS]))
+        if CONF_SECONDARY_ADDRESS in meter_config:
+            cg.add(meter.set_secondary_address(meter_config[CONF_SECONDARY_ADDRESS]))
+        cg.add(meter.set_priority(meter_config[CONF_PRIORITY]))
+        if meter_config[CONF_SELECTIVE_READOUT]:
+            cg.add(meter.set_selective_readout(True))
+        if adaptive_config := meter_config.get(CONF_ADAPTIVE_POLLING):
+            cg.add(
+                meter.set_adaptive_poll(
+                    adaptive_config[CONF_MIN_INTERVAL].total_milliseconds,
+                    adaptive_config[CONF_MAX_INTERVAL].total_milliseconds,
+                    adaptive_config[CONF_FLOW_THRESHOLD],
+                    adaptive_config[CONF_POWER_THRESHOLD],
+                    adaptive_config[CONF_TEMPERATURE_DIFF_THRESHOLD],
+                    adaptive_config[CONF_DAILY_BUDGET],
+                )
+            )
+            # the watched readings are needed in a selective readout as well
+            for quantity, key in (
+                (Quantity.VOLUME_FLOW, CONF_FLOW_THRESHOLD),
+                (Quantity.POWER, CONF_POWER_THRESHOLD),
+                (Quantity.TEMPERATURE_DIFF, CONF_TEMPERATURE_DIFF_THRESHOLD),
+            ):
+                if adaptive_config[key] > 0:
+                    cg.add(meter.request_quantity(quantity))
+        if history_config := meter_config.get(CONF_HISTORY):
+            cg.add_define("USE_SENSOSTAR_HISTORY")
+            cg.add(
+                meter.set_history(
+                    history_config[CONF_SIZE] // HISTORY_BLOCK_SIZE,
+                    history_config[CONF_FLASH_BLOCKS],
+                )
+            )
+        cg.add(var.add_meter(meter))
+
+    cg.add(var.set_priority_scheduling(config[CONF_SCHEDULING] == SCHEDULING_PRIORITY))
+    if config[CONF_BAUD_RATE] != 2400:
+        cg.add(var.set_baud_rate(config[CONF_BAUD_RATE]))
+
+    if config[CONF_DEBUG_STATS]:
+        cg.add_define("USE_SENSOSTAR_STATS")
+
+    if config[CONF_TRACE]:
+        cg.add_define("USE_SENSOSTAR_TRACE")
+
+    if gateway_config := config.get(CONF_GATEWAY):
+        cg.add_define("USE_SENSOSTAR_GATEWAY")
+        cg.add(var.set_gateway_port(gateway_config[CONF_PORT]))
+
+    if time_id := config.get(CONF_TIME_ID):
+        clock = await cg.get_variable(time_id)
+        cg.add(var.set_time(clock))
+
+    if export_config := config.get(CONF_HISTORY_EXPORT):
+        cg.add_define("USE_SENSOSTAR_HISTORY")
+        cg.add_define("USE_SENSOSTAR_HISTORY_EXPORT")
+        base = await cg.get_variable(export_config[CONF_WEB_SERVER_BASE_ID])
+        cg.add(var.set_history_export(base, export_config[CONF_PATH]))
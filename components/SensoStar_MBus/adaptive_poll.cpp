@@ -0,0 +1,62 @@
+#include "adaptive_poll.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace esphome {
+namespace sensostar {
+
+void AdaptivePoll::set_daily_budget(uint32_t budget) {
+    this->budget_ = budget;
+    this->capacity_ = std::max(1.0f, budget / 24.0f);
+    this->tokens_ = this->capacity_;
+}
+
+void AdaptivePoll::update(const float values[ADAPTIVE_INPUT_COUNT], uint32_t now) {
+    bool transient = false;
+    if (this->has_last_ && now != this->last_time_) {
+        const float minutes = (uint32_t) (now - this->last_time_) / 60000.0f;
+        for (uint8_t i = 0; i < ADAPTIVE_INPUT_COUNT; i++) {
+            if (this->thresholds_[i] <= 0 || std::isnan(values[i]) || std::isnan(this->last_[i]))
+                continue;
+            if (std::fabs(values[i] - this->last_[i]) / minutes > this->thresholds_[i])
+                transient = true;
+        }
+    }
+    for (uint8_t i = 0; i < ADAPTIVE_INPUT_COUNT; i++)
+        this->last_[i] = values[i];
+    this->last_time_ = now;
+
+    if (transient || this->interval_ == 0 || !this->has_last_)
+        this->interval_ = this->min_interval_;
+    else
+        this->interval_ = std::min(this->interval_ * 2, this->max_interval_);
+    this->has_last_ = true;
+}
+
+void AdaptivePoll::refill_(uint32_t now) {
+    const uint32_t elapsed = now - this->refill_time_;
+    this->refill_time_ = now;
+    if (this->budget_ == 0)
+        return;
+    this->tokens_ = std::min(this->capacity_, this->tokens_ + (float) this->budget_ * elapsed / ADAPTIVE_DAY);
+}
+
+void AdaptivePoll::spend(uint32_t now) {
+    this->refill_(now);
+    if (this->budget_ != 0)
+        this->tokens_ = std::max(0.0f, this->tokens_ - 1);
+}
+
+uint32_t AdaptivePoll::interval(uint32_t now) {
+    uint32_t interval = this->interval_ ? this->interval_ : this->min_interval_;
+    this->refill_(now);
+    if (this->budget_ == 0 || this->tokens_ >= 1)
+        return interval;
+    // Wait for the next token
+    const uint32_t wait = (uint32_t) ((1 - this->tokens_) * ADAPTIVE_DAY / this->budget_);
+    return std::max(interval, wait);
+}
+
+}  // namespace sensostar
+}  // namespace esphome
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+
+namespace esphome {
+namespace sensostar {
+
+// Readings whose rate of change shortens the poll interval
+enum AdaptiveInput : uint8_t {
+  ADAPTIVE_FLOW = 0,         // m3/h
+  ADAPTIVE_POWER,            // W
+  ADAPTIVE_TEMPERATURE_DIFF, // K
+  ADAPTIVE_INPUT_COUNT,
+};
+
+static const uint32_t ADAPTIVE_DAY = 24 * 60 * 60 * 1000;
+
+// Poll interval of one meter: the minimum while a watched reading changes faster than its threshold,
+// doubling back to the maximum while the readings are steady, stretched when the daily poll budget
+// of the meter battery runs low
+class AdaptivePoll {
+ public:
+  void set_min_interval(uint32_t min_interval) { this->min_interval_ = min_interval; }
+  void set_max_interval(uint32_t max_interval) { this->max_interval_ = max_interval; }
+  // Change per minute above which the meter is polled at the minimum interval, 0 = not watched
+  void set_threshold(AdaptiveInput input, float per_minute) { this->thresholds_[input] = per_minute; }
+  // Polls per day, 0 = unlimited; up to an hour's share can be spent at once
+  void set_daily_budget(uint32_t budget);
+
+  // Readings of a successful readout, NAN for missing ones
+  void update(const float values[ADAPTIVE_INPUT_COUNT], uint32_t now);
+  // Forget the last readings, e.g. after the meter stopped answering
+  void reset() { this->has_last_ = false; }
+  // A poll was sent
+  void spend(uint32_t now);
+  // Time from the last poll to the next one
+  uint32_t interval(uint32_t now);
+
+ protected:
+  void refill_(uint32_t now);
+
+  uint32_t min_interval_{10000};
+  uint32_t max_interval_{300000};
+  float thresholds_[ADAPTIVE_INPUT_COUNT]{};
+  uint32_t budget_{0};
+
+  uint32_t interval_{0}; // 0 until the first update(), polls at the minimum interval
+  bool has_last_{false};
+  float last_[ADAPTIVE_INPUT_COUNT];
+  uint32_t last_time_{0};
+
+  // Token bucket of the poll budget
+  float tokens_{0};
+  float capacity_{0};
+  uint32_t refill_time_{0};
+};
+
+}  // namespace sensostar
+}  // namespace esphome
@@ -0,0 +1,76 @@
+#include "aggregates.h"
+
+#include <cmath>
+
+namespace esphome {
+namespace sensostar {
+
+void RunningStat::add(float value) {
+    if (std::isnan(value))
+        return;
+    if (this->count == 0 || value < this->min)
+        this->min = value;
+    if (this->count == 0 || value > this->max)
+        this->max = value;
+    this->sum += value;
+    this->count++;
+}
+
+float RunningStat::mean() const { return this->count ? this->sum / this->count : NAN; }
+
+void PeriodAggregate::start(uint32_t key) {
+    *this = PeriodAggregate{};
+    this->key = key;
+    this->energy_start = this->energy_last = NAN;
+    this->volume_start = this->volume_last = NAN;
+}
+
+void PeriodAggregate::add(const AggregateSample &sample, uint32_t time) {
+    if (!std::isnan(sample.energy)) {
+        if (std::isnan(this->energy_start))
+            this->energy_start = sample.energy;
+        this->energy_last = sample.energy;
+    }
+    if (!std::isnan(sample.volume)) {
+        if (std::isnan(this->volume_start))
+            this->volume_start = sample.volume;
+        this->volume_last = sample.volume;
+    }
+    this->temperature_flow.add(sample.temperature_flow);
+    this->temperature_return.add(sample.temperature_return);
+
+    // Operating time: the interval since the last sample counts when the water was flowing at its start
+    if (this->last_time != 0 && this->last_flowing && time > this->last_time && time - this->last_time <= AGGREGATE_MAX_GAP)
+        this->flow_seconds += time - this->last_time;
+    this->last_time = time;
+    this->last_flowing = !std::isnan(sample.flow) && sample.flow > 0;
+}
+
+void PeriodAggregate::roll(uint32_t key) {
+    const double energy = this->energy_last, volume = this->volume_last;
+    const uint32_t last_time = this->last_time;
+    const bool last_flowing = this->last_flowing;
+    this->start(key);
+    this->energy_start = this->energy_last = energy;
+    this->volume_start = this->volume_last = volume;
+    this->last_time = last_time;
+    this->last_flowing = last_flowing;
+}
+
+float PeriodAggregate::value(AggregateValue value) const {
+    switch (value) {
+        case AGGREGATE_ENERGY: return this->energy_last - this->energy_start;
+        case AGGREGATE_VOLUME: return this->volume_last - this->volume_start;
+        case AGGREGATE_TEMPERATURE_FLOW_MIN: return this->temperature_flow.count ? this->temperature_flow.min : NAN;
+        case AGGREGATE_TEMPERATURE_FLOW_MAX: return this->temperature_flow.count ? this->temperature_flow.max : NAN;
+        case AGGREGATE_TEMPERATURE_FLOW_MEAN: return this->temperature_flow.mean();
+        case AGGREGATE_TEMPERATURE_RETURN_MIN: return this->temperature_return.count ? this->temperature_return.min : NAN;
+        case AGGREGATE_TEMPERATURE_RETURN_MAX: return this->temperature_return.count ? this->temperature_return.max : NAN;
+        case AGGREGATE_TEMPERATURE_RETURN_MEAN: return this->temperature_return.mean();
+        case AGGREGATE_OPERATING_HOURS: return this->flow_seconds / 3600.0f;
+        default: return NAN;
+    }
+}
+
+}  // namespace sensostar
+}  // namespace esphome
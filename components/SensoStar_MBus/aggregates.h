@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+
+namespace esphome {
+namespace sensostar {
+
+enum AggregatePeriod : uint8_t {
+  PERIOD_HOUR = 0,
+  PERIOD_DAY,
+  PERIOD_MONTH,
+  AGGREGATE_PERIOD_COUNT,
+};
+
+// Values published at the end of a period, names match the keys in sensor.py
+enum AggregateValue : uint8_t {
+  AGGREGATE_ENERGY = 0,          // kWh consumed in the period
+  AGGREGATE_VOLUME,              // m3
+  AGGREGATE_TEMPERATURE_FLOW_MIN,
+  AGGREGATE_TEMPERATURE_FLOW_MAX,
+  AGGREGATE_TEMPERATURE_FLOW_MEAN,
+  AGGREGATE_TEMPERATURE_RETURN_MIN,
+  AGGREGATE_TEMPERATURE_RETURN_MAX,
+  AGGREGATE_TEMPERATURE_RETURN_MEAN,
+  AGGREGATE_OPERATING_HOURS,     // h with flow > 0
+  AGGREGATE_VALUE_COUNT,
+};
+
+// Samples further apart do not count as operating time, e.g. across a reboot
+static const uint32_t AGGREGATE_MAX_GAP = 15 * 60;
+
+// One readout as far as the aggregates are concerned, NAN for missing values
+struct AggregateSample {
+  double energy;
+  double volume;
+  float flow;
+  float temperature_flow;
+  float temperature_return;
+};
+
+struct RunningStat {
+  float min;
+  float max;
+  double sum;
+  uint32_t count;
+
+  void add(float value);
+  float mean() const;
+};
+
+// Running aggregates of one period, kept in preferences as is
+struct PeriodAggregate {
+  uint32_t key;         // identifies the period, see SensoStarComponent::aggregate_keys_()
+  double energy_start;  // counter values at the end of the previous period
+  double volume_start;
+  double energy_last;
+  double volume_last;
+  RunningStat temperature_flow;
+  RunningStat temperature_return;
+  uint32_t flow_seconds;
+  uint32_t last_time;   // UNIX time of the last sample
+  bool last_flowing;
+
+  void start(uint32_t key);
+  // O(1) per readout
+  void add(const AggregateSample &sample, uint32_t time);
+  // The next period continues from the last counter values of this one
+  void roll(uint32_t key);
+  float value(AggregateValue value) const;
+};
+
+}  // namespace sensostar
+}  // namespace esphome
@@ -0,0 +1,51 @@
+import esphome.codegen as cg
+import esphome.config_validation as cv
+from esphome.components import binary_sensor
+from esphome.const import (
+    DEVICE_CLASS_BATTERY,
+    DEVICE_CLASS_PROBLEM,
+    ENTITY_CATEGORY_DIAGNOSTIC,
+)
+
+from . import SensoStarMeter, Quantity, CONF_METER_ID
+
+# one per bit of the error flags record, in bit order
+TYPES = [
+    "temperature_sensor_1_cable_break",
+    "temperature_sensor_1_short_circuit",
+    "temperature_sensor_2_cable_break",
+    "temperature_sensor_2_short_circuit",
+    "flow_measurement_error",
+    "electronic_defect",
+    "reset",
+    "low_battery",
+]
+
+CONFIG_SCHEMA = cv.Schema(
+    {
+        cv.GenerateID(CONF_METER_ID): cv.use_id(SensoStarMeter),
+        **{
+            cv.Optional(key): binary_sensor.binary_sensor_schema(
+                device_class=DEVICE_CLASS_BATTERY
+                if key == "low_battery"
+                else DEVICE_CLASS_PROBLEM,
+                entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+            )
+            for key in TYPES
+        },
+    }
+).extend(cv.COMPONENT_SCHEMA)
+
+
+async def setup_conf(config, key, meter):
+    if sensor_config := config.get(key):
+        sens = await binary_sensor.new_binary_sensor(sensor_config)
+        cg.add(getattr(meter, f"set_{key}_binary_sensor")(sens))
+
+
+async def to_code(config):
+    meter = await cg.get_variable(config[CONF_METER_ID])
+    for key in TYPES:
+        await setup_conf(config, key, meter)
+    if any(key in config for key in TYPES):
+        cg.add(meter.request_quantity(Quantity.ERROR_FLAGS))
@@ -0,0 +1,867 @@
+#include "bus_master.h"
+#include "esphome/core/log.h"
+#include "esphome/core/helpers.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace esphome {
+namespace sensostar {
+
+static const char *const TAG = "SensoStar";
+
+void BusMeter::update_name_() {
+    if (this->secondary_)
+        snprintf(this->name_buf_, sizeof(this->name_buf_), "ID %08X", (unsigned) this->secondary_id_);
+    else
+        snprintf(this->name_buf_, sizeof(this->name_buf_), "address 0x%02X", this->address_);
+}
+
+BusMaster::BusMaster(BusUart *uart, BusClock *clock, BusListener *listener)
+    : uart_(uart), clock_(clock), listener_(listener) {
+    this->parser_.set_sink(&this->decoder_);
+}
+
+bool BusMaster::restore_scan(const uint32_t *ids, size_t count) {
+    this->found_ids_.assign(ids, ids + count);
+    return this->resolve_meters_();
+}
+
+void BusMaster::rescan() {
+    // Scan below the configured mask when all wildcard meters share it, the whole address space otherwise
+    uint32_t mask = 0;
+    for (auto *meter : this->meters_) {
+        if (!meter->is_secondary() || !mbus::id_has_wildcard(meter->secondary_id_))
+            continue;
+        mask = (mask == 0 || mask == meter->secondary_id_) ? meter->secondary_id_ : 0xFFFFFFFF;
+    }
+    if (mask == 0)
+        return;
+    ESP_LOGI(TAG, "Scanning for secondary addresses matching %08X", (unsigned) mask);
+    this->found_ids_.clear();
+    this->scan_.start(mask);
+    this->scan_read_ = false;
+    this->scan_collision_ = false;
+    this->scan_start_ = this->clock_->bus_millis();
+    this->selected_ = nullptr;
+    // Probes go out at the default rate, meters switched to a higher one would not hear them
+    this->scan_baud_reset_ = this->baud_rate_ != MBUS_DEFAULT_BAUD_RATE;
+}
+
+bool BusMaster::resolve_meters_() {
+    // Assign found IDs in ascending order, to wildcard meters in configuration order
+    std::sort(this->found_ids_.begin(), this->found_ids_.end());
+    bool resolved = true;
+    for (auto *meter : this->meters_) {
+        if (!meter->is_secondary() || !mbus::id_has_wildcard(meter->secondary_id_))
+            continue;
+        meter->resolved_ = false;
+        for (uint32_t id : this->found_ids_) {
+            if (!mbus::id_matches(meter->secondary_id_, id))
+                continue;
+            bool taken = false;
+            for (auto *other : this->meters_)
+                taken |= other != meter && other->is_secondary() && other->resolved_ && other->resolved_id_ == id;
+            if (taken)
+                continue;
+            meter->resolved_id_ = id;
+            meter->resolved_ = true;
+            ESP_LOGD(TAG, "Meter %s: using ID %08X", meter->name_(), (unsigned) id);
+            break;
+        }
+        resolved &= meter->resolved_;
+    }
+    return resolved;
+}
+
+void BusMaster::update() {
+    for (auto *meter : this->meters_) {
+        if (!meter->adaptive_)
+            meter->pending_ = true;
+    }
+    if (!this->cycle_active_) {
+        this->cycle_start_ = this->clock_->bus_millis();
+        this->cycle_reads_ = 0;
+        this->cycle_active_ = true;
+    }
+}
+
+void BusMaster::handle_byte_(uint8_t c, uint32_t now) {
+    mbus::ParseResult result = this->parser_.feed(c);
+    if (this->scan_.running() && !this->scan_read_ && (result != mbus::ParseResult::ACK || this->scan_collision_)) {
+        // Anything but a single acknowledge, usually a byte garbled by several meters answering at once.
+        // Reported when the bus is silent again, so late answers do not hit the next probe.
+        this->scan_collision_ = true;
+        return;
+    }
+    if (this->parser_.in_frame()) {
+        this->receiving_ = 2;
+        return;
+    }
+
+    if (this->scan_.running()) {
+        if (result != mbus::ParseResult::NONE)
+            this->handle_scan_(result, now);
+        return;
+    }
+
+    switch (result) {
+        case mbus::ParseResult::NONE:
+            return;
+        case mbus::ParseResult::ACK:
+            // Acknowledge
+            SENSOSTAR_STATS(this->stats_.count(COUNTER_ACKS));
+            if (this->external_) {
+                if (this->external_select_ && this->external_meter_ != nullptr)
+                    this->selected_ = this->external_meter_;
+                break;
+            }
+            if (this->active_ == nullptr)
+                return;
+            this->handle_response_();
+            if (this->selecting_) {
+                this->selected_ = this->active_;
+                this->selecting_ = false;
+            }
+            else if (this->deselecting_) {
+                this->deselecting_ = false;
+            }
+            else if (this->resetting_) {
+                // SND_NKE to the secondary address also ends the selection
+                this->resetting_ = false;
+                if (this->active_->is_secondary())
+                    this->selected_ = nullptr;
+            }
+            else if (this->switching_baud_) {
+                this->switched_baud_rate_(this->active_);
+            }
+            else if (!this->active_->is_initialized())
+                this->active_->init_state_ |= 0x10;
+            else if (this->active_kind_ == REQUEST_READOUT && this->active_->selective_) {
+                this->selective_failed_(this->active_, "acknowledged without data");
+                this->active_->pending_ = true;
+            }
+            break;
+        case mbus::ParseResult::FRAME:
+            SENSOSTAR_STATS(this->stats_.count(COUNTER_FRAMES));
+            this->handle_frame_(now);
+            break;
+        default:
+            SENSOSTAR_STATS(this->stats_.count((BusCounter) (COUNTER_ERROR_START + (uint8_t) result - (uint8_t) mbus::ParseResult::ERROR_START)));
+            ESP_LOGV(TAG, "M-Bus received: %s", format_hex_pretty(this->parser_.frame(), this->parser_.frame_size()).c_str());
+            if (this->active_ != nullptr)
+                this->listener_->on_unavailable(this->active_);
+            ESP_LOGW(TAG, "%s", mbus::parse_result_to_str(result));
+            break;
+    }
+    this->finish_transaction_(now);
+}
+
+void BusMaster::handle_frame_(uint32_t now) {
+    ESP_LOGV(TAG, "M-Bus received: %s", format_hex_pretty(this->parser_.frame(), this->parser_.frame_size()).c_str());
+
+    if (this->external_) {
+        this->tee_frame_(now);
+        return;
+    }
+
+    BusMeter *meter = this->active_;
+    if (meter == nullptr){
+        ESP_LOGV(TAG, "Ignoring unsolicited frame");
+        return;
+    }
+
+    this->handle_response_();
+    if (this->selecting_ || this->deselecting_ || this->resetting_ || this->switching_baud_){
+        // A selection, SND_NKE or baud rate switch is only acknowledged with a single character
+        if (this->resetting_ && meter->is_secondary())
+            this->selected_ = nullptr;
+        this->selecting_ = false;
+        this->deselecting_ = false;
+        this->resetting_ = false;
+        this->switching_baud_ = false;
+        ESP_LOGW(TAG, "Meter %s: unexpected response to control frame", meter->name_());
+    }
+    else if (!meter->is_initialized()){
+        // Initialization sequence
+        meter->init_state_ |= 0x10;
+    }
+    else if (meter->init_verify_ && (!this->decoder_.is_rsp_ud() || !this->decoder_.complete()
+                                      || !this->decoder_.readout().has(mbus::Quantity::ENERGY))){
+        this->init_failed_(meter);
+    }
+    else if (!this->decoder_.is_rsp_ud()){
+        SENSOSTAR_STATS(this->stats_.count(COUNTER_UNKNOWN_FRAMES));
+        this->listener_->on_unavailable(meter);
+        ESP_LOGW(TAG, "Unknown frame");
+        if (meter->selective_) {
+            this->selective_failed_(meter, "not answered with RSP_UD");
+            meter->pending_ = true;
+        }
+    }
+    else {
+        const mbus::Readout &readout = this->decoder_.readout();
+        ESP_LOGD(TAG, "Meter %s: %u byte response, %u ms on the wire", meter->name_(), this->parser_.frame_size(),
+                 (unsigned) (this->parser_.frame_size() * 11 * 1000 / this->bus_baud_rate_));
+        if (meter->selective_ && (readout.present & meter->readout_mask_()) != meter->readout_mask_())
+            this->selective_failed_(meter, "incomplete");
+        this->publish_frame_(meter, now);
+        meter->FCB_ = !meter->FCB_;
+        this->cycle_reads_++;
+    }
+}
+
+void BusMaster::publish_frame_(BusMeter *meter, uint32_t now) {
+    meter->init_verify_ = false;
+    // Records were decoded while the frame was received, commit them now that checksum and stop are valid
+    if (!this->decoder_.complete())
+        ESP_LOGW(TAG, "Truncated data record");
+    if (this->decoder_.readout().unknown_records > 0)
+        ESP_LOGV(TAG, "Skipped %u unsupported data records", this->decoder_.readout().unknown_records);
+    SENSOSTAR_STATS(const uint32_t publish_start = this->clock_->bus_micros());
+    this->listener_->on_readout(meter, this->decoder_, now);
+#ifdef USE_SENSOSTAR_STATS
+    const uint32_t publish_time = this->clock_->bus_micros() - publish_start;
+    this->publish_time_ += publish_time;
+    this->stats_.time(STAGE_PUBLISH, publish_time);
+#endif
+}
+
+void BusMaster::finish_transaction_(uint32_t now) {
+    this->receiving_ = 0;
+    this->active_ = nullptr;
+    if (this->external_) {
+        ESP_LOGD(TAG, "External request done after %u ms", (unsigned) (now - this->external_start_));
+        this->external_ = false;
+        this->external_meter_ = nullptr;
+        this->external_select_ = false;
+    }
+
+    if (!this->cycle_active_)
+        return;
+    for (auto *meter : this->meters_) {
+        if (meter->needs_bus_())
+            return;
+    }
+    // All meters served: report bus throughput for this poll cycle
+    PollCycle cycle;
+    cycle.reads = this->cycle_reads_;
+    cycle.meters = this->meters_.size();
+    cycle.duration = now - this->cycle_start_;
+    cycle.loop_time_max = this->loop_time_max_;
+    ESP_LOGD(TAG, "Poll cycle: %u of %u meters read in %u ms (%.1f meters/min), longest loop() %u us", cycle.reads,
+             cycle.meters, (unsigned) cycle.duration, cycle.duration > 0 ? cycle.reads * 60000.0f / cycle.duration : 0.0f,
+             (unsigned) cycle.loop_time_max);
+    this->cycle_active_ = false;
+    this->loop_time_max_ = 0;
+    this->listener_->on_cycle(cycle);
+}
+
+void BusMaster::handle_response_() {
+    BusMeter *meter = this->active_;
+    meter->failures_ = 0;
+    meter->baud_probe_ = false;
+    meter->latency_[this->active_kind_].add(std::min<uint32_t>(this->response_latency_, UINT16_MAX));
+}
+
+void BusMaster::handle_timeout_(uint32_t now) {
+    BusMeter *meter = this->active_;
+    SENSOSTAR_STATS(this->stats_.count(COUNTER_TIMEOUTS));
+    if (this->switching_baud_) {
+        // Not acknowledged: an upward switch is considered failed, a downward switch done
+        if (this->desired_baud_rate_(meter) == MBUS_DEFAULT_BAUD_RATE)
+            this->switched_baud_rate_(meter);
+        else {
+            ESP_LOGW(TAG, "Meter %s: baud rate switch to %u not acknowledged", meter->name_(), (unsigned) this->baud_rate_);
+            meter->baud_attempts_++;
+            this->switching_baud_ = false;
+        }
+        return;
+    }
+
+    if (meter->init_verify_) {
+        this->init_failed_(meter);
+        return;
+    }
+
+    meter->failures_++;
+    if (this->active_kind_ == REQUEST_READOUT && meter->selective_ && meter->failures_ >= MBUS_SELECTIVE_MAX_FAILURES) {
+        // The full request gets its own retries before the meter is reported unavailable
+        this->selective_failed_(meter, "not answered");
+        meter->failures_ = 0;
+        meter->pending_ = true;
+        return;
+    }
+    const bool probed = meter->baud_probe_;
+    if (probed) {
+        // Not at the configured rate either, the next attempt is at the default rate again
+        meter->baud_probe_ = false;
+        meter->baud_rate_ = MBUS_DEFAULT_BAUD_RATE;
+    }
+    else if (meter->baud_rate_ != MBUS_DEFAULT_BAUD_RATE && meter->failures_ >= MBUS_MAX_RETRIES) {
+        // Meter stopped answering at the higher rate
+        ESP_LOGW(TAG, "Meter %s: no response at %u baud, falling back to %u", meter->name_(),
+                 (unsigned) meter->baud_rate_, (unsigned) MBUS_DEFAULT_BAUD_RATE);
+        meter->baud_attempts_++;
+        meter->baud_fallback_ = true;
+        meter->failures_ = 0;
+        meter->pending_ = true;
+        return;
+    }
+    else if (meter->failures_ < MBUS_MAX_RETRIES) {
+        // Just late: retry with a longer timeout before reporting the meter as unavailable
+        ESP_LOGD(TAG, "Meter %s: no response, retry %u", meter->name_(), meter->failures_);
+        SENSOSTAR_STATS(this->stats_.count(COUNTER_RETRIES));
+        meter->pending_ = true;
+        return;
+    }
+
+    ESP_LOGW(TAG, "Meter %s: last transmission too long ago. Reset RX index.", meter->name_());
+    this->listener_->on_unavailable(meter);
+    // A meter found by an earlier scan may have been replaced
+    if (meter->failures_ == MBUS_MAX_RETRIES && meter->is_secondary() && mbus::id_has_wildcard(meter->secondary_id_))
+        this->rescan();
+    uint32_t backoff = MBUS_BACKOFF_MIN << std::min<uint8_t>(meter->failures_ - MBUS_MAX_RETRIES, 7);
+    meter->retry_after_ = now + std::min(backoff, MBUS_BACKOFF_MAX);
+    // The meter may have kept the negotiated rate over a reboot of the ESP, every other attempt uses it
+    if (!probed && meter->baud_rate_ == MBUS_DEFAULT_BAUD_RATE && this->desired_baud_rate_(meter) != MBUS_DEFAULT_BAUD_RATE) {
+        ESP_LOGD(TAG, "Meter %s: trying %u baud on the next attempt", meter->name_(), (unsigned) this->baud_rate_);
+        meter->baud_rate_ = this->baud_rate_;
+        meter->baud_probe_ = true;
+    }
+    // Retry the init step on the meter's next turn
+    if (!meter->is_initialized())
+        meter->pending_ = true;
+}
+
+uint32_t BusMaster::response_timeout_() const {
+    // Inside a frame the bytes follow back to back, only tolerate loop() and driver latency
+    if (this->receiving_ == 2 || this->active_ == nullptr)
+        return MBUS_RESPONSE_TIMEOUT;
+
+    uint32_t timeout = MBUS_RESPONSE_TIMEOUT;
+    const LatencyStats &stats = this->active_->latency_[this->active_kind_];
+    if (stats.count() >= MBUS_MIN_LATENCY_SAMPLES) {
+        timeout = stats.p95() + stats.p95() / 2 + MBUS_TIMEOUT_MARGIN;
+        timeout = std::max(MBUS_MIN_RESPONSE_TIMEOUT, std::min(timeout, MBUS_RESPONSE_TIMEOUT));
+    }
+    // Double the timeout for every retry
+    timeout <<= std::min<uint8_t>(this->active_->failures_, 2);
+    return timeout;
+}
+
+uint32_t BusMaster::desired_baud_rate_(const BusMeter *meter) const {
+    if (meter->baud_fallback_ || meter->baud_attempts_ >= MBUS_MAX_BAUD_ATTEMPTS)
+        return MBUS_DEFAULT_BAUD_RATE;
+    return this->baud_rate_;
+}
+
+void BusMaster::switched_baud_rate_(BusMeter *meter) {
+    this->switching_baud_ = false;
+    meter->baud_rate_ = this->desired_baud_rate_(meter);
+    ESP_LOGI(TAG, "Meter %s: now at %u baud", meter->name_(), (unsigned) meter->baud_rate_);
+    // Latencies measured at the old rate no longer apply
+    for (auto &stats : meter->latency_)
+        stats.reset();
+    if (meter->baud_fallback_) {
+        // Start over at the power-on rate
+        meter->baud_fallback_ = false;
+        meter->init_state_ = 0;
+        meter->pending_ = true;
+    }
+}
+
+void BusMaster::set_bus_baud_rate_(uint32_t baud_rate) {
+    if (this->bus_baud_rate_ == baud_rate)
+        return;
+    ESP_LOGD(TAG, "Switching UART to %u baud", (unsigned) baud_rate);
+    SENSOSTAR_TRACE(trace_bus(TRACE_BAUD, this->clock_->bus_millis(), baud_rate));
+    this->uart_->bus_set_baud_rate(baud_rate);
+    this->bus_baud_rate_ = baud_rate;
+}
+
+void BusMaster::send_scan_(uint32_t now) {
+    this->parser_.reset();
+    if (this->scan_baud_reset_) {
+        // Broadcast, not answered: every meter at the configured rate returns to the default rate
+        ESP_LOGD(TAG, "Scan: switching meters back to %u baud", (unsigned) MBUS_DEFAULT_BAUD_RATE);
+        this->set_bus_baud_rate_(this->baud_rate_);
+        for (auto *meter : this->meters_) {
+            meter->baud_rate_ = MBUS_DEFAULT_BAUD_RATE;
+            meter->baud_probe_ = false;
+            for (auto &stats : meter->latency_)
+                stats.reset();
+        }
+        this->active_kind_ = REQUEST_INIT;
+        this->send_request_(mbus::C_SND_UD, mbus::ADDRESS_BROADCAST, mbus::baud_rate_to_ci(MBUS_DEFAULT_BAUD_RATE),
+                            nullptr, 0, now);
+        return;
+    }
+    this->set_bus_baud_rate_(MBUS_DEFAULT_BAUD_RATE);
+    this->active_kind_ = REQUEST_SELECT;
+    if (this->scan_read_) {
+        // Read the complete ID of the single meter that acknowledged
+        this->send_short_request_(mbus::C_REQ_UD2, mbus::ADDRESS_SECONDARY, now);
+        return;
+    }
+    uint32_t probe = this->scan_.probe();
+    uint8_t select[8] = { (uint8_t) probe, (uint8_t) (probe >> 8), (uint8_t) (probe >> 16), (uint8_t) (probe >> 24),
+        0xFF, 0xFF, 0xFF, 0xFF };
+    this->send_request_(mbus::C_SND_UD, mbus::ADDRESS_SECONDARY, mbus::CI_SELECT, select, sizeof(select), now);
+}
+
+void BusMaster::handle_scan_(mbus::ParseResult result, uint32_t now) {
+    if (!this->scan_read_) {
+        // Single acknowledge, anything else is a collision (handle_byte_())
+        this->scan_read_ = true;
+        this->finish_transaction_(now);
+        return;
+    }
+
+    if (result == mbus::ParseResult::FRAME && this->decoder_.is_rsp_ud()) {
+        uint32_t id = this->decoder_.header().id;
+        if (mbus::id_matches(this->scan_.probe(), id)) {
+            ESP_LOGD(TAG, "Scan: found ID %08X", (unsigned) id);
+            if (std::find(this->found_ids_.begin(), this->found_ids_.end(), id) == this->found_ids_.end())
+                this->found_ids_.push_back(id);
+            this->scan_result_(mbus::ScanResult::SINGLE, now);
+            return;
+        }
+    }
+    this->scan_result_(mbus::ScanResult::COLLISION, now);
+}
+
+void BusMaster::scan_result_(mbus::ScanResult result, uint32_t now) {
+    if (result == mbus::ScanResult::COLLISION && !mbus::id_has_wildcard(this->scan_.probe()))
+        ESP_LOGW(TAG, "Scan: several meters answer to ID %08X", (unsigned) this->scan_.probe());
+    this->scan_read_ = false;
+    this->scan_collision_ = false;
+    this->scan_.result(result);
+    this->parser_.reset();
+    this->finish_transaction_(now);
+    if (this->scan_.running())
+        return;
+
+    ESP_LOGI(TAG, "Scan: %u meters found with %u probes in %u ms", (unsigned) this->found_ids_.size(),
+             this->scan_.probes(), (unsigned) (now - this->scan_start_));
+    this->selected_ = nullptr;
+    if (!this->resolve_meters_())
+        ESP_LOGW(TAG, "Scan: not every meter with a wildcard secondary address was found");
+    this->listener_->on_scan_done(this->found_ids_);
+}
+
+uint32_t BusMaster::init_fingerprint(const BusMeter *meter) const {
+    // FNV-1 over everything the init sequence depends on
+    uint32_t hash = 2166136261UL;
+    auto add = [&hash](const uint8_t *data, size_t len) {
+        for (size_t i = 0; i < len; i++) {
+            hash *= 16777619UL;
+            hash ^= data[i];
+        }
+    };
+    add(INIT_PAYLOAD_1, sizeof(INIT_PAYLOAD_1));
+    add(INIT_PAYLOAD_2, sizeof(INIT_PAYLOAD_2));
+    add(INIT_PAYLOAD_3, sizeof(INIT_PAYLOAD_3));
+    add(INIT_PAYLOAD_4, sizeof(INIT_PAYLOAD_4));
+    add(INIT_PAYLOAD_5, sizeof(INIT_PAYLOAD_5));
+    const uint8_t address[5] = { meter->get_link_address(), (uint8_t) meter->resolved_id_, (uint8_t) (meter->resolved_id_ >> 8),
+        (uint8_t) (meter->resolved_id_ >> 16), (uint8_t) (meter->resolved_id_ >> 24) };
+    add(address, sizeof(address));
+    return hash;
+}
+
+void BusMaster::init_failed_(BusMeter *meter) {
+    ESP_LOGD(TAG, "Meter %s: no valid readout without init, running the init sequence", meter->name_());
+    this->listener_->on_init(meter, 0);
+    meter->init_verify_ = false;
+    meter->init_state_ = 0;
+    meter->FCB_ = false;
+    meter->failures_ = 0;
+    meter->pending_ = true;
+}
+
+BusMeter *BusMaster::next_meter_(uint32_t now) {
+    // Finish a meter's init sequence before switching to another one
+    for (auto *meter : this->meters_) {
+        if (!meter->is_initialized() && (meter->init_state_&0x10))
+            return meter;
+    }
+    // Avoid selecting again
+    if (this->selected_ != nullptr && this->selected_->pending_)
+        return this->selected_;
+
+    const size_t n = this->meters_.size();
+    BusMeter *best = nullptr;
+    size_t best_index = 0;
+    for (size_t k = 0; k < n; k++) {
+        size_t index = (this->next_index_ + k) % n;
+        BusMeter *meter = this->meters_[index];
+        if (!meter->pending_ || !meter->is_resolved())
+            continue;
+        // Backing off after repeated failures
+        if (meter->failures_ >= MBUS_MAX_RETRIES && (int32_t) (now - meter->retry_after_) < 0)
+            continue;
+        if (best == nullptr || (this->priority_scheduling_ && meter->priority_ > best->priority_)) {
+            best = meter;
+            best_index = index;
+        }
+        if (!this->priority_scheduling_)
+            break;
+    }
+    if (best != nullptr)
+        this->next_index_ = (best_index + 1) % n;
+    return best;
+}
+
+void BusMaster::loop() {
+    const uint32_t loop_start = this->clock_->bus_micros();
+    const uint32_t now = this->clock_->bus_millis();
+
+    // Keep feeding the request, the response timeout starts once it is on the wire
+    if (this->transmitting_)
+        this->transmit_(now);
+
+    if (this->uart_->bus_available()) {
+        // First response byte: latency from the end of the request on the wire
+        if (this->receiving_ == 1)
+            this->response_latency_ = (int32_t) (now - this->tx_end_) > 0 ? now - this->tx_end_ : 0;
+        this->last_transmission_ = now;
+    }
+
+    // Drain the UART in bulk into a stack chunk, then run the bytes through the frame assembler.
+    // This happens before the timeout check, so a late loop() does not drop a complete response.
+    uint8_t chunk[MBUS_RX_CHUNK_SIZE];
+    size_t avail;
+    while ((avail = this->uart_->bus_available()) > 0) {
+        if (avail > sizeof(chunk))
+            avail = sizeof(chunk);
+#ifdef USE_SENSOSTAR_STATS
+        const uint32_t receive_start = this->clock_->bus_micros();
+#endif
+        if (!this->uart_->bus_read(chunk, avail))
+            break;
+        SENSOSTAR_TRACE(trace_bus(TRACE_RX, now, chunk, avail));
+        // Straight from the receive chunk to the listener, the parser below sees the same bytes
+        if (this->external_)
+            this->listener_->on_external_data(chunk, avail);
+#ifdef USE_SENSOSTAR_STATS
+        const uint32_t decode_start = this->clock_->bus_micros();
+        this->stats_.time(STAGE_RECEIVE, decode_start - receive_start);
+        this->publish_time_ = 0;
+#endif
+        for (size_t n = 0; n < avail; n++)
+            this->handle_byte_(chunk[n], now);
+        SENSOSTAR_STATS(this->stats_.time(STAGE_DECODE, this->clock_->bus_micros() - decode_start - this->publish_time_));
+    }
+
+    if (this->receiving_ > 0 && !this->transmitting_ && now - this->last_transmission_ >= this->response_timeout_()) {
+        SENSOSTAR_TRACE(trace_bus(TRACE_TIMEOUT, now, this->response_timeout_()));
+        if (this->scan_.running() && this->scan_baud_reset_) {
+            this->scan_baud_reset_ = false;
+            this->scan_collision_ = false;
+        }
+        else if (this->scan_.running())
+            // A garbled answer, or an acknowledge without a readable ID: refine the prefix instead of dropping it
+            this->scan_result_(this->scan_collision_ || this->scan_read_ ? mbus::ScanResult::COLLISION
+                                                                          : mbus::ScanResult::NONE, now);
+        else if (this->deselecting_)
+            ESP_LOGW(TAG, "Meter %s: deselection not acknowledged", this->active_->name_());
+        else if (this->resetting_)
+            ESP_LOGW(TAG, "Meter %s: SND_NKE not acknowledged", this->active_->name_());
+        else if (this->active_ != nullptr)
+            this->handle_timeout_(now);
+        if (this->selecting_ || (this->resetting_ && this->active_->is_secondary())) {
+            this->selecting_ = false;
+            this->selected_ = nullptr;
+        }
+        this->deselecting_ = false;
+        this->resetting_ = false;
+        this->switching_baud_ = false;
+        this->parser_.reset();
+        this->finish_transaction_(now);
+    }
+
+    // One request at a time on the shared bus
+    if (this->receiving_ == 0 && now - this->last_transmission_ >= MBUS_INTERFRAME_DELAY) {
+        if (this->scan_.running())
+            this->send_scan_(now);
+        // Requests of the listener go first, between two transactions of the poll cycle
+        else if (!this->listener_->on_bus_free(now)) {
+            this->listener_->schedule(now);
+            BusMeter *meter = this->next_meter_(now);
+            if (meter != nullptr)
+                this->send_next_(meter, now);
+        }
+    }
+
+    const uint32_t loop_time = this->clock_->bus_micros() - loop_start;
+    if (loop_time > this->loop_time_max_)
+        this->loop_time_max_ = loop_time;
+}
+
+bool BusMaster::next_wakeup(uint32_t &at) const {
+    if (this->transmitting_) {
+        // Next chunk for the UART, or the end of the request on the wire
+        if (this->tx_pos_ < this->tx_size_) {
+            const uint32_t chars = this->tx_pos_ + 1 - std::min<size_t>(this->tx_pos_ + 1, this->tx_budget_);
+            at = this->tx_start_ + (chars * 11000 + this->bus_baud_rate_ - 1) / this->bus_baud_rate_;
+        }
+        else
+            at = this->tx_end_;
+        return true;
+    }
+    if (this->receiving_ > 0) {
+        at = this->last_transmission_ + this->response_timeout_();
+        return true;
+    }
+    // Next request after the interframe delay, or once the earliest backoff expired
+    const uint32_t next = this->last_transmission_ + MBUS_INTERFRAME_DELAY;
+    if (this->scan_.running()) {
+        at = next;
+        return true;
+    }
+    bool backing_off = false;
+    uint32_t retry = 0;
+    for (const auto *meter : this->meters_) {
+        if (!meter->is_initialized() && (meter->init_state_&0x10)) {
+            at = next;
+            return true;
+        }
+        if (!meter->pending_ || !meter->is_resolved())
+            continue;
+        if (meter->failures_ < MBUS_MAX_RETRIES) {
+            at = next;
+            return true;
+        }
+        if (!backing_off || (int32_t) (meter->retry_after_ - retry) < 0)
+            retry = meter->retry_after_;
+        backing_off = true;
+    }
+    if (!backing_off)
+        return false;
+    at = (int32_t) (retry - next) > 0 ? retry : next;
+    return true;
+}
+
+void BusMaster::send_next_(BusMeter *meter, uint32_t now) {
+    this->parser_.reset();
+
+    if (meter->is_secondary() && this->selected_ != nullptr && this->selected_ != meter &&
+        this->selected_->baud_rate_ != meter->baud_rate_) {
+        // The selection of another meter only deselects the meters listening at its rate: end the
+        // selection at the old rate first, and serve the meter on the next turn
+        BusMeter *selected = this->selected_;
+        this->selected_ = nullptr;
+        this->deselecting_ = true;
+        this->active_ = selected;
+        this->active_kind_ = REQUEST_SELECT;
+        this->next_index_ = std::find(this->meters_.begin(), this->meters_.end(), meter) - this->meters_.begin();
+        this->set_bus_baud_rate_(selected->baud_rate_);
+        this->send_short_request_(mbus::C_SND_NKE, mbus::ADDRESS_SECONDARY, now);
+        return;
+    }
+    this->set_bus_baud_rate_(meter->baud_rate_);
+
+    const uint8_t address = meter->get_link_address();
+    if (meter->is_secondary() && this->selected_ != meter) {
+        // Select the meter by its secondary address: ID (LSB first), wildcard manufacturer, version and medium
+        uint8_t select[8] = { (uint8_t) meter->resolved_id_, (uint8_t) (meter->resolved_id_ >> 8),
+            (uint8_t) (meter->resolved_id_ >> 16), (uint8_t) (meter->resolved_id_ >> 24), 0xFF, 0xFF, 0xFF, 0xFF };
+        this->selected_ = nullptr;
+        this->selecting_ = true;
+        this->active_ = meter;
+        this->active_kind_ = REQUEST_SELECT;
+        this->send_request_(mbus::C_SND_UD, mbus::ADDRESS_SECONDARY, mbus::CI_SELECT, select, sizeof(select), now);
+        return;
+    }
+
+    this->active_ = meter;
+    const uint32_t baud_rate = this->desired_baud_rate_(meter);
+    if (meter->is_initialized() && meter->baud_rate_ != baud_rate) {
+        // Baud rate switch, acknowledged at the current rate
+        this->switching_baud_ = true;
+        this->active_kind_ = REQUEST_INIT;
+        this->send_request_(mbus::C_SND_UD, address, mbus::baud_rate_to_ci(baud_rate), nullptr, 0, now);
+        return;
+    }
+
+    this->active_kind_ = meter->is_initialized() ? REQUEST_READOUT : REQUEST_INIT;
+    if (meter->init_state_ == 0x00 || meter->init_state_ == 0x01){
+        this->send_request_(mbus::C_SND_UD, address, mbus::CI_DATA_SEND, INIT_PAYLOAD_1, sizeof(INIT_PAYLOAD_1), now);
+        meter->init_state_ = 0x01;
+    }
+    else if (meter->init_state_ == 0x11 || meter->init_state_ == 0x02){
+        this->send_request_(mbus::C_SND_UD, address, mbus::CI_DATA_SEND, INIT_PAYLOAD_2, sizeof(INIT_PAYLOAD_2), now);
+        meter->init_state_ = 0x02;
+    }
+    else if (meter->init_state_ == 0x12 || meter->init_state_ == 0x03){
+        this->send_request_(mbus::C_SND_UD | mbus::C_FCB, address, mbus::CI_DATA_SEND, INIT_PAYLOAD_3, sizeof(INIT_PAYLOAD_3), now);
+        meter->init_state_ = 0x03;
+    }
+    else if (meter->init_state_ == 0x13 || meter->init_state_ == 0x04){
+        this->send_request_(mbus::C_SND_UD, address, mbus::CI_DATA_SEND, INIT_PAYLOAD_4, sizeof(INIT_PAYLOAD_4), now);
+        meter->init_state_ = 0x04;
+    }
+    else if (meter->init_state_ == 0x14 || meter->init_state_ == 0x05){
+        this->send_request_(mbus::C_SND_UD, address, mbus::CI_DATA_SEND, INIT_PAYLOAD_5, sizeof(INIT_PAYLOAD_5), now);
+        meter->init_state_ = 0x05;
+    }
+    else if (meter->init_state_ == 0x15){
+        // Initialized, the readout follows on the next pass
+        meter->init_state_ = 0xff;
+        this->listener_->on_init(meter, this->init_fingerprint(meter));
+        this->active_ = nullptr;
+    }
+    else if (meter->fcb_reset_) {
+        // A gateway client's request left the meter expecting its frame count bit: reset the link first
+        meter->fcb_reset_ = false;
+        meter->FCB_ = false;
+        this->resetting_ = true;
+        this->active_kind_ = REQUEST_SELECT;
+        this->send_short_request_(mbus::C_SND_NKE, address, now);
+    }
+    else {
+        meter->pending_ = false;
+        this->decoder_.set_filters(meter->record_filters_.data(), meter->record_filters_.size());
+
+        // FCB bit (FCV is part of SND_UD), toggled on a valid response so a retry repeats the request as is
+        uint8_t control = mbus::C_SND_UD;
+        if (meter->FCB_)
+            control |= mbus::C_FCB;
+
+        uint8_t payload[sizeof(POLL_PAYLOAD)];
+        size_t len = this->poll_payload_(meter, payload);
+        this->send_request_(control, address, mbus::CI_DATA_SEND, payload, len, now);
+    }
+}
+
+size_t BusMaster::poll_payload_(const BusMeter *meter, uint8_t *out) const {
+    if (!meter->selective_) {
+        memcpy(out, POLL_PAYLOAD, sizeof(POLL_PAYLOAD));
+        return sizeof(POLL_PAYLOAD);
+    }
+    memcpy(out, POLL_PAYLOAD, POLL_HEADER_SIZE);
+    size_t len = POLL_HEADER_SIZE;
+    const uint16_t mask = meter->readout_mask_();
+    for (const auto &item : READOUT_ITEMS) {
+        if (item.quantity != mbus::Quantity::NONE && (mask & (1 << static_cast<uint8_t>(item.quantity))))
+            out[len++] = item.item;
+    }
+    return len;
+}
+
+void BusMaster::selective_failed_(BusMeter *meter, const char *reason) {
+    ESP_LOGW(TAG, "Meter %s: selective readout %s, requesting all items", meter->name_(), reason);
+    meter->selective_ = false;
+}
+
+void BusMaster::send_request_(uint8_t control, uint8_t address, uint8_t ci, const uint8_t *payload, size_t len, uint32_t now) {
+    this->tx_size_ = mbus::build_long_frame(this->tx_buffer_, sizeof(this->tx_buffer_), control, address, ci, payload, len);
+    ESP_LOGV(TAG, "M-Bus write: %s", format_hex_pretty(this->tx_buffer_, this->tx_size_).c_str());
+    this->start_transmission_(now);
+}
+
+void BusMaster::send_short_request_(uint8_t control, uint8_t address, uint32_t now) {
+    this->tx_size_ = mbus::build_short_frame(this->tx_buffer_, control, address);
+    ESP_LOGV(TAG, "M-Bus write: %s", format_hex_pretty(this->tx_buffer_, this->tx_size_).c_str());
+    this->start_transmission_(now);
+}
+
+void BusMaster::start_transmission_(uint32_t now) {
+    SENSOSTAR_TRACE(trace_bus(TRACE_TX, now, this->tx_buffer_, this->tx_size_));
+    this->tx_pos_ = 0;
+    this->tx_start_ = now;
+    // 11 bits per character: start, 8 data, parity, stop
+    this->tx_end_ = now + this->tx_size_ * 11 * 1000 / this->bus_baud_rate_;
+    this->transmitting_ = true;
+    this->last_transmission_ = now;
+    this->response_latency_ = 0;
+    this->receiving_ = 1;
+    this->transmit_(now);
+}
+
+void BusMaster::transmit_(uint32_t now) {
+    // Characters that have left the UART since the start of the request
+    uint32_t on_wire = (uint32_t) (now - this->tx_start_) * this->bus_baud_rate_ / 11000;
+    size_t limit = std::min<size_t>(this->tx_size_, on_wire + this->tx_budget_);
+    if (this->tx_pos_ < limit) {
+        this->uart_->bus_write(this->tx_buffer_ + this->tx_pos_, limit - this->tx_pos_);
+        this->tx_pos_ = limit;
+    }
+    if (this->tx_pos_ == this->tx_size_ && (int32_t) (now - this->tx_end_) >= 0) {
+        this->transmitting_ = false;
+        this->last_transmission_ = now;
+    }
+}
+
+BusMeter *BusMaster::external_target_(const uint8_t *frame, size_t len, uint16_t address) const {
+    if (address == mbus::ADDRESS_SECONDARY) {
+        if (len < 11 || frame[0] != mbus::FRAME_START_LONG || frame[6] != mbus::CI_SELECT)
+            return this->selected_;
+        // Selection: the configured meter the ID (LSB first, may contain wildcards) resolves to
+        const uint32_t mask = frame[7] | frame[8] << 8 | frame[9] << 16 | (uint32_t) frame[10] << 24;
+        for (auto *meter : this->meters_) {
+            if (meter->is_secondary() && meter->is_resolved() && mbus::id_matches(mask, meter->resolved_id_))
+                return meter;
+        }
+        return nullptr;
+    }
+    for (auto *meter : this->meters_) {
+        if (!meter->is_secondary() && meter->address_ == address)
+            return meter;
+    }
+    return nullptr;
+}
+
+void BusMaster::send_external(const uint8_t *frame, size_t len, uint16_t address, uint32_t now) {
+    this->parser_.reset();
+    BusMeter *meter = this->external_target_(frame, len, address);
+    const bool long_frame = len >= 7 && frame[0] == mbus::FRAME_START_LONG;
+    const uint8_t control = long_frame ? frame[4] : len >= 2 ? frame[1] : 0;
+    // A meter switched to another baud rate only listens at its own; a single character goes out at
+    // the rate of the last transaction
+    if (meter != nullptr)
+        this->set_bus_baud_rate_(meter->baud_rate_);
+    else if (address != mbus::ADDRESS_NONE)
+        this->set_bus_baud_rate_(MBUS_DEFAULT_BAUD_RATE);
+    if (meter != nullptr)
+        this->decoder_.set_filters(meter->record_filters_.data(), meter->record_filters_.size());
+    else
+        this->decoder_.set_filters(nullptr, 0);
+    // A selection or SND_NKE to the secondary or broadcast addresses changes the selection on the bus,
+    // the acknowledged selection of a configured meter makes it the selected one
+    this->external_select_ = long_frame && address == mbus::ADDRESS_SECONDARY && frame[6] == mbus::CI_SELECT;
+    if (this->external_select_ || (control == mbus::C_SND_NKE && address >= mbus::ADDRESS_SECONDARY))
+        this->selected_ = nullptr;
+    // Its frame count bit is the client's now, the poller resets the link before its next readout
+    if (meter != nullptr && (control & mbus::C_FCV))
+        meter->fcb_reset_ = true;
+    this->external_meter_ = meter;
+
+    memcpy(this->tx_buffer_, frame, len);
+    this->tx_size_ = len;
+    this->external_ = true;
+    this->external_start_ = now;
+    this->start_transmission_(now);
+}
+
+void BusMaster::tee_frame_(uint32_t now) {
+    BusMeter *meter = this->external_meter_;
+    if (meter == nullptr || !this->decoder_.is_rsp_ud() || !this->decoder_.complete())
+        return;
+    // The answer of the meter the request went to: the selected ID, or the primary address it was sent
+    // to, which is the meter's own even when it is configured at 0xFE
+    bool match;
+    if (meter->is_secondary())
+        match = this->decoder_.header().id == meter->resolved_id_;
+    else
+        match = meter->address_ == mbus::ADDRESS_BROADCAST_REPLY || meter->address_ == this->parser_.address();
+    if (match && meter->is_initialized() && !meter->init_verify_) {
+        ESP_LOGD(TAG, "External request: response also published for meter %s", meter->name_());
+        this->publish_frame_(meter, now);
+    }
+}
+
+}  // namespace sensostar
+}  // namespace esphome
@@ -0,0 +1,287 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "mbus_frame.h"
+#include "mbus_decoder.h"
+#include "mbus_scan.h"
+#include "latency_stats.h"
+#include "sensostar_protocol.h"
+#include "bus_stats.h"
+#include "bus_trace.h"
+
+// The M-Bus master of SensoStarComponent: request scheduling, init sequence, FCB, response timeouts,
+// retries, backoff, baud rate negotiation and the secondary address scan. Plain C++ behind small UART
+// and clock interfaces, so the host simulation in tests/sim runs the same code as the device. Only
+// the ESPHome logging macros are used, the host build provides them in tests/shim.
+
+namespace esphome {
+namespace sensostar {
+
+// Bytes moved out of the UART per read call
+static const size_t MBUS_RX_CHUNK_SIZE = 64;
+// Bytes handed to the UART ahead of the estimated position on the wire; below the 128 byte
+// hardware FIFO, so a write never waits for the bus
+static const size_t MBUS_TX_FIFO_BUDGET = 64;
+// Unanswered selective readouts before a meter falls back to the full request
+static const uint8_t MBUS_SELECTIVE_MAX_FAILURES = 2;
+
+// Request kinds with separately measured response latencies
+enum RequestKind : uint8_t {
+  REQUEST_INIT = 0,
+  REQUEST_SELECT,
+  REQUEST_READOUT,
+  REQUEST_KIND_COUNT,
+};
+
+// The UART the master drives. Named apart from uart::UARTDevice, which the component implements it on.
+class BusUart {
+ public:
+  virtual size_t bus_available() = 0;
+  virtual bool bus_read(uint8_t *data, size_t len) = 0;
+  virtual void bus_write(const uint8_t *data, size_t len) = 0;
+  // Only called between transactions
+  virtual void bus_set_baud_rate(uint32_t baud_rate) = 0;
+};
+
+class BusClock {
+ public:
+  virtual uint32_t bus_millis() = 0;
+  virtual uint32_t bus_micros() = 0;
+};
+
+// Address and bus state of one meter, the base of SensoStarMeter
+class BusMeter {
+ public:
+  BusMeter() { this->update_name_(); }
+
+  void set_address(uint8_t address) {
+    this->address_ = address;
+    this->update_name_();
+  }
+  // BCD coded identification number, a 0xF nibble matches any digit
+  void set_secondary_address(uint32_t id) {
+    this->secondary_id_ = id;
+    this->secondary_ = true;
+    this->resolved_id_ = id;
+    this->resolved_ = !mbus::id_has_wildcard(id);
+    this->update_name_();
+  }
+  void set_priority(uint8_t priority) { this->priority_ = priority; }
+  // Request only the items of the quantities the configured sensors need instead of the full list
+  void set_selective_readout(bool selective) { this->selective_ = selective; }
+  // Called by the sensor platforms for every quantity a configured sensor depends on
+  void request_quantity(mbus::Quantity quantity) { this->requested_ |= 1 << static_cast<uint8_t>(quantity); }
+  // Skip the init sequence, e.g. completed before a reboot; the first readout verifies the meter still takes it
+  void assume_initialized() {
+    this->init_state_ = 0xff;
+    this->init_verify_ = true;
+  }
+
+  bool is_secondary() const { return this->secondary_; }
+  // A wildcard secondary address needs a bus scan before the meter can be polled
+  bool is_resolved() const { return !this->secondary_ || this->resolved_; }
+  // Address used in the A field of requests
+  uint8_t get_link_address() const { return this->secondary_ ? mbus::ADDRESS_SECONDARY : this->address_; }
+  uint8_t get_priority() const { return this->priority_; }
+  bool is_initialized() const { return this->init_state_ == 0xff; }
+
+ protected:
+  friend class BusMaster;
+
+  void update_name_();
+  // Waiting for a readout or in the middle of the init sequence
+  bool needs_bus_() const { return this->pending_ || (!this->is_initialized() && (this->init_state_&0x10)); }
+  // Description used in log messages
+  const char *name_() const { return this->name_buf_; }
+  // Quantities of a selective readout, the energy is always read to verify a skipped init sequence
+  uint16_t readout_mask_() const {
+    return this->requested_ | 1 << static_cast<uint8_t>(mbus::Quantity::ENERGY);
+  }
+
+  uint8_t address_{mbus::ADDRESS_BROADCAST_REPLY};
+  uint32_t secondary_id_{0}; // as configured, may contain wildcards
+  bool secondary_{false};
+  uint32_t resolved_id_{0};  // ID found by the scan, selected on the bus
+  bool resolved_{false};
+  uint8_t priority_{0};
+  bool selective_{false};
+  uint16_t requested_{0}; // Readout::present bits of the configured sensors
+  bool adaptive_{false};  // polled on its own schedule, not by update()
+  char name_buf_[20]{};
+  // Additional records decoded for this meter
+  std::vector<mbus::RecordFilter> record_filters_;
+
+  uint8_t init_state_{0};
+  bool init_verify_{false}; // init skipped, the first readout decides whether it is needed
+  bool pending_{true};
+  bool FCB_{false};
+  LatencyStats latency_[REQUEST_KIND_COUNT];
+  uint8_t failures_{0};     // consecutive requests without response
+  uint32_t retry_after_{0}; // backoff after MBUS_MAX_RETRIES failures
+  uint32_t baud_rate_{MBUS_DEFAULT_BAUD_RATE}; // rate the meter currently listens at
+  uint8_t baud_attempts_{0};  // failed baud rate negotiations
+  bool baud_fallback_{false}; // switch back to the default rate and run the init sequence again
+  bool baud_probe_{false};    // trying the configured rate on a meter not answering at the default rate
+  bool fcb_reset_{false};     // a gateway client's request may have toggled the frame count bit, SND_NKE first
+};
+
+// Duration of a poll cycle, from update() until every meter was served
+struct PollCycle {
+  uint8_t reads;
+  uint8_t meters;
+  uint32_t duration;      // ms
+  uint32_t loop_time_max; // us, longest BusMaster::loop()
+};
+
+// What the master hands to the rest of the component
+class BusListener {
+ public:
+  // Valid RSP_UD frame of the meter, checksum and stop checked
+  virtual void on_readout(BusMeter *meter, const mbus::RspUdDecoder &decoder, uint32_t now) = 0;
+  // Invalid answer, or no answer after the retries
+  virtual void on_unavailable(BusMeter *meter) = 0;
+  // Fingerprint of the init sequence the meter completed, 0 when it has to run it again
+  virtual void on_init(BusMeter * /*meter*/, uint32_t /*fingerprint*/) {}
+  virtual void on_scan_done(const std::vector<uint32_t> & /*ids*/) {}
+  virtual void on_cycle(const PollCycle & /*cycle*/) {}
+  // Before the master picks the next meter: meters with an own schedule are marked pending
+  virtual void schedule(uint32_t /*now*/) {}
+  // The bus is free; true after the listener started a request of its own with send_external()
+  virtual bool on_bus_free(uint32_t /*now*/) { return false; }
+  // Bytes received during an external request, as read from the UART
+  virtual void on_external_data(const uint8_t * /*data*/, size_t /*len*/) {}
+};
+
+class BusMaster {
+ public:
+  BusMaster(BusUart *uart, BusClock *clock, BusListener *listener);
+
+  void add_meter(BusMeter *meter) { this->meters_.push_back(meter); }
+  // Poll pending meters by priority instead of round-robin
+  void set_priority_scheduling(bool priority_scheduling) { this->priority_scheduling_ = priority_scheduling; }
+  bool is_priority_scheduling() const { return this->priority_scheduling_; }
+  // Baud rate negotiated with the meters after their init sequence
+  void set_baud_rate(uint32_t baud_rate) { this->baud_rate_ = baud_rate; }
+  uint32_t get_baud_rate() const { return this->baud_rate_; }
+  // Bytes handed to the UART ahead of the wire. A budget of a whole frame writes every request in
+  // one call, like the component did before the requests were fed in chunks.
+  void set_tx_budget(size_t budget) { this->tx_budget_ = budget; }
+
+  // IDs found by an earlier scan, false if a wildcard meter is not among them
+  bool restore_scan(const uint32_t *ids, size_t count);
+  // Search the bus for meters with wildcard secondary addresses again
+  void rescan();
+  bool is_scanning() const { return this->scan_.running(); }
+  uint16_t get_scan_probes() const { return this->scan_.probes(); }
+  const std::vector<uint32_t> &get_found_ids() const { return this->found_ids_; }
+  // FNV-1 over everything the init sequence of the meter depends on
+  uint32_t init_fingerprint(const BusMeter *meter) const;
+
+  // Starts a poll cycle: every meter without an own schedule is read
+  void update();
+  void loop();
+  // Time (ms) loop() has something to do without received bytes or update(), false if nothing.
+  // For hosts that skip idle time, like the simulation.
+  bool next_wakeup(uint32_t &at) const;
+
+  // Sends a complete frame from outside, e.g. a gateway client, from BusListener::on_bus_free().
+  // address: its A field, mbus::ADDRESS_NONE if it has none.
+  void send_external(const uint8_t *frame, size_t len, uint16_t address, uint32_t now);
+
+#ifdef USE_SENSOSTAR_STATS
+  BusStats &get_stats() { return this->stats_; }
+#endif
+
+ protected:
+  void handle_byte_(uint8_t c, uint32_t now);
+  void handle_frame_(uint32_t now);
+  // Hands the decoded RSP_UD frame to the listener as a readout of the meter
+  void publish_frame_(BusMeter *meter, uint32_t now);
+  BusMeter *next_meter_(uint32_t now);
+  void send_next_(BusMeter *meter, uint32_t now);
+  // Readout request for the items the meter needs, returns its length
+  size_t poll_payload_(const BusMeter *meter, uint8_t *out) const;
+  // The meter does not take the selective request, use the full one from now on
+  void selective_failed_(BusMeter *meter, const char *reason);
+  void send_request_(uint8_t control, uint8_t address, uint8_t ci, const uint8_t *payload, size_t len, uint32_t now);
+  void send_short_request_(uint8_t control, uint8_t address, uint32_t now);
+  void start_transmission_(uint32_t now);
+  void transmit_(uint32_t now);
+  void send_scan_(uint32_t now);
+  void handle_scan_(mbus::ParseResult result, uint32_t now);
+  void scan_result_(mbus::ScanResult result, uint32_t now);
+  bool resolve_meters_();
+  void finish_transaction_(uint32_t now);
+  void handle_response_();
+  void handle_timeout_(uint32_t now);
+  uint32_t response_timeout_() const;
+  uint32_t desired_baud_rate_(const BusMeter *meter) const;
+  void switched_baud_rate_(BusMeter *meter);
+  void set_bus_baud_rate_(uint32_t baud_rate);
+  void init_failed_(BusMeter *meter);
+  // Configured meter an external request goes to, nullptr if none or unknown
+  BusMeter *external_target_(const uint8_t *frame, size_t len, uint16_t address) const;
+  // Hands a RSP_UD frame received for an external request to the meter it came from
+  void tee_frame_(uint32_t now);
+
+  BusUart *uart_;
+  BusClock *clock_;
+  BusListener *listener_;
+
+  mbus::FrameParser parser_;
+  mbus::RspUdDecoder decoder_; // decodes records while the frame is received
+  uint32_t last_transmission_{0};
+  uint8_t receiving_{0};
+  uint8_t active_kind_{REQUEST_READOUT};
+  uint32_t tx_end_{0};           // estimated end of the last request on the wire
+  uint8_t tx_buffer_[mbus::MAX_FRAME_LENGTH];
+  uint16_t tx_size_{0};
+  uint16_t tx_pos_{0};           // bytes handed to the UART
+  size_t tx_budget_{MBUS_TX_FIFO_BUDGET};
+  uint32_t tx_start_{0};
+  bool transmitting_{false};     // request not completely on the wire yet, response timeout not started
+  uint32_t response_latency_{0}; // tx_end_ to first response byte
+
+  std::vector<BusMeter *> meters_;
+  BusMeter *active_{nullptr};   // meter the current request was sent to
+  BusMeter *selected_{nullptr}; // meter currently selected by secondary address
+  bool selecting_{false};
+  bool deselecting_{false}; // SND_NKE to the selected meter at its own baud rate
+  bool resetting_{false};   // SND_NKE to the active meter after a gateway client talked to it
+  bool switching_baud_{false};
+  uint32_t baud_rate_{MBUS_DEFAULT_BAUD_RATE};
+  uint32_t bus_baud_rate_{MBUS_DEFAULT_BAUD_RATE}; // rate the UART is currently set to
+  bool priority_scheduling_{false};
+  size_t next_index_{0};
+
+  // Request sent for the listener, its answer is forwarded
+  bool external_{false};
+  uint32_t external_start_{0};
+  BusMeter *external_meter_{nullptr}; // configured meter the request goes to
+  bool external_select_{false};       // the request selects external_meter_ by its secondary address
+
+  // Secondary address scan
+  mbus::SecondaryScan scan_;
+  bool scan_read_{false}; // probe acknowledged, reading the ID of the selected meter
+  bool scan_collision_{false}; // probe answered with something else than a single acknowledge
+  bool scan_baud_reset_{false}; // meters are sent back to the default baud rate before the first probe
+  uint32_t scan_start_{0};
+  std::vector<uint32_t> found_ids_;
+
+  // Poll cycle statistics
+  uint32_t cycle_start_{0};
+  uint8_t cycle_reads_{0};
+  bool cycle_active_{false};
+  uint32_t loop_time_max_{0}; // us, worst loop() during the cycle
+
+#ifdef USE_SENSOSTAR_STATS
+  BusStats stats_;
+  uint32_t publish_time_{0}; // us spent publishing during the current chunk, not counted as decoding
+#endif
+};
+
+}  // namespace sensostar
+}  // namespace esphome
@@ -0,0 +1,49 @@
+#include "bus_stats.h"
+
+#ifdef USE_SENSOSTAR_STATS
+
+#include "esphome/core/log.h"
+
+#include <cstdio>
+
+namespace esphome {
+namespace sensostar {
+
+static const char *const STAGE_NAMES[BUS_STAGE_COUNT] = {"receive", "decode", "publish"};
+
+void BusStats::time(BusStage stage, uint32_t us) {
+    uint8_t bucket = 0;
+    while (bucket < STAGE_HISTOGRAM_BUCKETS - 1 && us >= (STAGE_HISTOGRAM_BASE << bucket))
+        bucket++;
+    this->histogram_[stage][bucket]++;
+    if (us > this->max_[stage])
+        this->max_[stage] = us;
+}
+
+uint32_t BusStats::take_max(BusStage stage) {
+    uint32_t max = this->max_[stage];
+    this->max_[stage] = 0;
+    return max;
+}
+
+void BusStats::dump(const char *tag) const {
+    ESP_LOGD(tag, "Bus: %u frames, %u acks, errors start/length/stop/checksum %u/%u/%u/%u, %u unknown, %u timeouts, %u retries",
+             (unsigned) this->counters_[COUNTER_FRAMES], (unsigned) this->counters_[COUNTER_ACKS],
+             (unsigned) this->counters_[COUNTER_ERROR_START], (unsigned) this->counters_[COUNTER_ERROR_LENGTH],
+             (unsigned) this->counters_[COUNTER_ERROR_STOP], (unsigned) this->counters_[COUNTER_ERROR_CHECKSUM],
+             (unsigned) this->counters_[COUNTER_UNKNOWN_FRAMES], (unsigned) this->counters_[COUNTER_TIMEOUTS],
+             (unsigned) this->counters_[COUNTER_RETRIES]);
+    for (uint8_t stage = 0; stage < BUS_STAGE_COUNT; stage++) {
+        // Counts per bucket, <32us first
+        char line[STAGE_HISTOGRAM_BUCKETS * 11 + 1];
+        size_t len = 0;
+        for (uint8_t i = 0; i < STAGE_HISTOGRAM_BUCKETS; i++)
+            len += snprintf(line + len, sizeof(line) - len, i ? " %u" : "%u", (unsigned) this->histogram_[stage][i]);
+        ESP_LOGD(tag, "Bus %s time, buckets <%uus doubling: %s", STAGE_NAMES[stage], (unsigned) STAGE_HISTOGRAM_BASE, line);
+    }
+}
+
+}  // namespace sensostar
+}  // namespace esphome
+
+#endif  // USE_SENSOSTAR_STATS
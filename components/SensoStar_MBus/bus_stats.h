@@ -0,0 +1,59 @@
+#pragma once
+
+#include "esphome/core/defines.h"
+
+#include <cstdint>
+
+namespace esphome {
+namespace sensostar {
+
+// Statements only compiled in with the bus statistics
+#ifdef USE_SENSOSTAR_STATS
+#define SENSOSTAR_STATS(...) __VA_ARGS__
+#else
+#define SENSOSTAR_STATS(...)
+#endif
+
+enum BusCounter : uint8_t {
+  COUNTER_FRAMES = 0,     // valid long frames
+  COUNTER_ACKS,
+  COUNTER_ERROR_START,    // same order as the ParseResult errors
+  COUNTER_ERROR_LENGTH,
+  COUNTER_ERROR_STOP,
+  COUNTER_ERROR_CHECKSUM,
+  COUNTER_UNKNOWN_FRAMES, // valid frame but no RSP_UD
+  COUNTER_TIMEOUTS,
+  COUNTER_RETRIES,
+  BUS_COUNTER_COUNT,
+};
+
+// Parts of SensoStarComponent::loop() that are timed
+enum BusStage : uint8_t {
+  STAGE_RECEIVE = 0, // reading the UART
+  STAGE_DECODE,      // frame parser and record decoder
+  STAGE_PUBLISH,     // publishing a readout
+  BUS_STAGE_COUNT,
+};
+
+// Bucket i counts durations below STAGE_HISTOGRAM_BASE << i us, the last one everything longer
+static const uint8_t STAGE_HISTOGRAM_BUCKETS = 10;
+static const uint32_t STAGE_HISTOGRAM_BASE = 32;
+
+class BusStats {
+ public:
+  void count(BusCounter counter) { this->counters_[counter]++; }
+  uint32_t get(BusCounter counter) const { return this->counters_[counter]; }
+  void time(BusStage stage, uint32_t us);
+  // Longest duration of a stage since the last call
+  uint32_t take_max(BusStage stage);
+  // One line per stage plus one for the counters
+  void dump(const char *tag) const;
+
+ protected:
+  uint32_t counters_[BUS_COUNTER_COUNT]{};
+  uint32_t histogram_[BUS_STAGE_COUNT][STAGE_HISTOGRAM_BUCKETS]{};
+  uint32_t max_[BUS_STAGE_COUNT]{};
+};
+
+}  // namespace sensostar
+}  // namespace esphome
@@ -0,0 +1,35 @@
+#include "bus_trace.h"
+
+#ifdef USE_SENSOSTAR_TRACE
+
+#include "esphome/core/log.h"
+
+namespace esphome {
+namespace sensostar {
+
+static const char *const TAG = "sensostar.trace";
+static const char *const TRACE_NAMES[] = {"TX", "RX", "BAUD", "TIMEOUT"};
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+void trace_bus(TraceEvent event, uint32_t now, const uint8_t *data, size_t len) {
+    char line[2 * TRACE_BYTES_PER_LINE + 1];
+    size_t pos = 0;
+    do {
+        size_t n = 0;
+        for (; n < TRACE_BYTES_PER_LINE && pos < len; n++, pos++) {
+            line[2 * n] = HEX_DIGITS[data[pos] >> 4];
+            line[2 * n + 1] = HEX_DIGITS[data[pos] & 0x0F];
+        }
+        line[2 * n] = '\0';
+        ESP_LOGI(TAG, "%u %s %s", (unsigned) now, TRACE_NAMES[event], line);
+    } while (pos < len);
+}
+
+void trace_bus(TraceEvent event, uint32_t now, uint32_t value) {
+    ESP_LOGI(TAG, "%u %s %u", (unsigned) now, TRACE_NAMES[event], (unsigned) value);
+}
+
+}  // namespace sensostar
+}  // namespace esphome
+
+#endif
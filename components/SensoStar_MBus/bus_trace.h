@@ -0,0 +1,34 @@
+#pragma once
+
+#include "esphome/core/defines.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+namespace sensostar {
+
+// Statements only compiled in with the bus trace
+#ifdef USE_SENSOSTAR_TRACE
+#define SENSOSTAR_TRACE(...) __VA_ARGS__
+#else
+#define SENSOSTAR_TRACE(...)
+#endif
+
+enum TraceEvent : uint8_t {
+  TRACE_TX = 0,  // request handed to the transmitter, complete frame
+  TRACE_RX,      // bytes as read from the UART
+  TRACE_BAUD,    // UART switched, value is the new baud rate
+  TRACE_TIMEOUT, // response timeout expired
+};
+
+// Longest hex run per log line, longer data continues on the next line with the same time
+static const size_t TRACE_BYTES_PER_LINE = 64;
+
+// Writes the bus traffic as log lines "<ms> <event> <hex or value>" with the tag
+// "sensostar.trace", to feed a recorded session to the frame parser or a simulated meter
+void trace_bus(TraceEvent event, uint32_t now, const uint8_t *data, size_t len);
+void trace_bus(TraceEvent event, uint32_t now, uint32_t value);
+
+}  // namespace sensostar
+}  // namespace esphome
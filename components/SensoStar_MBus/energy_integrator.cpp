@@ -0,0 +1,65 @@
+#include "energy_integrator.h"
+
+#include <cmath>
+
+namespace esphome {
+namespace sensostar {
+
+float water_table_lookup(const float *table, float temperature) {
+    float position = temperature / WATER_TABLE_STEP;
+    if (!(position > 0)) // also NaN
+        return table[0];
+    if (position >= WATER_TABLE_SIZE - 1)
+        return table[WATER_TABLE_SIZE - 1];
+    uint8_t i = (uint8_t) position;
+    float fraction = position - i;
+    return table[i] + (table[i + 1] - table[i]) * fraction;
+}
+
+double thermal_power(double flow, double tdiff, float t_volume, float t_mean) {
+    double mass_flow = flow / 3600.0 * water_table_lookup(WATER_DENSITY, t_volume); // kg/s
+    return mass_flow * water_table_lookup(WATER_HEAT_CAPACITY, t_mean) * tdiff;
+}
+
+void EnergyIntegrator::reset(double value) {
+    this->sum_ = value;
+    this->compensation_ = 0;
+    this->has_sample_ = false;
+}
+
+void EnergyIntegrator::add(double power, uint32_t now) {
+    if (this->has_sample_) {
+        // W * ms -> kWh
+        double increment = (this->last_power_ + power) / 2.0 * (double)(uint32_t)(now - this->last_time_) / 3.6e9;
+        double y = increment - this->compensation_;
+        double t = this->sum_ + y;
+        this->compensation_ = (t - this->sum_) - y;
+        this->sum_ = t;
+    }
+    this->last_power_ = power;
+    this->last_time_ = now;
+    this->has_sample_ = true;
+}
+
+double RegisterInterpolator::update(double energy, double power, uint32_t now) {
+    if (this->register_ < 0 || floor(energy) != floor(this->register_)) {
+        // First readout, a step, or the register went backwards
+        this->register_ = energy;
+        this->integrator_.reset(energy);
+        if (power >= 0)
+            this->integrator_.add(power, now);
+        return energy;
+    }
+    this->register_ = energy;
+    if (power < 0) {
+        this->integrator_.restart();
+        return NAN;
+    }
+    this->integrator_.add(power, now);
+    if (floor(this->integrator_.value()) != floor(energy))
+        return NAN;
+    return this->integrator_.value();
+}
+
+}  // namespace sensostar
+}  // namespace esphome
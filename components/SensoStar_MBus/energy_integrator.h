@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+
+// Plain C++ heat and energy calculations, no ESPHome dependencies
+
+namespace esphome {
+namespace sensostar {
+
+// Properties of water at 1 bar, tabulated every WATER_TABLE_STEP °C from 0 °C
+static const float WATER_TABLE_STEP = 10.0f;
+static const uint8_t WATER_TABLE_SIZE = 11;
+// kg/m3
+static constexpr float WATER_DENSITY[WATER_TABLE_SIZE] = {999.84f, 999.70f, 998.21f, 995.65f, 992.22f, 988.03f,
+                                                          983.20f, 977.76f, 971.79f, 965.31f, 958.35f};
+// J/(kg K)
+static constexpr float WATER_HEAT_CAPACITY[WATER_TABLE_SIZE] = {4219.9f, 4195.5f, 4184.1f, 4179.6f, 4178.5f, 4180.6f,
+                                                                4184.9f, 4190.8f, 4198.6f, 4208.3f, 4215.6f};
+// Used for both temperatures when the meter does not report them
+static const float WATER_DEFAULT_TEMPERATURE = 50.0f;
+
+// Linear interpolation in one of the tables above, clamped to 0..100 °C
+float water_table_lookup(const float *table, float temperature);
+
+// Thermal power in W for a volume flow in m3/h measured at t_volume, and a temperature
+// difference in K; the heat capacity is taken at the mean of flow and return temperature
+double thermal_power(double flow, double tdiff, float t_volume, float t_mean);
+
+// Energy in kWh accumulated from power samples with the trapezoidal rule. The sum is
+// Kahan-compensated, so small increments are not lost on a large meter register.
+class EnergyIntegrator {
+ public:
+  // Restart at value, the next sample only sets the reference
+  void reset(double value);
+  // Forget the previous sample, e.g. after a gap in the readings
+  void restart() { this->has_sample_ = false; }
+  // Power in W, now in ms
+  void add(double power, uint32_t now);
+
+  double value() const { return this->sum_; }
+
+ protected:
+  double sum_{0};
+  double compensation_{0};
+  double last_power_{0};
+  uint32_t last_time_{0};
+  bool has_sample_{false};
+};
+
+// The meter's energy register between its kWh steps: the register plus the power integrated since
+// the last readout, held below the next step until the register reaches it. Takes the register as
+// it is when it steps, and starts over when it goes backwards (meter replaced or reset).
+class RegisterInterpolator {
+ public:
+  // Register in kWh, power in W or negative if not reported, now in ms. Returns the value to
+  // publish, NAN if the last one still holds.
+  double update(double energy, double power, uint32_t now);
+  // Forget the power sample, e.g. after readouts were missed
+  void restart() { this->integrator_.restart(); }
+
+ protected:
+  EnergyIntegrator integrator_;
+  double register_{-1};
+};
+
+}  // namespace sensostar
+}  // namespace esphome
@@ -0,0 +1,107 @@
+#include "history.h"
+#include "esphome/core/helpers.h"
+#include "esphome/core/log.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace esphome {
+namespace sensostar {
+
+static const char *const TAG = "SensoStar";
+
+bool HistoryBuffer::init(uint16_t blocks) {
+    RAMAllocator<HistoryBlock> allocator;
+    this->blocks_ = allocator.allocate(blocks);
+    if (this->blocks_ == nullptr) {
+        ESP_LOGE(TAG, "Could not allocate %u history blocks", blocks);
+        return false;
+    }
+    memset(this->blocks_, 0, blocks * sizeof(HistoryBlock));
+    this->capacity_ = blocks;
+    return true;
+}
+
+void HistoryBuffer::setup_persistence(uint32_t key, uint8_t slots) {
+    if (this->capacity_ == 0)
+        return;
+    slots = std::min<uint16_t>(slots, this->capacity_);
+
+    // Restore the stored blocks in sequence order
+    std::vector<uint32_t> sequences;
+    for (uint8_t i = 0; i < slots; i++) {
+        this->slots_.push_back(global_preferences->make_preference<HistoryBlock>(key + i, true));
+        HistoryBlock *block = &this->blocks_[i];
+        if (!this->slots_[i].load(block) || block->sequence == 0 || block->used > HISTORY_BLOCK_DATA_SIZE)
+            memset(block, 0, sizeof(HistoryBlock));
+    }
+    std::sort(this->blocks_, this->blocks_ + slots, [](const HistoryBlock &a, const HistoryBlock &b) {
+        // Unused blocks last
+        return a.sequence != 0 && (b.sequence == 0 || a.sequence < b.sequence);
+    });
+    while (this->size_ < slots && this->blocks_[this->size_].sequence != 0)
+        this->size_++;
+    if (this->size_ == 0)
+        return;
+
+    HistoryBlock *newest = this->at_(this->size_ - 1);
+    this->next_sequence_ = newest->sequence + 1;
+    this->encoder_.begin(newest);
+    ESP_LOGD(TAG, "Restored %u history blocks", this->size_);
+}
+
+HistoryBlock *HistoryBuffer::start_block_(uint32_t time, uint8_t flags) {
+    if (this->size_ == this->capacity_) {
+        this->first_ = (this->first_ + 1) % this->capacity_;
+        this->size_--;
+    }
+    HistoryBlock *block = this->at_(this->size_++);
+    memset(block, 0, sizeof(HistoryBlock));
+    block->sequence = this->next_sequence_++;
+    block->start_time = time;
+    block->flags = flags;
+    this->encoder_.begin(block);
+    return block;
+}
+
+void HistoryBuffer::add(const HistoryRecord &record, uint8_t flags, uint32_t now) {
+    if (this->capacity_ == 0)
+        return;
+
+    LockGuard guard(this->lock_);
+    HistoryBlock *block = this->size_ ? this->at_(this->size_ - 1) : nullptr;
+    if (block == nullptr || block->flags != flags || !this->encoder_.append(record)) {
+        // The completed block is final, store it before it gets evicted from the ring
+        if (block != nullptr)
+            this->persist_(block, now);
+        this->start_block_(record.time, flags);
+        this->encoder_.append(record);
+    }
+    else if ((uint32_t)(now - this->last_persist_) >= HISTORY_FLASH_INTERVAL) {
+        this->persist_(block, now);
+    }
+}
+
+void HistoryBuffer::persist_(const HistoryBlock *block, uint32_t now) {
+    // Uptime timestamps are meaningless after a reboot
+    if (this->slots_.empty() || (block->flags & HISTORY_FLAG_UPTIME))
+        return;
+    // Preferences are committed to flash by the next global sync
+    this->slots_[block->sequence % this->slots_.size()].save(block);
+    this->last_persist_ = now;
+}
+
+bool HistoryBuffer::copy(uint32_t sequence, HistoryBlock &out) const {
+    LockGuard guard(this->lock_);
+    for (uint16_t i = 0; i < this->size_; i++) {
+        const HistoryBlock *block = this->at_(i);
+        if (block->sequence >= sequence) {
+            memcpy(&out, block, sizeof(HistoryBlock));
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace sensostar
+}  // namespace esphome
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "esphome/core/defines.h"
+#include "esphome/core/helpers.h"
+#include "esphome/core/preferences.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "history_codec.h"
+
+namespace esphome {
+namespace sensostar {
+
+// The block being filled is written to flash at most this often (ms)
+static const uint32_t HISTORY_FLASH_INTERVAL = 15 * 60 * 1000;
+
+// Fixed-size ring of history blocks, the oldest block is dropped when all are used.
+// add() runs in loop(), copy() may run in another task (the web server on ESP32).
+class HistoryBuffer {
+ public:
+  // Allocates the blocks, preferably in PSRAM
+  bool init(uint16_t blocks);
+  // Keeps the newest `slots` blocks in flash, rotating over the slots to spread the writes
+  void setup_persistence(uint32_t key, uint8_t slots);
+
+  void add(const HistoryRecord &record, uint8_t flags, uint32_t now);
+
+  uint16_t capacity() const { return this->capacity_; }
+  uint16_t size() const { return this->size_; }
+  // Copies the oldest stored block with a sequence number >= sequence, false if there is none
+  bool copy(uint32_t sequence, HistoryBlock &out) const;
+
+ protected:
+  HistoryBlock *at_(uint16_t i) const { return &this->blocks_[(this->first_ + i) % this->capacity_]; }
+  HistoryBlock *start_block_(uint32_t time, uint8_t flags);
+  void persist_(const HistoryBlock *block, uint32_t now);
+
+  HistoryBlock *blocks_{nullptr};
+  uint16_t capacity_{0};
+  uint16_t first_{0};
+  uint16_t size_{0};
+  uint32_t next_sequence_{1};
+  HistoryEncoder encoder_;
+
+  std::vector<ESPPreferenceObject> slots_;
+  uint32_t last_persist_{0};
+  mutable Mutex lock_; // ring and block contents between add() and copy()
+};
+
+}  // namespace sensostar
+}  // namespace esphome
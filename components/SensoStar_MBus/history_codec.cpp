@@ -0,0 +1,110 @@
+#include "history_codec.h"
+
+#include <cstring>
+
+namespace esphome {
+namespace sensostar {
+
+static uint8_t *write_varint(uint8_t *p, uint32_t value) {
+    while (value >= 0x80) {
+        *p++ = (uint8_t)value | 0x80;
+        value >>= 7;
+    }
+    *p++ = (uint8_t)value;
+    return p;
+}
+
+static uint32_t zigzag_encode(int32_t value) { return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31); }
+static int32_t zigzag_decode(uint32_t value) { return (int32_t)(value >> 1) ^ -(int32_t)(value & 1); }
+
+void HistoryEncoder::begin(HistoryBlock *block) {
+    this->block_ = block;
+    this->last_time_ = block->start_time;
+    memset(this->last_values_, 0, sizeof(this->last_values_));
+
+    // Continue after the records already in the block
+    HistoryBlockReader reader(*block);
+    HistoryRecord record;
+    while (reader.next(record)) {
+        this->last_time_ = record.time;
+        for (uint8_t i = 0; i < HISTORY_FIELD_COUNT; i++) {
+            if (record.present & (1 << i))
+                this->last_values_[i] = record.values[i];
+        }
+    }
+}
+
+bool HistoryEncoder::append(const HistoryRecord &record) {
+    HistoryBlock *block = this->block_;
+    if (block == nullptr || record.time < this->last_time_ || block->count == 0xff)
+        return false;
+
+    uint8_t buffer[HISTORY_MAX_RECORD_SIZE];
+    uint8_t *p = buffer;
+    *p++ = record.present;
+    p = write_varint(p, record.time - this->last_time_);
+    // Deltas are taken modulo 2^32, the reader wraps its sums the same way
+    for (uint8_t i = 0; i < HISTORY_FIELD_COUNT; i++) {
+        if (record.present & (1 << i))
+            p = write_varint(p, zigzag_encode((int32_t)((uint32_t)record.values[i] - (uint32_t)this->last_values_[i])));
+    }
+    size_t len = p - buffer;
+    if (block->used + len > HISTORY_BLOCK_DATA_SIZE)
+        return false;
+
+    memcpy(block->data + block->used, buffer, len);
+    block->used += len;
+    block->count++;
+    this->last_time_ = record.time;
+    for (uint8_t i = 0; i < HISTORY_FIELD_COUNT; i++) {
+        if (record.present & (1 << i))
+            this->last_values_[i] = record.values[i];
+    }
+    return true;
+}
+
+void HistoryBlockReader::begin(const HistoryBlock &block) {
+    this->block_ = &block;
+    this->pos_ = 0;
+    this->index_ = 0;
+    this->last_time_ = block.start_time;
+    memset(this->last_values_, 0, sizeof(this->last_values_));
+}
+
+bool HistoryBlockReader::read_varint_(uint32_t &value) {
+    value = 0;
+    for (uint8_t shift = 0; shift < 35; shift += 7) {
+        if (this->pos_ >= this->block_->used)
+            return false;
+        uint8_t c = this->block_->data[this->pos_++];
+        value |= (uint32_t)(c & 0x7f) << shift;
+        if ((c & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+bool HistoryBlockReader::next(HistoryRecord &record) {
+    if (this->block_ == nullptr || this->index_ >= this->block_->count || this->pos_ >= this->block_->used)
+        return false;
+
+    uint32_t value;
+    record.present = this->block_->data[this->pos_++];
+    if (!this->read_varint_(value))
+        return false;
+    record.time = this->last_time_ + value;
+    for (uint8_t i = 0; i < HISTORY_FIELD_COUNT; i++) {
+        if (record.present & (1 << i)) {
+            if (!this->read_varint_(value))
+                return false;
+            this->last_values_[i] = (int32_t)((uint32_t)this->last_values_[i] + (uint32_t)zigzag_decode(value));
+        }
+        record.values[i] = this->last_values_[i];
+    }
+    this->last_time_ = record.time;
+    this->index_++;
+    return true;
+}
+
+}  // namespace sensostar
+}  // namespace esphome
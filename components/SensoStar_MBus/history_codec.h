@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Plain C++ encoding of the reading history, no ESPHome dependencies
+
+namespace esphome {
+namespace sensostar {
+
+// Values kept per reading, stored as integers in the given unit
+enum HistoryField : uint8_t {
+  HISTORY_ENERGY = 0,         // Wh
+  HISTORY_VOLUME,             // l
+  HISTORY_TEMPERATURE_FLOW,   // 0.01 °C
+  HISTORY_TEMPERATURE_RETURN, // 0.01 °C
+  HISTORY_POWER,              // W
+  HISTORY_FLOW,               // l/h
+  HISTORY_FIELD_COUNT,
+};
+
+// Readout units per stored unit
+static const float HISTORY_FIELD_SCALE[HISTORY_FIELD_COUNT] = {1000.0f, 1000.0f, 100.0f, 100.0f, 1.0f, 1000.0f};
+
+// Blocks are the unit of eviction and of flash persistence
+static const size_t HISTORY_BLOCK_SIZE = 256;
+static const size_t HISTORY_BLOCK_DATA_SIZE = HISTORY_BLOCK_SIZE - 12;
+// Mask byte, time delta and one delta per field, each varint takes at most 5 bytes
+static const size_t HISTORY_MAX_RECORD_SIZE = 1 + 5 * (1 + HISTORY_FIELD_COUNT);
+// Timestamps are uptime seconds instead of UNIX time
+static const uint8_t HISTORY_FLAG_UPTIME = 0x01;
+
+struct HistoryRecord {
+  uint32_t time;
+  uint8_t present; // bit per HistoryField
+  int32_t values[HISTORY_FIELD_COUNT];
+};
+
+// Records are [present mask][varint time delta][zigzag varint value delta per present field],
+// deltas relative to the previous record of the same block, so every block decodes on its own
+struct HistoryBlock {
+  uint32_t sequence;   // 0 = unused
+  uint32_t start_time; // reference for the first time delta
+  uint16_t used;
+  uint8_t count;
+  uint8_t flags;
+  uint8_t data[HISTORY_BLOCK_DATA_SIZE];
+};
+static_assert(sizeof(HistoryBlock) == HISTORY_BLOCK_SIZE, "HistoryBlock must not be padded");
+
+// Encoding state of one block, also used to append to a block restored from flash
+class HistoryEncoder {
+ public:
+  void begin(HistoryBlock *block);
+  // False if the record does not fit, the block is not changed then
+  bool append(const HistoryRecord &record);
+
+ protected:
+  HistoryBlock *block_{nullptr};
+  uint32_t last_time_{0};
+  int32_t last_values_[HISTORY_FIELD_COUNT];
+};
+
+class HistoryBlockReader {
+ public:
+  HistoryBlockReader() = default;
+  explicit HistoryBlockReader(const HistoryBlock &block) { this->begin(block); }
+  void begin(const HistoryBlock &block);
+  bool next(HistoryRecord &record);
+
+ protected:
+  bool read_varint_(uint32_t &value);
+
+  const HistoryBlock *block_{nullptr};
+  uint16_t pos_{0};
+  uint8_t index_{0};
+  uint32_t last_time_{0};
+  int32_t last_values_[HISTORY_FIELD_COUNT];
+};
+
+}  // namespace sensostar
+}  // namespace esphome
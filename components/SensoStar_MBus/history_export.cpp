@@ -0,0 +1,109 @@
+#include "history_export.h"
+
+#ifdef USE_SENSOSTAR_HISTORY
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#ifdef USE_SENSOSTAR_HISTORY_EXPORT
+#ifdef USE_ESP32
+#include <esp_http_server.h>
+#endif
+#include <memory>
+#endif
+
+namespace esphome {
+namespace sensostar {
+
+size_t HistoryCsvWriter::read(char *buffer, size_t size) {
+    size_t written = 0;
+    while (written < size) {
+        if (this->line_pos_ == this->line_length_ && !this->next_line_())
+            break;
+        size_t n = std::min(size - written, this->line_length_ - this->line_pos_);
+        memcpy(buffer + written, this->line_ + this->line_pos_, n);
+        this->line_pos_ += n;
+        written += n;
+    }
+    return written;
+}
+
+bool HistoryCsvWriter::next_block_() {
+    while (this->meter_index_ < this->meters_.size()) {
+        const HistoryBuffer *history = this->meters_[this->meter_index_]->get_history();
+        if (history != nullptr && history->copy(this->next_sequence_, this->block_)) {
+            this->next_sequence_ = this->block_.sequence + 1;
+            this->reader_.begin(this->block_);
+            return true;
+        }
+        this->meter_index_++;
+        this->next_sequence_ = 0;
+    }
+    return false;
+}
+
+bool HistoryCsvWriter::next_line_() {
+    this->line_pos_ = 0;
+    if (!this->header_) {
+        this->header_ = true;
+        this->line_length_ = snprintf(this->line_, sizeof(this->line_),
+            "meter,clock,time,energy_kwh,volume_m3,temperature_flow_c,temperature_return_c,power_w,flow_m3h\n");
+        return true;
+    }
+
+    HistoryRecord record;
+    while (!this->in_block_ || !this->reader_.next(record)) {
+        this->in_block_ = this->next_block_();
+        if (!this->in_block_) {
+            this->line_length_ = 0;
+            return false;
+        }
+    }
+
+    size_t len = snprintf(this->line_, sizeof(this->line_), "%s,%s,%u",
+        this->meters_[this->meter_index_]->name_(),
+        (this->block_.flags & HISTORY_FLAG_UPTIME) ? "uptime" : "unix", (unsigned) record.time);
+    for (uint8_t i = 0; i < HISTORY_FIELD_COUNT && len < sizeof(this->line_); i++) {
+        if (record.present & (1 << i))
+            len += snprintf(this->line_ + len, sizeof(this->line_) - len, ",%.3f", record.values[i] / HISTORY_FIELD_SCALE[i]);
+        else
+            len += snprintf(this->line_ + len, sizeof(this->line_) - len, ",");
+    }
+    if (len < sizeof(this->line_) - 1)
+        this->line_[len++] = '\n';
+    this->line_length_ = std::min(len, sizeof(this->line_) - 1);
+    return true;
+}
+
+#ifdef USE_SENSOSTAR_HISTORY_EXPORT
+bool HistoryExportHandler::canHandle(AsyncWebServerRequest *request) {
+    return request->method() == HTTP_GET && request->url() == this->path_;
+}
+
+void HistoryExportHandler::handleRequest(AsyncWebServerRequest *request) {
+#ifdef USE_ESP32
+    // Runs in the HTTP server task, every chunk is sent before the next one is produced
+    httpd_req_t *req = *request;
+    httpd_resp_set_type(req, "text/csv");
+    HistoryCsvWriter writer(this->meters_);
+    char buffer[512];
+    size_t len;
+    while ((len = writer.read(buffer, sizeof(buffer))) > 0) {
+        if (httpd_resp_send_chunk(req, buffer, len) != ESP_OK)
+            return;
+    }
+    httpd_resp_send_chunk(req, nullptr, 0);
+#else
+    auto writer = std::make_shared<HistoryCsvWriter>(this->meters_);
+    request->send(request->beginChunkedResponse("text/csv", [writer](uint8_t *buffer, size_t max_len, size_t index) -> size_t {
+        return writer->read((char *) buffer, max_len);
+    }));
+#endif
+}
+#endif
+
+}  // namespace sensostar
+}  // namespace esphome
+
+#endif  // USE_SENSOSTAR_HISTORY
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "esphome/core/defines.h"
+#ifdef USE_SENSOSTAR_HISTORY
+
+#include "history.h"
+#include "sensostar_meter.h"
+
+#include <vector>
+
+#ifdef USE_SENSOSTAR_HISTORY_EXPORT
+#include "esphome/components/web_server_base/web_server_base.h"
+#endif
+
+namespace esphome {
+namespace sensostar {
+
+// Produces the stored history of all meters as CSV, a few lines at a time, so the
+// response never has to be held in RAM. Blocks are tracked by sequence number, blocks
+// evicted while the export runs are skipped.
+class HistoryCsvWriter {
+ public:
+  explicit HistoryCsvWriter(const std::vector<SensoStarMeter *> &meters) : meters_(meters) {}
+
+  // Fills buffer with up to size bytes, 0 when the export is complete
+  size_t read(char *buffer, size_t size);
+
+ protected:
+  bool next_line_();
+  bool next_block_();
+
+  const std::vector<SensoStarMeter *> &meters_;
+  size_t meter_index_{0};
+  uint32_t next_sequence_{0};
+  HistoryBlock block_;             // copy taken under the buffer's lock, the ring may be overwritten meanwhile
+  HistoryBlockReader reader_;
+  bool in_block_{false};
+  bool header_{false};
+  char line_[160];
+  size_t line_length_{0};
+  size_t line_pos_{0};
+};
+
+#ifdef USE_SENSOSTAR_HISTORY_EXPORT
+class HistoryExportHandler : public AsyncWebHandler {
+ public:
+  HistoryExportHandler(const std::vector<SensoStarMeter *> &meters, const char *path) : meters_(meters), path_(path) {}
+
+  bool canHandle(AsyncWebServerRequest *request) override;
+  void handleRequest(AsyncWebServerRequest *request) override;
+  bool isRequestHandlerTrivial() override { return false; }
+
+ protected:
+  const std::vector<SensoStarMeter *> &meters_;
+  const char *path_;
+};
+#endif
+
+}  // namespace sensostar
+}  // namespace esphome
+
+#endif  // USE_SENSOSTAR_HISTORY
@@ -0,0 +1,35 @@
+#include "latency_stats.h"
+
+namespace esphome {
+namespace sensostar {
+
+void LatencyStats::add(uint16_t latency) {
+    this->samples_[this->index_] = latency;
+    this->index_ = (this->index_ + 1) % LATENCY_WINDOW;
+    if (this->count_ < LATENCY_WINDOW)
+        this->count_++;
+
+    // Insertion sort of at most LATENCY_WINDOW samples, only done once per response
+    uint16_t sorted[LATENCY_WINDOW];
+    for (uint8_t i = 0; i < this->count_; i++) {
+        uint16_t v = this->samples_[i];
+        uint8_t j = i;
+        while (j > 0 && sorted[j-1] > v) {
+            sorted[j] = sorted[j-1];
+            j--;
+        }
+        sorted[j] = v;
+    }
+    this->p50_ = sorted[(this->count_ - 1) * 50 / 100];
+    this->p95_ = sorted[(this->count_ - 1) * 95 / 100];
+    this->max_ = sorted[this->count_ - 1];
+}
+
+void LatencyStats::reset() {
+    this->count_ = 0;
+    this->index_ = 0;
+    this->p50_ = this->p95_ = this->max_ = 0;
+}
+
+}  // namespace sensostar
+}  // namespace esphome
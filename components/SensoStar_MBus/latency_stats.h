@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+namespace sensostar {
+
+// Number of recent response latencies kept per request kind
+static const uint8_t LATENCY_WINDOW = 32;
+
+// Sliding window of response latencies (ms) with percentiles updated on every sample
+class LatencyStats {
+ public:
+  void add(uint16_t latency);
+  void reset();
+
+  uint8_t count() const { return this->count_; }
+  uint16_t p50() const { return this->p50_; }
+  uint16_t p95() const { return this->p95_; }
+  uint16_t max() const { return this->max_; }
+
+ protected:
+  uint16_t samples_[LATENCY_WINDOW];
+  uint8_t count_{0};
+  uint8_t index_{0};
+  uint16_t p50_{0};
+  uint16_t p95_{0};
+  uint16_t max_{0};
+};
+
+}  // namespace sensostar
+}  // namespace esphome
@@ -0,0 +1,299 @@
+#include "mbus_decoder.h"
+
+#include <cstring>
+
+namespace esphome {
+namespace sensostar {
+namespace mbus {
+
+static int32_t read_int(const uint8_t *p, uint8_t n) {
+    uint32_t result = 0;
+    for (uint8_t k = 0; k < n; k++)
+        result |= (uint32_t)p[k] << (8 * k);
+    if (n < 4 && (p[n-1]&0x80) == 0x80) // Negative
+        result |= 0xffffffff << (8 * n);
+    return (int32_t)result;
+}
+
+static int64_t read_int64(const uint8_t *p, uint8_t n) {
+    uint64_t result = 0;
+    for (uint8_t k = 0; k < n; k++)
+        result |= (uint64_t)p[k] << (8 * k);
+    if (n < 8 && (p[n-1]&0x80) == 0x80) // Negative
+        result |= ~(uint64_t)0 << (8 * n);
+    return (int64_t)result;
+}
+
+// Type A: packed BCD, an F in the most significant digit marks a negative value
+static bool read_bcd(const uint8_t *p, uint8_t n, double &value) {
+    double result = 0;
+    bool negative = false;
+    for (int k = n - 1; k >= 0; k--) {
+        uint8_t hi = p[k] >> 4, lo = p[k]&0x0F;
+        if (k == n - 1 && hi == 0x0F) {
+            negative = true;
+            hi = 0;
+        }
+        if (hi > 9 || lo > 9)
+            return false;
+        result = result * 100 + hi * 10 + lo;
+    }
+    value = negative ? -result : result;
+    return true;
+}
+
+bool decode_value(uint8_t coding, const uint8_t *data, double &value) {
+    switch (coding) {
+        case 0x01:
+        case 0x02:
+        case 0x03:
+        case 0x04:
+            value = read_int(data, coding);
+            return true;
+        case 0x05: { // 32 bit IEEE 754
+            uint32_t raw = (uint32_t)read_int(data, 4);
+            float f;
+            memcpy(&f, &raw, sizeof(f));
+            value = f;
+            return true;
+        }
+        case 0x06:
+            value = (double)read_int64(data, 6);
+            return true;
+        case 0x07:
+            value = (double)read_int64(data, 8);
+            return true;
+        case 0x09:
+        case 0x0A:
+        case 0x0B:
+        case 0x0C:
+        case 0x0E:
+            return read_bcd(data, DIF_DATA_LENGTH[coding], value);
+        default: // No data, selection for readout, variable length
+            return false;
+    }
+}
+
+bool RecordFilter::matches(const DataRecord &record) const {
+    uint16_t vife = record.vife_count ? record.vife : RECORD_FILTER_NO_VIFE;
+    return record.vif == this->vif && vife == this->vife && (uint8_t)record.function == this->function &&
+           record.storage == this->storage && record.tariff == this->tariff && record.subunit == this->subunit;
+}
+
+void RecordDecoder::reset() {
+    this->readout_.clear();
+    this->state_ = State::DIF;
+}
+
+bool RecordDecoder::complete() const {
+    return this->state_ == State::DIF || this->state_ == State::MANUFACTURER;
+}
+
+void RecordDecoder::feed(uint8_t c) {
+    switch (this->state_) {
+        case State::DIF:
+            if (c == 0x2F) // Idle filler
+                return;
+            if ((c&0x0F) == 0x0F) { // Manufacturer specific data follows
+                this->state_ = State::MANUFACTURER;
+                return;
+            }
+            this->dif_ = c;
+            this->dife_count_ = 0;
+            this->storage_ = (c&0x40) >> 6;
+            this->tariff_ = 0;
+            this->subunit_ = 0;
+            this->state_ = (c&0x80) ? State::DIFE : State::VIF;
+            return;
+        case State::DIFE:
+            // Up to 10 DIFEs, each adds 4 bits of storage number, 2 bits of tariff and 1 bit of subunit.
+            // Bits beyond the width of the fields are dropped.
+            if (this->dife_count_ < 10) {
+                uint8_t n = this->dife_count_++;
+                if (n < STORAGE_DIFE_COUNT)
+                    this->storage_ |= (uint32_t)(c&0x0F) << (1 + 4 * n);
+                if (n < TARIFF_DIFE_COUNT)
+                    this->tariff_ |= ((c&0x30) >> 4) << (2 * n);
+                this->subunit_ |= ((c&0x40) >> 6) << n;
+            }
+            if ((c&0x80) == 0)
+                this->state_ = State::VIF;
+            return;
+        case State::VIF:
+            this->vif_ = c;
+            this->vife_count_ = 0;
+            if (c&0x80)
+                this->state_ = State::VIFE;
+            else
+                this->begin_data_();
+            return;
+        case State::VIFE:
+            if (this->vife_count_++ == 0)
+                this->vife_ = c;
+            if ((c&0x80) == 0)
+                this->begin_data_();
+            return;
+        case State::LVAR:
+            this->variable_length_ = true;
+            if (c < 0xC0) // ASCII string
+                this->data_length_ = c;
+            else if (c < 0xD0) // Positive BCD
+                this->data_length_ = c - 0xC0;
+            else if (c < 0xE0) // Negative BCD
+                this->data_length_ = c - 0xD0;
+            else if (c < 0xF0) // Binary number
+                this->data_length_ = c - 0xE0;
+            else if (c < 0xF5) // Big number
+                this->data_length_ = 4 * (c - 0xEC);
+            else if (c == 0xF5)
+                this->data_length_ = 48;
+            else if (c == 0xF6)
+                this->data_length_ = 64;
+            else { // Reserved, the length of the record is unknown
+                this->state_ = State::ERROR;
+                return;
+            }
+            this->data_index_ = 0;
+            if (this->data_length_ == 0) {
+                this->finish_record_();
+                return;
+            }
+            this->state_ = State::DATA;
+            return;
+        case State::DATA:
+            if (this->data_index_ < sizeof(this->data_))
+                this->data_[this->data_index_] = c;
+            if (++this->data_index_ == this->data_length_)
+                this->finish_record_();
+            return;
+        default:
+            return;
+    }
+}
+
+void RecordDecoder::begin_data_() {
+    uint8_t lc = this->dif_&0x0f; // Length and coding
+    this->variable_length_ = false;
+    if (lc == 0x0D) {
+        this->state_ = State::LVAR;
+        return;
+    }
+    this->data_length_ = DIF_DATA_LENGTH[lc];
+    this->data_index_ = 0;
+    if (this->data_length_ == 0)
+        this->finish_record_();
+    else
+        this->state_ = State::DATA;
+}
+
+void RecordDecoder::finish_record_() {
+    this->state_ = State::DIF;
+
+    DataRecord record;
+    record.function = (Function)((this->dif_&0x30) >> 4);
+    record.coding = this->dif_&0x0f;
+    record.storage = this->storage_;
+    record.tariff = this->tariff_;
+    record.subunit = this->subunit_;
+    record.vif = this->vif_&0x7F;
+    record.vife = this->vife_count_ ? this->vife_&0x7F : 0;
+    record.vife_count = this->vife_count_;
+    record.value = 0;
+    record.numeric = !this->variable_length_ && decode_value(record.coding, this->data_, record.value);
+
+    const VifInfo &info = VIF_TABLE[record.vif];
+    bool handled = false;
+    if (record.numeric && this->filter_count_ > 0) {
+        double scale = info.quantity != Quantity::NONE ? pow10_lookup(info.exponent) : 1.0;
+        for (uint8_t i = 0; i < this->filter_count_ && i < MAX_RECORD_FILTERS; i++) {
+            if (this->filters_[i].matches(record)) {
+                this->readout_.records[i] = record.value * scale;
+                this->readout_.records_present |= 1 << i;
+                handled = true;
+            }
+        }
+    }
+
+    // The built-in quantities are the current values only, not stored (e.g. month end) values,
+    // other tariffs or subunits
+    Quantity q = Quantity::NONE;
+    int8_t exponent = 0;
+    if (record.storage == 0 && record.tariff == 0 && record.subunit == 0) {
+        if (record.vif == 0x7D && record.vife_count > 0 && record.vife == 0x17) {
+            q = Quantity::ERROR_FLAGS;
+        }
+        else if (record.function == Function::INSTANTANEOUS) {
+            q = info.quantity;
+            exponent = info.exponent;
+        }
+    }
+
+    if (q == Quantity::NONE || !record.numeric) {
+        // Unknown or unsupported record: skip it, keep decoding the rest of the frame
+        if (!handled)
+            this->readout_.unknown_records++;
+    }
+    else if (q == Quantity::ERROR_FLAGS) {
+        // Bit field, not a signed number
+        uint32_t raw = 0;
+        uint8_t n = record.coding <= 0x04 ? record.coding : 0;
+        for (uint8_t k = 0; k < n; k++)
+            raw |= (uint32_t)this->data_[k] << (8 * k);
+        this->readout_.set(q, raw);
+    }
+    else {
+        this->readout_.set(q, record.value * pow10_lookup(exponent));
+    }
+}
+
+void RspUdDecoder::on_frame_start() {
+    this->records_.reset();
+    this->length_ = 0;
+    this->control_ = 0;
+    this->ci_ = 0;
+}
+
+void RspUdDecoder::on_user_data(uint8_t c, uint16_t index) {
+    this->length_ = index + 1;
+    if (index == 0) {
+        this->control_ = c;
+        return;
+    }
+    if (index == 2)
+        this->ci_ = c;
+    if (index < 3 || this->control_ != C_RSP_UD || this->ci_ != CI_RSP_UD)
+        return;
+
+    // Fixed data header
+    uint16_t h = index - 3;
+    switch (h) {
+        case 0: this->header_.id = c; return;
+        case 1: this->header_.id |= c << 8; return;
+        case 2: this->header_.id |= (uint32_t)c << 16; return;
+        case 3: this->header_.id |= (uint32_t)c << 24; return;
+        case 4: this->header_.manufacturer = c; return;
+        case 5: this->header_.manufacturer |= c << 8; return;
+        case 6: this->header_.version = c; return;
+        case 7: this->header_.medium = c; return;
+        case 8: this->header_.access_number = c; return;
+        case 9: this->header_.status = c; return;
+        case 10:
+        case 11: return; // Signature
+        default:
+            this->records_.feed(c);
+            return;
+    }
+}
+
+bool decode_records(const uint8_t *data, size_t len, Readout &readout) {
+    RecordDecoder decoder;
+    decoder.reset();
+    for (size_t i = 0; i < len && decoder.ok(); i++)
+        decoder.feed(data[i]);
+    readout = decoder.readout();
+    return decoder.complete();
+}
+
+}  // namespace mbus
+}  // namespace sensostar
+}  // namespace esphome
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "mbus_frame.h"
+
+// Plain C++ M-Bus (EN 13757-3) RSP_UD application layer decoder, no ESPHome dependencies
+
+namespace esphome {
+namespace sensostar {
+namespace mbus {
+
+// Quantities the SensoStar reports in its RSP_UD frame
+enum class Quantity : uint8_t {
+  NONE = 0,
+  ENERGY,              // kWh
+  VOLUME,              // m3
+  POWER,               // W
+  VOLUME_FLOW,         // m3/h
+  TEMPERATURE_FLOW,    // C
+  TEMPERATURE_RETURN,  // C
+  TEMPERATURE_DIFF,    // K
+  ERROR_FLAGS,         // bit field
+};
+static const size_t QUANTITY_COUNT = 9;
+
+struct VifInfo {
+  Quantity quantity;
+  int8_t exponent;  // value = raw * 10^exponent, already scaled to the unit above
+};
+
+// Primary VIF (extension bit masked off) -> quantity and decimal exponent
+constexpr VifInfo vif_info(uint8_t vif) {
+  return (vif & 0x78) == 0x00   ? VifInfo{Quantity::ENERGY, static_cast<int8_t>((vif & 0x07) - 6)}
+         : (vif & 0x78) == 0x10 ? VifInfo{Quantity::VOLUME, static_cast<int8_t>((vif & 0x07) - 6)}
+         : (vif & 0x78) == 0x28 ? VifInfo{Quantity::POWER, static_cast<int8_t>((vif & 0x07) - 3)}
+         : (vif & 0x78) == 0x38 ? VifInfo{Quantity::VOLUME_FLOW, static_cast<int8_t>((vif & 0x07) - 6)}
+         : (vif & 0x7C) == 0x58 ? VifInfo{Quantity::TEMPERATURE_FLOW, static_cast<int8_t>((vif & 0x03) - 3)}
+         : (vif & 0x7C) == 0x5C ? VifInfo{Quantity::TEMPERATURE_RETURN, static_cast<int8_t>((vif & 0x03) - 3)}
+         : (vif & 0x7C) == 0x60 ? VifInfo{Quantity::TEMPERATURE_DIFF, static_cast<int8_t>((vif & 0x03) - 3)}
+                                : VifInfo{Quantity::NONE, 0};
+}
+
+template<size_t... I> constexpr std::array<VifInfo, sizeof...(I)> make_vif_table(std::index_sequence<I...>) {
+  return {{vif_info(static_cast<uint8_t>(I))...}};
+}
+
+static constexpr std::array<VifInfo, 128> VIF_TABLE = make_vif_table(std::make_index_sequence<128>{});
+
+// Powers of ten covering every exponent the VIF table can produce
+static const int8_t POW10_MIN_EXPONENT = -12;
+static const int8_t POW10_MAX_EXPONENT = 12;
+static constexpr double POW10_TABLE[] = {1e-12, 1e-11, 1e-10, 1e-9, 1e-8, 1e-7, 1e-6, 1e-5, 1e-4,
+                                         1e-3,  1e-2,  1e-1,  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                         1e6,   1e7,   1e8,   1e9,  1e10, 1e11, 1e12};
+
+inline double pow10_lookup(int8_t exponent) {
+  if (exponent < POW10_MIN_EXPONENT)
+    exponent = POW10_MIN_EXPONENT;
+  else if (exponent > POW10_MAX_EXPONENT)
+    exponent = POW10_MAX_EXPONENT;
+  return POW10_TABLE[exponent - POW10_MIN_EXPONENT];
+}
+
+// Data length in bytes for each DIF coding, -1 for codings that need special handling
+static constexpr int8_t DIF_DATA_LENGTH[16] = {0, 1, 2, 3, 4, 4, 6, 8, 0, 1, 2, 3, 4, -1, 6, -1};
+
+// DIF function field
+enum class Function : uint8_t {
+  INSTANTANEOUS = 0,
+  MAXIMUM,
+  MINIMUM,
+  ERROR_STATE,
+};
+
+// One variable data record with its DIF/DIFE and VIF/VIFE information decoded
+struct DataRecord {
+  Function function;
+  uint8_t coding;      // DIF bits 0-3
+  uint32_t storage;    // storage number
+  uint8_t tariff;
+  uint16_t subunit;
+  uint8_t vif;         // extension bit masked off
+  uint8_t vife;        // first VIFE, extension bit masked off, 0 without VIFE
+  uint8_t vife_count;
+  double value;        // raw value, not scaled by the VIF
+  bool numeric;        // false for strings, dates and unsupported codings
+};
+
+// DIFEs whose storage number and tariff bits fit into DataRecord::storage and DataRecord::tariff
+static const uint8_t STORAGE_DIFE_COUNT = 8;
+static const uint8_t TARIFF_DIFE_COUNT = 4;
+
+// Selects a record for an additional value, all fields must match
+struct RecordFilter {
+  uint8_t vif;         // extension bit masked off
+  uint16_t vife;       // first VIFE with the extension bit masked off, RECORD_FILTER_NO_VIFE for none
+  uint8_t function;
+  uint32_t storage;
+  uint8_t tariff;
+  uint16_t subunit;
+
+  bool matches(const DataRecord &record) const;
+};
+static const uint16_t RECORD_FILTER_NO_VIFE = 0x100;
+// Filters per meter, bit per filter in Readout::records_present
+static const uint8_t MAX_RECORD_FILTERS = 16;
+
+// Values decoded from one RSP_UD frame
+struct Readout {
+  // Instantaneous values of the current storage, tariff 0 and subunit 0
+  double values[QUANTITY_COUNT];
+  uint16_t present{0};
+  // Records matching the filters passed to the decoder, scaled by the VIF table where it knows the VIF
+  double records[MAX_RECORD_FILTERS];
+  uint16_t records_present{0};
+  uint8_t unknown_records{0};
+
+  void clear() {
+    this->present = 0;
+    this->records_present = 0;
+    this->unknown_records = 0;
+  }
+  bool has(Quantity q) const { return this->present & (1 << static_cast<uint8_t>(q)); }
+  double get(Quantity q) const { return this->values[static_cast<uint8_t>(q)]; }
+  void set(Quantity q, double value) {
+    this->values[static_cast<uint8_t>(q)] = value;
+    this->present |= 1 << static_cast<uint8_t>(q);
+  }
+};
+
+// Fixed data header of a RSP_UD frame
+struct FixedHeader {
+  uint32_t id;  // BCD coded identification number
+  uint16_t manufacturer;
+  uint8_t version;
+  uint8_t medium;
+  uint8_t access_number;
+  uint8_t status;
+};
+
+// Byte-at-a-time decoder for the variable data records of a RSP_UD frame.
+// Records with an unknown VIF or coding are skipped; decoded values are staged
+// in readout() until the caller decides to commit them.
+class RecordDecoder {
+ public:
+  // Records to collect in Readout::records, in addition to the known quantities
+  void set_filters(const RecordFilter *filters, uint8_t count) {
+    this->filters_ = filters;
+    this->filter_count_ = count;
+  }
+  void reset();
+  void feed(uint8_t c);
+  // True if the record area ended on a record boundary
+  bool complete() const;
+  // False once a record could not be sized, the rest of the frame is ignored then
+  bool ok() const { return this->state_ != State::ERROR; }
+
+  const Readout &readout() const { return this->readout_; }
+
+ protected:
+  enum class State : uint8_t { DIF, DIFE, VIF, VIFE, LVAR, DATA, MANUFACTURER, ERROR };
+
+  void begin_data_();
+  void finish_record_();
+
+  Readout readout_;
+  const RecordFilter *filters_{nullptr};
+  uint8_t filter_count_{0};
+  State state_{State::DIF};
+  uint8_t dif_{0};
+  uint8_t dife_count_{0};
+  uint32_t storage_{0};
+  uint8_t tariff_{0};
+  uint16_t subunit_{0};
+  uint8_t vif_{0};
+  uint8_t vife_{0};
+  uint8_t vife_count_{0};
+  uint8_t data_[8];
+  uint8_t data_length_{0};
+  uint8_t data_index_{0};
+  bool variable_length_{false};
+};
+
+// Numeric value of the data of a record, false for codings without one
+bool decode_value(uint8_t coding, const uint8_t *data, double &value);
+
+// Streaming decoder for a RSP_UD frame, fed by FrameParser while the frame is received
+class RspUdDecoder : public UserDataSink {
+ public:
+  void on_frame_start() override;
+  void on_user_data(uint8_t c, uint16_t index) override;
+  void set_filters(const RecordFilter *filters, uint8_t count) { this->records_.set_filters(filters, count); }
+
+  // Valid after FrameParser reported ParseResult::FRAME
+  bool is_rsp_ud() const { return this->control_ == C_RSP_UD && this->ci_ == CI_RSP_UD && this->length_ >= 3 + FIXED_HEADER_LENGTH; }
+  bool complete() const { return this->records_.complete(); }
+  const FixedHeader &header() const { return this->header_; }
+  const Readout &readout() const { return this->records_.readout(); }
+
+ protected:
+  RecordDecoder records_;
+  FixedHeader header_;
+  uint16_t length_{0};
+  uint8_t control_{0};
+  uint8_t ci_{0};
+};
+
+// Decode a complete record area (after the 12 byte fixed data header, before checksum).
+// Returns false if the record area could not be walked to its end.
+bool decode_records(const uint8_t *data, size_t len, Readout &readout);
+
+}  // namespace mbus
+}  // namespace sensostar
+}  // namespace esphome
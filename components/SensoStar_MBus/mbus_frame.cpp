@@ -0,0 +1,108 @@
+#include "mbus_frame.h"
+
+namespace esphome {
+namespace sensostar {
+namespace mbus {
+
+const char *parse_result_to_str(ParseResult result) {
+    switch (result) {
+        case ParseResult::ACK:
+            return "Acknowledge";
+        case ParseResult::FRAME:
+            return "Frame";
+        case ParseResult::ERROR_START:
+            return "Invalid frame start";
+        case ParseResult::ERROR_LENGTH:
+            return "Invalid length";
+        case ParseResult::ERROR_STOP:
+            return "Invalid stop";
+        case ParseResult::ERROR_CHECKSUM:
+            return "Invalid checksum";
+        default:
+            return "None";
+    }
+}
+
+ParseResult FrameParser::feed(uint8_t c) {
+    if (this->length_ == 0) {
+        if (c == FRAME_ACK)
+            return ParseResult::ACK;
+        if (c != FRAME_START_LONG)
+            return ParseResult::NONE;
+        this->checksum_ = 0;
+        if (this->sink_ != nullptr)
+            this->sink_->on_frame_start();
+    }
+    this->buffer_[this->length_++] = c;
+
+    // User data: checksum and hand over as the bytes arrive
+    if (this->length_ > 4 && this->length_ <= this->buffer_[1] + 4) {
+        this->checksum_ += c;
+        if (this->sink_ != nullptr)
+            this->sink_->on_user_data(c, this->length_ - 5);
+    }
+
+    // Length field seen: the frame can never outgrow the buffer, since buffer_[1] <= 255
+    if (this->length_ > 4 && this->length_ == this->buffer_[1] + 6) {
+        this->frame_length_ = this->length_;
+        this->length_ = 0;
+        return this->validate_();
+    }
+    return ParseResult::NONE;
+}
+
+ParseResult FrameParser::validate_() const {
+    if (this->buffer_[0] != FRAME_START_LONG || this->buffer_[3] != FRAME_START_LONG)
+        return ParseResult::ERROR_START;
+    // C, A and CI field are mandatory
+    if (this->buffer_[1] != this->buffer_[2] || this->buffer_[1] < 3)
+        return ParseResult::ERROR_LENGTH;
+    if (this->buffer_[this->frame_length_-1] != FRAME_STOP)
+        return ParseResult::ERROR_STOP;
+
+    if (this->checksum_ != this->buffer_[this->frame_length_-2])
+        return ParseResult::ERROR_CHECKSUM;
+    return ParseResult::FRAME;
+}
+
+uint8_t baud_rate_to_ci(uint32_t baud_rate) {
+    uint32_t rate = 300;
+    for (uint8_t ci = CI_BAUD_RATE_300; ci <= CI_BAUD_RATE_300 + 7; ci++, rate *= 2) {
+        if (rate == baud_rate)
+            return ci;
+    }
+    return 0;
+}
+
+size_t build_long_frame(uint8_t *out, size_t out_size, uint8_t control, uint8_t address, uint8_t ci,
+                        const uint8_t *payload, size_t len) {
+    if (len > 252 || out_size < len + 9)
+        return 0;
+    out[0] = FRAME_START_LONG;
+    out[1] = out[2] = len + 3;
+    out[3] = FRAME_START_LONG;
+    out[4] = control;
+    out[5] = address;
+    out[6] = ci;
+    uint8_t checksum = control + address + ci;
+    for (size_t i = 0; i < len; i++) {
+        out[7+i] = payload[i];
+        checksum += payload[i];
+    }
+    out[7+len] = checksum;
+    out[8+len] = FRAME_STOP;
+    return len + 9;
+}
+
+size_t build_short_frame(uint8_t *out, uint8_t control, uint8_t address) {
+    out[0] = FRAME_START_SHORT;
+    out[1] = control;
+    out[2] = address;
+    out[3] = control + address;
+    out[4] = FRAME_STOP;
+    return 5;
+}
+
+}  // namespace mbus
+}  // namespace sensostar
+}  // namespace esphome
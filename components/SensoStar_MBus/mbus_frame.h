@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Plain C++ M-Bus (EN 13757-2) link layer, no ESPHome dependencies
+
+namespace esphome {
+namespace sensostar {
+namespace mbus {
+
+static const uint8_t FRAME_ACK = 0xE5;
+static const uint8_t FRAME_START_SHORT = 0x10;
+static const uint8_t FRAME_START_LONG = 0x68;
+static const uint8_t FRAME_STOP = 0x16;
+
+// Control field
+static const uint8_t C_SND_NKE = 0x40;
+static const uint8_t C_SND_UD = 0x53;
+static const uint8_t C_REQ_UD2 = 0x5B;
+static const uint8_t C_RSP_UD = 0x08;
+static const uint8_t C_FCB = 0x20;
+static const uint8_t C_FCV = 0x10;
+
+// Control information field
+static const uint8_t CI_DATA_SEND = 0x51;
+static const uint8_t CI_SELECT = 0x52;
+// Baud rate switch: 0xB8 (300 baud) ... 0xBF (38400 baud)
+static const uint8_t CI_BAUD_RATE_300 = 0xB8;
+static const uint8_t CI_RSP_UD = 0x72;
+
+static const uint8_t ADDRESS_SECONDARY = 0xFD;
+static const uint8_t ADDRESS_BROADCAST_REPLY = 0xFE;
+static const uint8_t ADDRESS_BROADCAST = 0xFF;
+// No A field, e.g. a single character frame
+static const uint16_t ADDRESS_NONE = 0x100;
+
+// Long frame: 0x68 L L 0x68 + L bytes user data + checksum + 0x16, L <= 255
+static const size_t MAX_FRAME_LENGTH = 255 + 6;
+// Fixed data header of a RSP_UD frame (ID, manufacturer, version, medium, access no, status, signature)
+static const size_t FIXED_HEADER_LENGTH = 12;
+
+enum class ParseResult : uint8_t {
+  NONE = 0,  // need more bytes
+  ACK,
+  FRAME,
+  ERROR_START,
+  ERROR_LENGTH,
+  ERROR_STOP,
+  ERROR_CHECKSUM,
+};
+
+const char *parse_result_to_str(ParseResult result);
+
+// Receives the user data (C, A, CI field and payload) of a long frame while it arrives,
+// before the checksum could be verified
+class UserDataSink {
+ public:
+  virtual void on_frame_start() = 0;
+  // index 0 is the C field
+  virtual void on_user_data(uint8_t c, uint16_t index) = 0;
+};
+
+// Assembles long frames from a byte stream. Bytes outside a frame other than the
+// single character acknowledge are discarded.
+class FrameParser {
+ public:
+  ParseResult feed(uint8_t c);
+  void reset() { this->length_ = 0; }
+  void set_sink(UserDataSink *sink) { this->sink_ = sink; }
+
+  bool in_frame() const { return this->length_ > 0; }
+
+  // Last completed frame, valid after feed() returned a result other than NONE/ACK
+  // until the next frame start is fed
+  const uint8_t *frame() const { return this->buffer_; }
+  uint16_t frame_size() const { return this->frame_length_; }
+
+  // Accessors, valid after feed() returned ParseResult::FRAME
+  uint8_t control() const { return this->buffer_[4]; }
+  uint8_t address() const { return this->buffer_[5]; }
+  uint8_t ci() const { return this->buffer_[6]; }
+  // User data after the CI field, excluding checksum and stop byte
+  const uint8_t *payload() const { return &this->buffer_[7]; }
+  uint16_t payload_size() const { return this->buffer_[1] - 3; }
+
+ protected:
+  ParseResult validate_() const;
+
+  uint8_t buffer_[MAX_FRAME_LENGTH];
+  UserDataSink *sink_{nullptr};
+  uint16_t length_{0};
+  uint16_t frame_length_{0};
+  uint8_t checksum_{0};
+};
+
+// CI field switching the slave to the given baud rate, 0 if the rate is not defined by M-Bus
+uint8_t baud_rate_to_ci(uint32_t baud_rate);
+
+// Build a long frame into out (at least len + 9 bytes). Returns the frame length, 0 if it does not fit.
+size_t build_long_frame(uint8_t *out, size_t out_size, uint8_t control, uint8_t address, uint8_t ci,
+                        const uint8_t *payload, size_t len);
+// Build a short frame into out (5 bytes). Returns the frame length.
+size_t build_short_frame(uint8_t *out, uint8_t control, uint8_t address);
+
+}  // namespace mbus
+}  // namespace sensostar
+}  // namespace esphome
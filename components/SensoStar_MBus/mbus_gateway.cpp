@@ -0,0 +1,117 @@
+#include "mbus_gateway.h"
+
+#ifdef USE_SENSOSTAR_GATEWAY
+
+#include "esphome/core/log.h"
+
+#include <cerrno>
+
+namespace esphome {
+namespace sensostar {
+
+static const char *const TAG = "SensoStar";
+
+bool MBusGateway::setup(uint16_t port) {
+    this->server_ = socket::socket_ip(SOCK_STREAM, 0);
+    if (this->server_ == nullptr) {
+        ESP_LOGE(TAG, "Gateway: could not create socket");
+        return false;
+    }
+    int enable = 1;
+    this->server_->setsockopt(SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(int));
+    this->server_->setblocking(false);
+
+    struct sockaddr_storage server;
+    socklen_t sl = socket::set_sockaddr_any((struct sockaddr *) &server, sizeof(server), port);
+    if (sl == 0 || this->server_->bind((struct sockaddr *) &server, sl) != 0 || this->server_->listen(1) != 0) {
+        ESP_LOGE(TAG, "Gateway: could not listen on port %u, errno %d", port, errno);
+        this->server_ = nullptr;
+        return false;
+    }
+    return true;
+}
+
+size_t MBusGateway::missing_() const {
+    if (this->length_ == 0)
+        return 1;
+    switch (this->request_[0]) {
+        case 0xE5: // Single character
+            return 0;
+        case 0x10: // Short frame: start, C, A, checksum, stop
+            return 5 - this->length_;
+        default:   // Long frame: start, L, L, start, L bytes, checksum, stop
+            if (this->length_ < 4)
+                return 4 - this->length_;
+            return this->request_[1] + 6 - this->length_;
+    }
+}
+
+bool MBusGateway::poll() {
+    if (this->server_ == nullptr)
+        return false;
+    if (this->client_ == nullptr) {
+        struct sockaddr_storage source;
+        socklen_t len = sizeof(source);
+        this->client_ = this->server_->accept((struct sockaddr *) &source, &len);
+        if (this->client_ == nullptr)
+            return false;
+        this->client_->setblocking(false);
+        // Responses go out in UART sized chunks, do not hold them back for coalescing
+        int enable = 1;
+        this->client_->setsockopt(IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(int));
+        this->length_ = 0;
+        ESP_LOGD(TAG, "Gateway: client connected");
+    }
+
+    // Read no further than the end of the current frame, the rest waits in the socket
+    size_t missing;
+    while ((missing = this->missing_()) > 0) {
+        ssize_t n = this->client_->read(this->request_ + this->length_, missing);
+        if (n == 0 || (n < 0 && errno != EWOULDBLOCK && errno != EAGAIN)) {
+            this->disconnect_();
+            return false;
+        }
+        if (n < 0)
+            return false;
+        this->length_ += n;
+
+        // Resynchronize on anything that cannot start or continue a frame
+        const uint8_t start = this->request_[0];
+        if (start != 0xE5 && start != 0x10 && start != 0x68) {
+            this->length_ = 0;
+        }
+        else if (start == 0x68 && this->length_ >= 4 && (this->request_[1] != this->request_[2] || this->request_[3] != 0x68)) {
+            ESP_LOGW(TAG, "Gateway: invalid long frame header from client");
+            this->length_ = 0;
+        }
+    }
+    if (this->request_[this->length_ - 1] != 0x16 && this->request_[0] != 0xE5) {
+        ESP_LOGW(TAG, "Gateway: missing stop byte in client frame");
+        this->length_ = 0;
+        return false;
+    }
+    return true;
+}
+
+void MBusGateway::forward(const uint8_t *data, size_t len) {
+    if (this->client_ == nullptr)
+        return;
+    // The TCP send buffer holds many frames, a client that does not keep up is dropped
+    ssize_t n = this->client_->write(data, len);
+    if (n != (ssize_t) len) {
+        ESP_LOGW(TAG, "Gateway: client not accepting the response, disconnecting");
+        this->disconnect_();
+    }
+}
+
+void MBusGateway::disconnect_() {
+    ESP_LOGD(TAG, "Gateway: client disconnected");
+    this->client_->close();
+    this->client_ = nullptr;
+    this->length_ = 0;
+}
+
+}  // namespace sensostar
+}  // namespace esphome
+
+#endif
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "esphome/core/defines.h"
+
+#ifdef USE_SENSOSTAR_GATEWAY
+
+#include "esphome/components/socket/socket.h"
+
+#include "mbus_frame.h"
+
+#include <memory>
+
+namespace esphome {
+namespace sensostar {
+
+// Raw M-Bus over TCP for one client at a time. Requests are collected frame by frame, the hub puts
+// them on the bus between its own transactions and writes the response bytes back as they arrive.
+class MBusGateway {
+ public:
+  bool setup(uint16_t port);
+  // Accepts a client and reads from it until a request frame is complete, true while one is waiting
+  bool poll();
+  const uint8_t *request() const { return this->request_; }
+  uint16_t request_size() const { return this->length_; }
+  // A field of the waiting request, mbus::ADDRESS_NONE for a single character or a frame too short to have one
+  uint16_t request_address() const {
+    if (this->length_ >= 3 && this->request_[0] == mbus::FRAME_START_SHORT)
+      return this->request_[2];
+    if (this->length_ >= 6 && this->request_[0] == mbus::FRAME_START_LONG)
+      return this->request_[5];
+    return mbus::ADDRESS_NONE;
+  }
+  // The waiting request was put on the bus, the next one is read
+  void request_sent() { this->length_ = 0; }
+  // Bytes received from the bus during a gateway transaction, passed through unchanged
+  void forward(const uint8_t *data, size_t len);
+  bool connected() const { return this->client_ != nullptr; }
+
+ protected:
+  // Bytes still missing from the request, 0 when it is complete
+  size_t missing_() const;
+  void disconnect_();
+
+  std::unique_ptr<socket::Socket> server_;
+  std::unique_ptr<socket::Socket> client_;
+  uint8_t request_[mbus::MAX_FRAME_LENGTH];
+  uint16_t length_{0};
+};
+
+}  // namespace sensostar
+}  // namespace esphome
+
+#endif
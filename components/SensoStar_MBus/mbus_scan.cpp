@@ -0,0 +1,71 @@
+#include "mbus_scan.h"
+
+namespace esphome {
+namespace sensostar {
+namespace mbus {
+
+// Position of the most significant wildcard nibble below `below`, -1 if there is none
+static int8_t next_wildcard(uint32_t mask, int8_t below) {
+    for (int8_t shift = below - 4; shift >= 0; shift -= 4) {
+        if (((mask >> shift) & 0x0F) == 0x0F)
+            return shift;
+    }
+    return -1;
+}
+
+bool id_has_wildcard(uint32_t id) {
+    return next_wildcard(id, 32) >= 0;
+}
+
+bool id_matches(uint32_t mask, uint32_t id) {
+    for (uint8_t shift = 0; shift < 32; shift += 4) {
+        uint8_t m = (mask >> shift) & 0x0F;
+        if (m != 0x0F && m != ((id >> shift) & 0x0F))
+            return false;
+    }
+    return true;
+}
+
+void SecondaryScan::start(uint32_t mask) {
+    this->depth_ = 0;
+    this->probes_ = 0;
+    int8_t shift = next_wildcard(mask, 32);
+    if (shift < 0)
+        return;
+    this->stack_[0] = Level{mask, (uint8_t) shift, 0};
+    this->depth_ = 1;
+}
+
+uint32_t SecondaryScan::probe() const {
+    const Level &level = this->stack_[this->depth_ - 1];
+    return (level.mask & ~(0x0Fu << level.shift)) | ((uint32_t) level.digit << level.shift);
+}
+
+void SecondaryScan::result(ScanResult result) {
+    if (!this->running())
+        return;
+    this->probes_++;
+    if (result == ScanResult::COLLISION) {
+        // Refine the prefix with the next wildcard digit; a collision on a complete ID can not be resolved
+        uint32_t mask = this->probe();
+        int8_t shift = next_wildcard(mask, this->stack_[this->depth_ - 1].shift);
+        if (shift >= 0) {
+            this->stack_[this->depth_++] = Level{mask, (uint8_t) shift, 0};
+            return;
+        }
+    }
+    this->advance_();
+}
+
+void SecondaryScan::advance_() {
+    while (this->depth_ > 0) {
+        Level &level = this->stack_[this->depth_ - 1];
+        if (++level.digit <= 9)
+            return;
+        this->depth_--;
+    }
+}
+
+}  // namespace mbus
+}  // namespace sensostar
+}  // namespace esphome
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+
+// Plain C++ secondary address wildcard search (EN 13757-3 annex), no ESPHome dependencies
+
+namespace esphome {
+namespace sensostar {
+namespace mbus {
+
+// BCD identification numbers, a 0xF nibble is a wildcard
+bool id_has_wildcard(uint32_t id);
+bool id_matches(uint32_t mask, uint32_t id);
+
+enum class ScanResult : uint8_t {
+  NONE = 0,  // no answer to the selection
+  SINGLE,    // exactly one meter answered
+  COLLISION, // garbled answer, several meters match
+};
+
+// Depth-first search over the wildcard digits of a mask, most significant digit first.
+// Only prefixes with a collision are refined, so the number of probes grows with the
+// number of meters instead of the size of the address space.
+class SecondaryScan {
+ public:
+  void start(uint32_t mask);
+  void stop() { this->depth_ = 0; }
+  bool running() const { return this->depth_ > 0; }
+  // Mask to select next
+  uint32_t probe() const;
+  void result(ScanResult result);
+  uint16_t probes() const { return this->probes_; }
+
+ protected:
+  void advance_();
+
+  struct Level {
+    uint32_t mask;
+    uint8_t shift; // nibble being enumerated
+    uint8_t digit;
+  };
+  Level stack_[8];
+  uint8_t depth_{0};
+  uint16_t probes_{0};
+};
+
+}  // namespace mbus
+}  // namespace sensostar
+}  // namespace esphome
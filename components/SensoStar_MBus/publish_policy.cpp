@@ -0,0 +1,29 @@
+#include "publish_policy.h"
+
+#include <cmath>
+
+namespace esphome {
+namespace sensostar {
+
+bool PublishPolicy::is_due(float value, uint32_t now) const {
+    if (!this->on_change_ || !this->has_last_)
+        return true;
+    if (this->heartbeat_ && (uint32_t)(now - this->last_publish_) >= this->heartbeat_)
+        return true;
+    if (std::isnan(value) || std::isnan(this->last_value_))
+        return std::isnan(value) != std::isnan(this->last_value_);
+
+    float threshold = this->deadband_relative_ * std::fabs(this->last_value_);
+    if (threshold < this->deadband_)
+        threshold = this->deadband_;
+    return std::fabs(value - this->last_value_) > threshold;
+}
+
+void PublishPolicy::published(float value, uint32_t now) {
+    this->has_last_ = true;
+    this->last_value_ = value;
+    this->last_publish_ = now;
+}
+
+}  // namespace sensostar
+}  // namespace esphome
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+
+namespace esphome {
+namespace sensostar {
+
+// Decides whether a new value of a sensor is worth publishing
+class PublishPolicy {
+ public:
+  // Publish only values that differ from the last published one
+  void set_on_change(bool on_change) { this->on_change_ = on_change; }
+  // Changes up to max(deadband, deadband_relative * |last value|) are suppressed
+  void set_deadband(float deadband) { this->deadband_ = deadband; }
+  void set_deadband_relative(float deadband_relative) { this->deadband_relative_ = deadband_relative; }
+  // Publish anyway after this many ms without a publish, 0 = never
+  void set_heartbeat(uint32_t heartbeat) { this->heartbeat_ = heartbeat; }
+  // Published together with the other values of a frame as soon as one of them is due
+  void set_batch(bool batch) { this->batch_ = batch; }
+
+  bool is_batch() const { return this->batch_; }
+  bool is_due(float value, uint32_t now) const;
+  void published(float value, uint32_t now);
+  // Next value is due regardless of the last one, e.g. after publishing NaN
+  void reset() { this->has_last_ = false; }
+
+ protected:
+  bool on_change_{false};
+  bool batch_{false};
+  float deadband_{0};
+  float deadband_relative_{0};
+  uint32_t heartbeat_{0};
+
+  bool has_last_{false};
+  float last_value_{0};
+  uint32_t last_publish_{0};
+};
+
+}  // namespace sensostar
+}  // namespace esphome
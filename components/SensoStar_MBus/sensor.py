@@ -1,5 +1,6 @@
 import esphome.codegen as cg
 import esphome.config_validation as cv
+import esphome.final_validate as fv
 from esphome.components import sensor
 from esphome.const import (
     CONF_ENERGY,
@@ -13,27 +14,110 @@ from esphome.const import (
     DEVICE_CLASS_POWER,
     DEVICE_CLASS_VOLUME_FLOW_RATE,
     DEVICE_CLASS_TEMPERATURE,
+    DEVICE_CLASS_DURATION,
+    
+    CONF_ACCURACY_DECIMALS,
+    CONF_TIME_ID,
+    CONF_TYPE,
+    STATE_CLASS_TOTAL,
+    UNIT_HOUR,
+    
+    ENTITY_CATEGORY_DIAGNOSTIC,
+    
+    CONF_HEARTBEAT,
+    CONF_MULTIPLY,
     
     UNIT_KILOWATT_HOURS,
     UNIT_CUBIC_METER,
     UNIT_WATT,
     UNIT_CUBIC_METER_PER_HOUR,
     UNIT_CELSIUS,
+    UNIT_MILLISECOND,
+    UNIT_MICROSECOND,
+    UNIT_SECOND,
     
     ICON_POWER,
     ICON_THERMOMETER,
+    ICON_TIMER,
+    ICON_COUNTER,
     
     STATE_CLASS_MEASUREMENT,
     STATE_CLASS_TOTAL_INCREASING,
 
 )
-from . import SensoStarComponent, CONF_SENSOSTAR_ID
+from . import (
+    sensostar,
+    SensoStarComponent,
+    SensoStarMeter,
+    Quantity,
+    CONF_METER_ID,
+    CONF_SENSOSTAR_ID,
+)
 
 CONF_TEMPERATURE_FLOW = "temperature_flow"
 CONF_TEMPERATURE_RETURN = "temperature_return"
 CONF_TEMPERATURE_DIFF = "temperature_diff"
 CONF_CALCULATED_POWER = "calculated_power"
 CONF_CALCULATED_ENERGY_DEICE = "calculated_energy_deice"
+CONF_RESPONSE_TIME = "response_time"
+CONF_RESPONSE_TIME_P95 = "response_time_p95"
+CONF_SUPPRESSED_PUBLISHES = "suppressed_publishes"
+CONF_TIME_TO_FIRST_READING = "time_to_first_reading"
+CONF_EFFECTIVE_INTERVAL = "effective_interval"
+CONF_DAILY_POLLS = "daily_polls"
+
+CONF_PUBLISH = "publish"
+CONF_ON_CHANGE = "on_change"
+CONF_DEADBAND = "deadband"
+CONF_DEADBAND_PERCENT = "deadband_percent"
+CONF_BATCH = "batch"
+
+# Bus statistics of the hub, compiled in only when one of them is configured
+CONF_FRAMES_PER_MINUTE = "frames_per_minute"
+CONF_CHECKSUM_ERRORS = "checksum_errors"
+CONF_LENGTH_ERRORS = "length_errors"
+CONF_FRAMING_ERRORS = "framing_errors"
+CONF_UNKNOWN_FRAMES = "unknown_frames"
+CONF_TIMEOUTS = "timeouts"
+CONF_RETRIES = "retries"
+CONF_RECEIVE_TIME = "receive_time"
+CONF_DECODE_TIME = "decode_time"
+CONF_PUBLISH_TIME = "publish_time"
+
+UNIT_FRAMES_PER_MINUTE = "frames/min"
+
+# Consumption aggregates, published at the end of each period
+CONF_AGGREGATES = "aggregates"
+CONF_PERIOD = "period"
+AggregatePeriod = sensostar.enum("AggregatePeriod")
+AggregateValue = sensostar.enum("AggregateValue")
+AGGREGATE_PERIODS = {
+    "hour": AggregatePeriod.PERIOD_HOUR,
+    "day": AggregatePeriod.PERIOD_DAY,
+    "month": AggregatePeriod.PERIOD_MONTH,
+}
+
+# Sensors for any data record of the RSP_UD frame
+CONF_RECORDS = "records"
+CONF_VIF = "vif"
+CONF_VIFE = "vife"
+CONF_FUNCTION = "function"
+CONF_STORAGE = "storage"
+CONF_TARIFF = "tariff"
+CONF_SUBUNIT = "subunit"
+
+# DIF function field
+RECORD_FUNCTIONS = {
+    "instantaneous": 0,
+    "maximum": 1,
+    "minimum": 2,
+    "error": 3,
+}
+# Must match RECORD_FILTER_NO_VIFE and MAX_RECORD_FILTERS in mbus_decoder.h
+RECORD_FILTER_NO_VIFE = 0x100
+MAX_RECORD_FILTERS = 16
+
+MeterSensor = sensostar.enum("MeterSensor")
 
 TYPES = [
     CONF_ENERGY,
@@ -44,85 +128,402 @@ TYPES = [
     CONF_TEMPERATURE_RETURN,
     CONF_TEMPERATURE_DIFF,
     CONF_CALCULATED_POWER,
-    CONF_CALCULATED_ENERGY_DEICE
+    CONF_CALCULATED_ENERGY_DEICE,
+    CONF_RESPONSE_TIME,
+    CONF_RESPONSE_TIME_P95,
 ]
 
-CONFIG_SCHEMA = cv.All(
+COUNTER_TYPES = [
+    CONF_CHECKSUM_ERRORS,
+    CONF_LENGTH_ERRORS,
+    CONF_FRAMING_ERRORS,
+    CONF_UNKNOWN_FRAMES,
+    CONF_TIMEOUTS,
+    CONF_RETRIES,
+]
+
+# longest receive, decode and publish step in loop() since the previous update
+STAGE_TIME_TYPES = [
+    CONF_RECEIVE_TIME,
+    CONF_DECODE_TIME,
+    CONF_PUBLISH_TIME,
+]
+
+# meter sensors without a publish policy
+METER_DIAGNOSTIC_TYPES = [
+    CONF_SUPPRESSED_PUBLISHES,
+    CONF_TIME_TO_FIRST_READING,
+    CONF_EFFECTIVE_INTERVAL,
+    CONF_DAILY_POLLS,
+]
+
+HUB_TYPES = [CONF_FRAMES_PER_MINUTE] + COUNTER_TYPES + STAGE_TIME_TYPES
+
+# quantities of the readout each sensor is calculated from, for the selective readout
+THERMAL_QUANTITIES = ["VOLUME_FLOW", "TEMPERATURE_DIFF", "TEMPERATURE_FLOW", "TEMPERATURE_RETURN"]
+SENSOR_QUANTITIES = {
+    CONF_ENERGY: ["ENERGY"],
+    CONF_VOLUME: ["VOLUME"],
+    CONF_POWER: ["POWER"],
+    CONF_FLOW: ["VOLUME_FLOW"],
+    CONF_TEMPERATURE_FLOW: ["TEMPERATURE_FLOW"],
+    CONF_TEMPERATURE_RETURN: ["TEMPERATURE_RETURN"],
+    CONF_TEMPERATURE_DIFF: ["TEMPERATURE_DIFF"],
+    CONF_CALCULATED_POWER: THERMAL_QUANTITIES,
+    CONF_CALCULATED_ENERGY_DEICE: THERMAL_QUANTITIES,
+}
+
+# Without a publish block every decoded value is published
+PUBLISH_POLICY_SCHEMA = cv.Schema(
+    {
+        cv.Optional(CONF_ON_CHANGE, default=False): cv.boolean,
+        cv.Optional(CONF_DEADBAND): cv.positive_float,
+        cv.Optional(CONF_DEADBAND_PERCENT): cv.percentage,
+        cv.Optional(CONF_HEARTBEAT): cv.positive_time_period_milliseconds,
+        cv.Optional(CONF_BATCH, default=False): cv.boolean,
+    }
+)
+
+
+def policy_sensor_schema(**kwargs):
+    return sensor.sensor_schema(**kwargs).extend(
+        {cv.Optional(CONF_PUBLISH): PUBLISH_POLICY_SCHEMA}
+    )
+
+
+# The value is scaled to the unit of the built-in sensor when the VIF is one of theirs (kWh, m3, W,
+# m3/h, C), otherwise it is the raw record value; multiply converts it further
+RECORD_SCHEMA = sensor.sensor_schema().extend(
+    {
+        cv.Required(CONF_VIF): cv.hex_uint8_t,
+        cv.Optional(CONF_VIFE): cv.hex_uint8_t,
+        cv.Optional(CONF_FUNCTION, default="instantaneous"): cv.enum(
+            RECORD_FUNCTIONS, lower=True
+        ),
+        # 0 is the current value, higher numbers are stored values, e.g. month ends
+        cv.Optional(CONF_STORAGE, default=0): cv.positive_int,
+        cv.Optional(CONF_TARIFF, default=0): cv.uint8_t,
+        cv.Optional(CONF_SUBUNIT, default=0): cv.uint16_t,
+        cv.Optional(CONF_MULTIPLY, default=1.0): cv.float_,
+    }
+)
+
+
+# quantity each aggregate is calculated from, for the selective readout
+AGGREGATE_QUANTITIES = {
+    "energy": "ENERGY",
+    "volume": "VOLUME",
+    **{f"temperature_flow_{stat}": "TEMPERATURE_FLOW" for stat in ("min", "max", "mean")},
+    **{f"temperature_return_{stat}": "TEMPERATURE_RETURN" for stat in ("min", "max", "mean")},
+    "operating_hours": "VOLUME_FLOW",
+}
+
+
+def aggregate_schema(**kwargs):
+    return sensor.sensor_schema(**kwargs).extend(
+        {cv.Required(CONF_PERIOD): cv.enum(AGGREGATE_PERIODS, lower=True)}
+    )
+
+
+AGGREGATE_TEMPERATURE_SCHEMA = aggregate_schema(
+    unit_of_measurement=UNIT_CELSIUS,
+    icon=ICON_THERMOMETER,
+    accuracy_decimals=1,
+    device_class=DEVICE_CLASS_TEMPERATURE,
+    state_class=STATE_CLASS_MEASUREMENT,
+)
+
+# consumption and operating time within the period, temperatures over the period
+AGGREGATE_SCHEMA = cv.typed_schema(
+    {
+        "energy": aggregate_schema(
+            unit_of_measurement=UNIT_KILOWATT_HOURS,
+            icon=ICON_POWER,
+            accuracy_decimals=0,
+            device_class=DEVICE_CLASS_ENERGY,
+            state_class=STATE_CLASS_TOTAL,
+        ),
+        "volume": aggregate_schema(
+            unit_of_measurement=UNIT_CUBIC_METER,
+            accuracy_decimals=3,
+            device_class=DEVICE_CLASS_VOLUME,
+            state_class=STATE_CLASS_TOTAL,
+        ),
+        **{
+            f"temperature_{side}_{stat}": AGGREGATE_TEMPERATURE_SCHEMA
+            for side in ("flow", "return")
+            for stat in ("min", "max", "mean")
+        },
+        "operating_hours": aggregate_schema(
+            unit_of_measurement=UNIT_HOUR,
+            icon=ICON_TIMER,
+            accuracy_decimals=2,
+            device_class=DEVICE_CLASS_DURATION,
+            state_class=STATE_CLASS_MEASUREMENT,
+        ),
+    },
+    key=CONF_TYPE,
+    lower=True,
+)
+
+
+def _final_validate(config):
+    # the periods follow the clock of the hub
+    if CONF_AGGREGATES in config:
+        hub_config = fv.full_config.get().get("SensoStar_MBus", {})
+        if CONF_TIME_ID not in hub_config:
+            raise cv.Invalid(f"{CONF_AGGREGATES} need {CONF_TIME_ID} on the SensoStar_MBus hub")
+    return config
+
+
+FINAL_VALIDATE_SCHEMA = _final_validate
+
+METER_SCHEMA = cv.All(
     cv.Schema(
         {
+            cv.GenerateID(CONF_METER_ID): cv.use_id(SensoStarMeter),
             cv.GenerateID(CONF_SENSOSTAR_ID): cv.use_id(SensoStarComponent),
-            cv.Optional(CONF_ENERGY): sensor.sensor_schema(
+            cv.Optional(CONF_ENERGY): policy_sensor_schema(
                 unit_of_measurement=UNIT_KILOWATT_HOURS,
                 icon=ICON_POWER,
                 accuracy_decimals=0,
                 device_class=DEVICE_CLASS_ENERGY,
                 state_class=STATE_CLASS_TOTAL_INCREASING,
             ),
-            cv.Optional(CONF_VOLUME): sensor.sensor_schema(
+            cv.Optional(CONF_VOLUME): policy_sensor_schema(
                 unit_of_measurement=UNIT_CUBIC_METER,
                 accuracy_decimals=3,
                 device_class=DEVICE_CLASS_VOLUME,
                 state_class=STATE_CLASS_TOTAL_INCREASING,
             ),
-            cv.Optional(CONF_POWER): sensor.sensor_schema(
+            cv.Optional(CONF_POWER): policy_sensor_schema(
                 unit_of_measurement=UNIT_WATT,
                 icon=ICON_POWER,
                 accuracy_decimals=0,
                 device_class=DEVICE_CLASS_POWER,
                 state_class=STATE_CLASS_MEASUREMENT,
             ),
-            cv.Optional(CONF_FLOW): sensor.sensor_schema(
+            cv.Optional(CONF_FLOW): policy_sensor_schema(
                 unit_of_measurement=UNIT_CUBIC_METER_PER_HOUR,
                 accuracy_decimals=3,
                 device_class=DEVICE_CLASS_VOLUME_FLOW_RATE,
                 state_class=STATE_CLASS_MEASUREMENT,
             ),
-            cv.Optional(CONF_TEMPERATURE_FLOW): sensor.sensor_schema(
+            cv.Optional(CONF_TEMPERATURE_FLOW): policy_sensor_schema(
                 unit_of_measurement=UNIT_CELSIUS,
                 icon=ICON_THERMOMETER,
                 accuracy_decimals=0,
                 device_class=DEVICE_CLASS_TEMPERATURE,
                 state_class=STATE_CLASS_MEASUREMENT,
             ),
-            cv.Optional(CONF_TEMPERATURE_RETURN): sensor.sensor_schema(
+            cv.Optional(CONF_TEMPERATURE_RETURN): policy_sensor_schema(
                 unit_of_measurement=UNIT_CELSIUS,
                 icon=ICON_THERMOMETER,
                 accuracy_decimals=0,
                 device_class=DEVICE_CLASS_TEMPERATURE,
                 state_class=STATE_CLASS_MEASUREMENT,
             ),
-            cv.Optional(CONF_TEMPERATURE_DIFF): sensor.sensor_schema(
+            cv.Optional(CONF_TEMPERATURE_DIFF): policy_sensor_schema(
                 unit_of_measurement=UNIT_CELSIUS,
                 icon=ICON_THERMOMETER,
                 accuracy_decimals=2,
                 device_class=DEVICE_CLASS_TEMPERATURE,
                 state_class=STATE_CLASS_MEASUREMENT,
             ),
-            cv.Optional(CONF_CALCULATED_POWER): sensor.sensor_schema(
+            cv.Optional(CONF_CALCULATED_POWER): policy_sensor_schema(
                 unit_of_measurement=UNIT_WATT,
                 icon=ICON_POWER,
                 accuracy_decimals=0,
                 device_class=DEVICE_CLASS_POWER,
                 state_class=STATE_CLASS_MEASUREMENT,
             ),
-            cv.Optional(CONF_CALCULATED_ENERGY_DEICE): sensor.sensor_schema(
+            cv.Optional(CONF_CALCULATED_ENERGY_DEICE): policy_sensor_schema(
                 unit_of_measurement=UNIT_KILOWATT_HOURS,
                 icon=ICON_POWER,
                 accuracy_decimals=2,
                 device_class=DEVICE_CLASS_ENERGY,
                 state_class=STATE_CLASS_TOTAL_INCREASING,
             ),
+            # median and 95th percentile of the measured readout response latency
+            cv.Optional(CONF_RESPONSE_TIME): policy_sensor_schema(
+                unit_of_measurement=UNIT_MILLISECOND,
+                icon=ICON_TIMER,
+                accuracy_decimals=0,
+                device_class=DEVICE_CLASS_DURATION,
+                state_class=STATE_CLASS_MEASUREMENT,
+                entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+            ),
+            cv.Optional(CONF_RESPONSE_TIME_P95): policy_sensor_schema(
+                unit_of_measurement=UNIT_MILLISECOND,
+                icon=ICON_TIMER,
+                accuracy_decimals=0,
+                device_class=DEVICE_CLASS_DURATION,
+                state_class=STATE_CLASS_MEASUREMENT,
+                entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+            ),
+            # values held back by the publish policies
+            cv.Optional(CONF_SUPPRESSED_PUBLISHES): sensor.sensor_schema(
+                icon=ICON_COUNTER,
+                accuracy_decimals=0,
+                state_class=STATE_CLASS_TOTAL_INCREASING,
+                entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+            ),
+            # seconds from boot to the first valid readout
+            cv.Optional(CONF_TIME_TO_FIRST_READING): sensor.sensor_schema(
+                unit_of_measurement=UNIT_SECOND,
+                icon=ICON_TIMER,
+                accuracy_decimals=1,
+                device_class=DEVICE_CLASS_DURATION,
+                state_class=STATE_CLASS_MEASUREMENT,
+                entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+            ),
+            # adaptive polling: current interval and polls since the daily count was reset
+            cv.Optional(CONF_EFFECTIVE_INTERVAL): sensor.sensor_schema(
+                unit_of_measurement=UNIT_SECOND,
+                icon=ICON_TIMER,
+                accuracy_decimals=0,
+                device_class=DEVICE_CLASS_DURATION,
+                state_class=STATE_CLASS_MEASUREMENT,
+                entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+            ),
+            cv.Optional(CONF_DAILY_POLLS): sensor.sensor_schema(
+                icon=ICON_COUNTER,
+                accuracy_decimals=0,
+                state_class=STATE_CLASS_TOTAL_INCREASING,
+                entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+            ),
+            cv.Optional(CONF_AGGREGATES): cv.ensure_list(AGGREGATE_SCHEMA),
+            cv.Optional(CONF_RECORDS): cv.All(
+                cv.ensure_list(RECORD_SCHEMA), cv.Length(max=MAX_RECORD_FILTERS)
+            ),
         }
     ).extend(cv.COMPONENT_SCHEMA)
 )
 
-async def setup_conf(config, key, hub):
+# Bus statistics belong to the hub, in an entry of their own without meter_id
+HUB_SCHEMA = cv.Schema(
+    {
+        cv.GenerateID(CONF_SENSOSTAR_ID): cv.use_id(SensoStarComponent),
+        cv.Optional(CONF_FRAMES_PER_MINUTE): sensor.sensor_schema(
+            unit_of_measurement=UNIT_FRAMES_PER_MINUTE,
+            icon=ICON_COUNTER,
+            accuracy_decimals=1,
+            state_class=STATE_CLASS_MEASUREMENT,
+            entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+        ),
+        **{
+            cv.Optional(key): sensor.sensor_schema(
+                icon=ICON_COUNTER,
+                accuracy_decimals=0,
+                state_class=STATE_CLASS_TOTAL_INCREASING,
+                entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+            )
+            for key in COUNTER_TYPES
+        },
+        **{
+            cv.Optional(key): sensor.sensor_schema(
+                unit_of_measurement=UNIT_MICROSECOND,
+                icon=ICON_TIMER,
+                accuracy_decimals=0,
+                state_class=STATE_CLASS_MEASUREMENT,
+                entity_category=ENTITY_CATEGORY_DIAGNOSTIC,
+            )
+            for key in STAGE_TIME_TYPES
+        },
+    }
+).extend(cv.COMPONENT_SCHEMA)
+
+
+def _validate_entry(config):
+    hub_keys = [key for key in HUB_TYPES if key in config]
+    if not hub_keys:
+        return METER_SCHEMA(config)
+    if CONF_METER_ID in config:
+        raise cv.Invalid(
+            f"{', '.join(hub_keys)} are bus statistics of the hub, put them in an entry without {CONF_METER_ID}"
+        )
+    return HUB_SCHEMA(config)
+
+
+CONFIG_SCHEMA = _validate_entry
+
+
+async def setup_conf(config, key, parent):
     if sensor_config := config.get(key):
         sens = await sensor.new_sensor(sensor_config)
-        cg.add(getattr(hub, f"set_{key}_sensor")(sens))
+        cg.add(getattr(parent, f"set_{key}_sensor")(sens))
+        if policy := sensor_config.get(CONF_PUBLISH):
+            deadband = policy.get(CONF_DEADBAND, 0.0)
+            deadband_relative = policy.get(CONF_DEADBAND_PERCENT, 0.0)
+            heartbeat = policy.get(CONF_HEARTBEAT)
+            # a deadband or heartbeat only makes sense when unchanged values are suppressed
+            on_change = (
+                policy[CONF_ON_CHANGE]
+                or CONF_DEADBAND in policy
+                or CONF_DEADBAND_PERCENT in policy
+                or heartbeat is not None
+            )
+            cg.add(
+                parent.set_publish_policy(
+                    getattr(MeterSensor, f"SENSOR_{key.upper()}"),
+                    on_change,
+                    deadband,
+                    deadband_relative,
+                    heartbeat.total_milliseconds if heartbeat is not None else 0,
+                    policy[CONF_BATCH],
+                )
+            )
 
 
 async def to_code(config):
-    hub = await cg.get_variable(config[CONF_SENSOSTAR_ID])
-    for key in TYPES:
-        await setup_conf(config, key, hub)
+    if CONF_METER_ID not in config:
+        cg.add_define("USE_SENSOSTAR_STATS")
+        hub = await cg.get_variable(config[CONF_SENSOSTAR_ID])
+        for key in HUB_TYPES:
+            await setup_conf(config, key, hub)
+        return
+
+    meter = await cg.get_variable(config[CONF_METER_ID])
+    for key in TYPES + METER_DIAGNOSTIC_TYPES:
+        await setup_conf(config, key, meter)
+
+    for aggregate_config in config.get(CONF_AGGREGATES, []):
+        cg.add_define("USE_SENSOSTAR_AGGREGATES")
+        sens = await sensor.new_sensor(aggregate_config)
+        cg.add(
+            meter.add_aggregate_sensor(
+                sens,
+                aggregate_config[CONF_PERIOD],
+                getattr(AggregateValue, f"AGGREGATE_{aggregate_config[CONF_TYPE].upper()}"),
+            )
+        )
+
+    quantities = []
+    for key, needed in SENSOR_QUANTITIES.items():
+        if key in config:
+            quantities += needed
+    for aggregate_config in config.get(CONF_AGGREGATES, []):
+        quantities.append(AGGREGATE_QUANTITIES[aggregate_config[CONF_TYPE]])
+    # the energy between its kWh steps is integrated from the power
+    if config.get(CONF_ENERGY, {}).get(CONF_ACCURACY_DECIMALS, 0) > 0:
+        quantities.append("POWER")
+    for quantity in sorted(set(quantities)):
+        cg.add(meter.request_quantity(getattr(Quantity, quantity)))
+
+    for record_config in config.get(CONF_RECORDS, []):
+        sens = await sensor.new_sensor(record_config)
+        cg.add(
+            meter.add_record_sensor(
+                sens,
+                record_config[CONF_VIF] & 0x7F,
+                record_config[CONF_VIFE] & 0x7F
+                if CONF_VIFE in record_config
+                else RECORD_FILTER_NO_VIFE,
+                record_config[CONF_FUNCTION],
+                record_config[CONF_STORAGE],
+                record_config[CONF_TARIFF],
+                record_config[CONF_SUBUNIT],
+                record_config[CONF_MULTIPLY],
+            )
+        )
+
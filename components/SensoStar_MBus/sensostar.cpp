@@ -1,14 +1,61 @@
 #include "sensostar.h"
-#include <vector>
+#include "sensostar_protocol.h"
 #include "esphome/core/log.h"
 #include "esphome/core/helpers.h"
+#ifdef USE_SENSOSTAR_GATEWAY
+#include "esphome/components/network/util.h"
+#endif
+
+#include <algorithm>
+#include <cstring>
 
 namespace esphome {
 namespace sensostar {
 
 static const char *const TAG = "SensoStar";
 
-void SensoStarComponent::setup() { }
+void SensoStarComponent::setup() {
+    // Meters found by an earlier scan
+    this->scan_pref_ = global_preferences->make_preference<ScanStore>(fnv1_hash("sensostar_scan"), true);
+    ScanStore store{};
+    if (!this->scan_pref_.load(&store) || store.count > MBUS_MAX_SCAN_RESULTS)
+        store.count = 0;
+    if (!this->master_.restore_scan(store.ids, store.count))
+        this->master_.rescan();
+
+    // Meters that completed the same init sequence before the reboot are read right away
+    for (auto *meter : this->meters_) {
+        meter->init_pref_ = global_preferences->make_preference<uint32_t>(fnv1_hash(std::string("sensostar_init_") + meter->name_()), true);
+        uint32_t fingerprint = 0;
+        if (meter->init_pref_.load(&fingerprint) && fingerprint == this->master_.init_fingerprint(meter)) {
+            ESP_LOGD(TAG, "Meter %s: initialized before reboot, skipping init sequence", meter->name_());
+            meter->assume_initialized();
+        }
+    }
+#ifdef USE_SENSOSTAR_HISTORY
+    for (auto *meter : this->meters_)
+        meter->setup_history();
+#endif
+#ifdef USE_SENSOSTAR_AGGREGATES
+    for (auto *meter : this->meters_)
+        meter->setup_aggregates();
+#endif
+    // Record sensors and the history use records outside of the configured sensors
+    for (auto *meter : this->meters_) {
+        bool full = !meter->record_filters_.empty();
+#ifdef USE_SENSOSTAR_HISTORY
+        full = full || meter->history_.capacity() > 0;
+#endif
+        if (meter->selective_ && full) {
+            ESP_LOGW(TAG, "Meter %s: record sensors and history need the full readout, selective readout disabled", meter->name_());
+            meter->selective_ = false;
+        }
+    }
+#ifdef USE_SENSOSTAR_HISTORY_EXPORT
+    this->web_server_base_->init();
+    this->web_server_base_->add_handler(new HistoryExportHandler(this->meters_, this->history_path_));
+#endif
+}
 
 void SensoStarComponent::dump_config() {
     ESP_LOGCONFIG(TAG, "SensoStar M-Bus:");
@@ -16,45 +63,22 @@ void SensoStarComponent::dump_config() {
     if (this->data_led_ != nullptr) {
         ESP_LOGCONFIG(TAG, "  Data LED: Present");
     }	
+    if (this->master_.get_baud_rate() != MBUS_DEFAULT_BAUD_RATE)
+        ESP_LOGCONFIG(TAG, "  Negotiated baud rate: %u", (unsigned) this->master_.get_baud_rate());
+    ESP_LOGCONFIG(TAG, "  Scheduling: %s", this->master_.is_priority_scheduling() ? "priority" : "round-robin");
+#ifdef USE_SENSOSTAR_HISTORY_EXPORT
+    ESP_LOGCONFIG(TAG, "  History export: %s", this->history_path_);
+#endif
+#ifdef USE_SENSOSTAR_GATEWAY
+    ESP_LOGCONFIG(TAG, "  Gateway port: %u", this->gateway_port_);
+#endif
+    for (auto *meter : this->meters_)
+        meter->dump_config();
 }
 
 void SensoStarComponent::update() {
-    this->trigger_next_ = true;
-}
-
-static char format_hex_pretty_char(uint8_t v) { return v >= 10 ? 'A' + (v - 10) : '0' + v; }
-static double convert_value(uint32_t data, int8_t decimals){
-    double value = (int32_t)data;
-    for (int8_t i=0; i<decimals; i++) value *= 10;
-    for (int8_t i=decimals; i<0; i++) value /= 10;
-    return value;
-}
-
-void SensoStarComponent::publish_nans_(){
-#ifdef USE_TEXT_SENSOR
-    if (this->status_text_sensor_)
-        this->status_text_sensor_->publish_state("No readout from heat meter");
-#endif
-#ifdef USE_SENSOR
-    if (this->energy_sensor_)
-        this->energy_sensor_->publish_state(NAN);
-    if (this->volume_sensor_)
-        this->volume_sensor_->publish_state(NAN);
-    if (this->power_sensor_)
-        this->power_sensor_->publish_state(NAN);
-    if (this->flow_sensor_)
-        this->flow_sensor_->publish_state(NAN);
-    if (this->temperature_flow_sensor_)
-        this->temperature_flow_sensor_->publish_state(NAN);
-    if (this->temperature_return_sensor_)
-        this->temperature_return_sensor_->publish_state(NAN);
-    if (this->temperature_diff_sensor_)
-        this->temperature_diff_sensor_->publish_state(NAN);
-    if (this->calculated_power_sensor_)
-        this->calculated_power_sensor_->publish_state(NAN);
-    if (this->calculated_energy_deice_sensor_)
-        this->calculated_energy_deice_sensor_->publish_state(NAN);
-#endif
+    SENSOSTAR_STATS(this->publish_stats_(millis()));
+    this->master_.update();
 }
 
 void SensoStarComponent::flash_data_led_() {
@@ -73,388 +97,154 @@ void SensoStarComponent::loop() {
         this->data_led_off_time_ = 0;
     }
 
-    if ( this->receiving_ > 0 && ( now - this->last_transmission_ >= 500 + this->last_send_tx_offset_ ) ) {
-        ESP_LOGW(TAG, "Last transmission too long ago. Reset RX index.");
-        this->publish_nans_();
-        this->data_.clear();
-        this->receiving_ = 0;
-        if (this->init_state_ != 0xff)
-            this->trigger_next_ = true;
-        }
-    
-    // Trigger initialization sequence
-    if (this->init_state_ != 0xff && this->init_state_&0x10 && now - this->last_transmission_ >= 20)
-        this->trigger_next_ = true;
-  
-    if ( available() )
-        this->last_transmission_ = now;
-   
-    while ( available() ) {
-        uint8_t c;
-        read_byte(&c);
-        
-        
-        if (this->receiving_ != 2) {
-            if (c == 0xe5) {
-                // Acknowledge
-                this->data_.clear();
-                this->receiving_ = 0;
-                
-                if (this->init_state_ != 0xff)
-                    this->init_state_ |= 0x10;
-            }
-            if (c != 0x68)
-                continue;
-                
-            this->receiving_ = 2;
-        }
-        this->data_.push_back(c);
-        
-        
-        if ( this->data_.size() > 4 && this->data_.size() == this->data_[1]+6 ) {
-                       
-            ESP_LOGV(TAG, "M-Bus received: %s", format_hex_pretty(this->data_).c_str());
-            
-            if (this->data_[0] != 0x68 || this->data_[3] != 0x68){
-                this->publish_nans_();
-                ESP_LOGW(TAG, "Invalid frame start");
-            }
-            else if (this->data_[1] != this->data_[2]){
-                this->publish_nans_();
-                ESP_LOGW(TAG, "Invalid length");
-            }
-            else if (this->data_[this->data_.size()-1] != 0x16){
-                this->publish_nans_();
-                ESP_LOGW(TAG, "Invalid stop");
-            }
-            else {
-                uint8_t checksum = 0;
-                for (uint8_t i = 4; i < this->data_.size()-2; i++)
-                    checksum += this->data_[i];
-                
-                if (checksum != this->data_[this->data_.size()-2]){
-                    this->publish_nans_();
-                    ESP_LOGW(TAG, "Invalid checksum");
-                }
-                else if (this->init_state_ != 0xff){
-                    // Initialization sequence
-                    this->init_state_ |= 0x10;
-                }
-                else if (this->data_[4] != 0x08 || this->data_[6] != 0x72 ){
-                    this->publish_nans_();
-                    ESP_LOGW(TAG, "Unknown frame");
-                }
-                else {
-                    // Store values for calculated_power
-                    double flow = -127;
-                    double tdiff = -127;
-                    // Store values for energy calculation
-                    float power = -127;
-                    float energy = -127;
-                    // Decode
-					this->flash_data_led_(); // Flash LED when new data arrived
-                    uint8_t i = 19; // Skip start header and fixed data header
-                    while(i < this->data_.size()-3){
-                        
-                        // Get all indexes
-                        uint8_t i_DIF = i;
-                        while( (this->data_[i] & 0x80) == 0x80)
-                            i++;
-                        i++;
-                        uint8_t i_VIF = i;
-                        while( (this->data_[i] & 0x80) == 0x80)
-                            i++;
-                        i++;
-                        
-                        // Read data
-                        uint8_t lc = this->data_[i_DIF]&0x0f; // Length and coding
-                        uint32_t result = 0;
-                        if (lc == 0x01){ // 8 Bit Integer
-                            result = this->data_[i];
-                            if ((this->data_[i]&0x80) == 0x80) // Negative
-                                result |= 0xffffff00;
-                            i += 1;
-                        }
-                        else if (lc == 0x02){ // 16 Bit Integer	
-                            result = this->data_[i] | this->data_[i+1]<<8;
-                            if ((this->data_[i+1]&0x80) == 0x80) // Negative
-                                result |= 0xffff0000;
-                            i += 2;
-                        }
-                        else if (lc == 0x03){ // 24 Bit Integer	
-                            result = this->data_[i] | this->data_[i+1]<<8 | this->data_[i+2]<<16;
-                            if ((this->data_[i+2]&0x80) == 0x80) // Negative
-                                result |= 0xff000000;
-                            i += 3;
-                        }
-                        else if (lc == 0x04){ // 32 Bit Integer
-                            result = this->data_[i] | this->data_[i+1]<<8 | this->data_[i+2]<<16 | this->data_[i+3]<<24;
-                            i += 4;
-                        }
-                        else {
-                            ESP_LOGW(TAG, "Unsupported coding 0x%02x", lc);
-                            break;
-                        }
-                        // Parce
-                        // DIF
-                        uint8_t f = ( this->data_[i_DIF]&0x30 ) >> 4; // Function (normal 0x00 for instantaneous value)
-                        // VIF
-                        uint8_t vif = this->data_[i_VIF] & 0x7f;
-                        if ( (vif&0x78) == 0x00 && f == 0x00){ // Energy (Wh)
-                            energy = convert_value(result, (vif&0x07) - 3) / 1000;
-#ifdef USE_SENSOR
-                            if (this->energy_sensor_ && this->energy_sensor_->get_accuracy_decimals() == 0)
-                                this->energy_sensor_->publish_state(energy);
-#endif
-                        }
-                        else if ( (vif&0x78) == 0x10 && f == 0x00){ // Volume (m3)
-#ifdef USE_SENSOR
-                            if (this->volume_sensor_)
-                                this->volume_sensor_->publish_state(convert_value(result, (vif&0x07) - 6));
+#ifdef USE_SENSOSTAR_GATEWAY
+    if (!this->gateway_started_ && network::is_connected())
+        this->gateway_started_ = this->gateway_.setup(this->gateway_port_);
+    this->gateway_request_ = this->gateway_started_ && this->gateway_.poll();
+    if (this->gateway_request_ && this->gateway_ready_ == 0)
+        this->gateway_ready_ = now;
 #endif
-                        }
-                        else if ( (vif&0x78) == 0x28 && f == 0x00){ // Power (W)
-                            power = convert_value(result, (vif&0x07) - 3);
-#ifdef USE_SENSOR
-                            if (this->power_sensor_)
-                                this->power_sensor_->publish_state(power);
-#endif
-                        }
-                        else if ( (vif&0x78) == 0x38 && f == 0x00){ // Volume Flow (m3/h)
-#ifdef USE_SENSOR
-                            flow = convert_value(result, (vif&0x07) - 6);
-                            if (this->flow_sensor_)
-                                this->flow_sensor_->publish_state(flow);
-#endif
-                        }
-                        else if ( (vif&0x7C) == 0x58 && f == 0x00){ // Flow Temperature (C)
-#ifdef USE_SENSOR
-                            if (this->temperature_flow_sensor_)
-                                this->temperature_flow_sensor_->publish_state(convert_value(result, (vif&0x03) - 3));
-#endif
-                        }
-                        else if ( (vif&0x7C) == 0x5c && f == 0x00){ // Return Temperature (C)
+
+    this->master_.loop();
+}
+
+void SensoStarComponent::bus_set_baud_rate(uint32_t baud_rate) {
+    this->flush();
+    this->parent_->set_baud_rate(baud_rate);
+    this->parent_->load_settings(false);
+}
+
+void SensoStarComponent::on_readout(BusMeter *bus_meter, const mbus::RspUdDecoder &decoder, uint32_t now) {
+    SensoStarMeter *meter = static_cast<SensoStarMeter *>(bus_meter);
+    this->flash_data_led_(); // Flash LED when new data arrived
 #ifdef USE_SENSOR
-                            if (this->temperature_return_sensor_)
-                                this->temperature_return_sensor_->publish_state(convert_value(result, (vif&0x03) - 3));
+    if (meter->first_reading_ && meter->time_to_first_reading_sensor_)
+        meter->time_to_first_reading_sensor_->publish_state(now / 1000.0f);
 #endif
-                        }
-                        else if ( (vif&0x7C) == 0x60 && f == 0x00){ // Temperature Difference (K)
-#ifdef USE_SENSOR
-                            tdiff = convert_value(result, (vif&0x03) - 3);
-                            if (this->temperature_diff_sensor_)
-                                this->temperature_diff_sensor_->publish_state(tdiff);
+    meter->first_reading_ = false;
+    const mbus::Readout &readout = decoder.readout();
+    meter->publish_readout(readout, now);
+    meter->publish_latency();
+    meter->commit_states(now);
+#ifdef USE_SENSOSTAR_HISTORY
+    uint8_t flags;
+    uint32_t time = this->history_time_(flags);
+    meter->record_history(readout, time, flags, now);
 #endif
-                        }
-                        else if ( this->data_[i_VIF] == 0xfd && this->data_[i_VIF+1] == 0x17 ) { // Error flags (binary)
-#ifdef USE_TEXT_SENSOR
-                            if (this->status_text_sensor_){
-                                if (result == 0x00)
-                                    this->status_text_sensor_->publish_state("OK");
-                                else {
-                                    bool append = false;
-                                    std::string state;
-                                    state.reserve(256);
-                                    if (result&0x01){
-                                        if (append)
-                                            state += " | ";
-                                        state += "Temperature Sensor 1: Cable Break";
-                                        append = true;
-                                    }
-                                    if (result&0x02){
-                                        if (append)
-                                            state += " | ";
-                                        state += "Temperature Sensor 1: Short Circuit";
-                                        append = true;
-                                    }
-                                    if (result&0x04){
-                                        if (append)
-                                            state += " | ";
-                                        state += "Temperature Sensor 2: Cable Break";
-                                        append = true;
-                                    }
-                                    if (result&0x08){
-                                        if (append)
-                                            state += " | ";
-                                        state += "Temperature Sensor 2: Short Circuit";
-                                        append = true;
-                                    }
-                                    if (result&0x10){
-                                        if (append)
-                                            state += " | ";
-                                        state += "Error at Flow Measurement System";
-                                        append = true;
-                                    }
-                                    if (result&0x20){
-                                        if (append)
-                                            state += " | ";
-                                        state += "Electronic Defect";
-                                        append = true;
-                                    }
-                                    if (result&0x40){
-                                        if (append)
-                                            state += " | ";
-                                        state += "Reset";
-                                        append = true;
-                                    }
-                                    if (result&0x80){
-                                        if (append)
-                                            state += " | ";
-                                        state += "Low Battery";
-                                        append = true;
-                                    }
-                                    this->status_text_sensor_->publish_state(state);
-                                }
-                            }
+#ifdef USE_SENSOSTAR_AGGREGATES
+    uint32_t keys[AGGREGATE_PERIOD_COUNT];
+    uint32_t timestamp;
+    if (this->aggregate_keys_(keys, timestamp))
+        meter->aggregate(readout, keys, timestamp, now);
 #endif
-                        }
-                        else {
-                            // Unknown
-                            ESP_LOGW(TAG, "Unsupported value type 0x%02x", vif);
-                            break;
-                        }
-                    }
-#ifdef USE_SENSOR
-                    if (this->energy_sensor_ && this->energy_sensor_->get_accuracy_decimals() > 0 && energy > 0){
-                        if (floor(energy) != floor(this->energy_calc_)){
-                            if (this->energy_calc_ > 0)
-                                this->energy_sensor_->publish_state(energy);
-                            this->energy_calc_ = energy;
-                        }
-                        else if (!std::isnan(this->energy_sensor_->get_raw_state()) && power >= 0){
-                            this->energy_calc_ += power / 3600.0f * (float)(uint32_t)(now - this->last_energy_calc_) / 1000000.0f;
-                            if (floor(energy) == floor(this->energy_calc_))
-                                this->energy_sensor_->publish_state(this->energy_calc_);
-                        }
-                        this->last_energy_calc_ = now;
-                    }
+}
 
-                    if (this->calculated_power_sensor_) {
-                        if (tdiff == -127 || flow == -127)
-                            this->calculated_power_sensor_->publish_state(NAN);
-                        else if (flow > 0)
-                            this->calculated_power_sensor_->publish_state(flow / 3.6 * 4193 * tdiff);
-                        else
-                            this->calculated_power_sensor_->publish_state(0);
-                    }
+void SensoStarComponent::on_init(BusMeter *meter, uint32_t fingerprint) {
+    static_cast<SensoStarMeter *>(meter)->init_pref_.save(&fingerprint);
+}
 
-                    if (calculated_energy_deice_sensor_) {
-                        if (this->last_energy_deice_calc_ && flow > 0 && tdiff < 0 && tdiff != -127) {
-                            this->energy_deice_calc_ -= flow / 3.6 * 4193 * tdiff / 3600.0f * (float)(uint32_t)(now - this->last_energy_deice_calc_) / 1000000.0f;
-                            this->calculated_energy_deice_sensor_->publish_state(this->energy_deice_calc_);
-                        }
-                        this->last_energy_deice_calc_ = now;
-                    }
-#endif
+void SensoStarComponent::on_scan_done(const std::vector<uint32_t> &ids) {
+    ScanStore store{};
+    store.count = std::min<size_t>(ids.size(), MBUS_MAX_SCAN_RESULTS);
+    std::copy(ids.begin(), ids.begin() + store.count, store.ids);
+    this->scan_pref_.save(&store);
+}
 
-                }
-            }
-            
-            this->data_.clear();
-            this->receiving_ = 0;
+void SensoStarComponent::schedule(uint32_t now) {
+    for (auto *meter : this->meters_)
+        meter->schedule_(now);
+}
+
+#ifdef USE_SENSOSTAR_HISTORY
+uint32_t SensoStarComponent::history_time_(uint8_t &flags) const {
+#ifdef USE_TIME
+    if (this->time_ != nullptr) {
+        ESPTime time = this->time_->now();
+        if (time.is_valid()) {
+            flags = 0;
+            return time.timestamp;
         }
     }
-    
-    if (this->trigger_next_) {
-        this->trigger_next_ = false;
+#endif
+    flags = HISTORY_FLAG_UPTIME;
+    return millis() / 1000;
+}
+#endif
 
-        this->flush();
-        this->data_.clear();
-        
-        if (this->init_state_ == 0x00 || this->init_state_ == 0x01){
-            uint8_t request_message[] = { 0x68, 0x08, 0x08, 0x68, 0x53, 0xFE, 0x51, 0x0F, 0x00, 0x00, 0x04, 0x5C, 0x11, 0x16 };
-            ESP_LOGV(TAG, "M-Bus write: %s", format_hex_pretty(request_message, sizeof(request_message)).c_str());
-            this->write_array(request_message, sizeof(request_message));
-            this->last_transmission_ = now;
-            this->last_send_tx_offset_ = sizeof(request_message) * 11 * 1000 / 2400;
-            this->receiving_ = 1;
-            this->init_state_ = 0x01;
-            
-        }
-        else if (this->init_state_ == 0x11 || this->init_state_ == 0x02){
-            uint8_t request_message[] = { 0x68, 0x09, 0x09, 0x68, 0x53, 0xFE, 0x51, 0x0F, 0x00, 0x00, 0x00, 0x59, 0x2D, 0x37, 0x16 };
-            ESP_LOGV(TAG, "M-Bus write: %s", format_hex_pretty(request_message, sizeof(request_message)).c_str());
-            this->write_array(request_message, sizeof(request_message));
-            this->last_transmission_ = now;
-            this->last_send_tx_offset_ = sizeof(request_message) * 11 * 1000 / 2400;
-            this->receiving_ = 1;
-            this->init_state_ = 0x02;
-        }
-        else if (this->init_state_ == 0x12 || this->init_state_ == 0x03){
-            uint8_t request_message[] = { 0x68, 0x08, 0x08, 0x68, 0x73, 0xFE, 0x51, 0x0F, 0x00, 0x00, 0x00, 0x5D, 0x2E, 0x16 };
-            ESP_LOGV(TAG, "M-Bus write: %s", format_hex_pretty(request_message, sizeof(request_message)).c_str());
-            this->write_array(request_message, sizeof(request_message));
-            this->last_transmission_ = now;
-            this->last_send_tx_offset_ = sizeof(request_message) * 11 * 1000 / 2400;
-            this->receiving_ = 1;
-            this->init_state_ = 0x03;
-        }
-        else if (this->init_state_ == 0x13 || this->init_state_ == 0x04){
-            uint8_t request_message[] = { 0x68, 0x73, 0x73, 0x68, 0x53, 0xFE, 0x51, 0x0F, 0x00, 0x00, 0x06, 0x5C, 0x09, 0x02, 0x00, 0x00, 
-                0x8f, 0xad, 0xce, 0xe5, 0xc7, 0x00, 0x00, 0x00, 0x00, 0x00,
-                0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                0x00, 0x00, 0x00, 0x99, 0x16};
-            // Checksum
-            uint8_t checksum = 0;
-            for (uint8_t i = 4; i < sizeof(request_message)-2; i++)
-                checksum += request_message[i];
-            request_message[sizeof(request_message)-2] = checksum;
-            
-            ESP_LOGV(TAG, "M-Bus write: %s", format_hex_pretty(request_message, sizeof(request_message)).c_str());
-            this->write_array(request_message, sizeof(request_message));
-            this->last_transmission_ = now;
-            this->last_send_tx_offset_ = sizeof(request_message) * 11 * 1000 / 2400;
-            this->receiving_ = 1;
-            this->init_state_ = 0x04;
+#ifdef USE_SENSOSTAR_AGGREGATES
+bool SensoStarComponent::aggregate_keys_(uint32_t keys[AGGREGATE_PERIOD_COUNT], uint32_t &timestamp) const {
+#ifdef USE_TIME
+    if (this->time_ != nullptr) {
+        ESPTime time = this->time_->now();
+        if (time.is_valid()) {
+            // Local time, so the days and months end at midnight
+            const uint32_t day = time.year * 366u + time.day_of_year;
+            keys[PERIOD_HOUR] = day * 24 + time.hour;
+            keys[PERIOD_DAY] = day;
+            keys[PERIOD_MONTH] = time.year * 12u + time.month;
+            timestamp = time.timestamp;
+            return true;
         }
-        else if (this->init_state_ == 0x14 || this->init_state_ == 0x05){
-            uint8_t request_message[] = { 0x68, 0x09, 0x09, 0x68, 0x53, 0xFE, 0x51, 0x0F, 0x00, 0x00, 0x00, 0x59, 0x0C, 0x16, 0x16};
-            ESP_LOGV(TAG, "M-Bus write: %s", format_hex_pretty(request_message, sizeof(request_message)).c_str());
-            this->write_array(request_message, sizeof(request_message));
-            this->last_transmission_ = now;
-            this->last_send_tx_offset_ = sizeof(request_message) * 11 * 1000 / 2400;
-            this->receiving_ = 1;
-            this->init_state_ = 0x05;
-        }
-        else if (this->init_state_ == 0x15){
-            this->init_state_ = 0xff;
-        }
-        else {
-            uint8_t request_message[] = { 0x68, 0x11, 0x11, 0x68, 0x53, 0xFE, 0x51, 0x0F, 0x00, 0x00, 0x01, 0x59, 0x02, 0x03, 0x04, 0x06, 0x05, 0x07, 0x08, 0x09, 0x0B, 0x00, 0x16 };
-        
-
-            // FCB bit
-            if (this->FCB_)
-                request_message[4] |= 0x10;
-            this->FCB_ = !this->FCB_;
-
-            // Checksum
-            uint8_t checksum = 0;
-            for (uint8_t i = 4; i < sizeof(request_message)-2; i++)
-                checksum += request_message[i];
-            request_message[sizeof(request_message)-2] = checksum;
+    }
+#endif
+    return false;
+}
+#endif
 
-            ESP_LOGV(TAG, "M-Bus write: %s", format_hex_pretty(request_message, sizeof(request_message)).c_str());
-            this->write_array(request_message, sizeof(request_message));
-            this->last_transmission_ = now;
-            this->last_send_tx_offset_ = sizeof(request_message) * 11 * 1000 / 2400;
-            this->receiving_ = 1;
-        }
+#ifdef USE_SENSOSTAR_STATS
+void SensoStarComponent::publish_stats_(uint32_t now) {
+    BusStats &stats = this->master_.get_stats();
+    stats.dump(TAG);
+#ifdef USE_SENSOR
+    uint32_t frames = stats.get(COUNTER_FRAMES);
+    if (this->frames_per_minute_sensor_ && this->stats_time_ != 0 && now != this->stats_time_)
+        this->frames_per_minute_sensor_->publish_state((frames - this->stats_frames_) * 60000.0f / (uint32_t) (now - this->stats_time_));
+    this->stats_frames_ = frames;
+    this->stats_time_ = now;
+
+    if (this->checksum_errors_sensor_)
+        this->checksum_errors_sensor_->publish_state(stats.get(COUNTER_ERROR_CHECKSUM));
+    if (this->length_errors_sensor_)
+        this->length_errors_sensor_->publish_state(stats.get(COUNTER_ERROR_LENGTH));
+    if (this->framing_errors_sensor_)
+        this->framing_errors_sensor_->publish_state(stats.get(COUNTER_ERROR_START) + stats.get(COUNTER_ERROR_STOP));
+    if (this->unknown_frames_sensor_)
+        this->unknown_frames_sensor_->publish_state(stats.get(COUNTER_UNKNOWN_FRAMES));
+    if (this->timeouts_sensor_)
+        this->timeouts_sensor_->publish_state(stats.get(COUNTER_TIMEOUTS));
+    if (this->retries_sensor_)
+        this->retries_sensor_->publish_state(stats.get(COUNTER_RETRIES));
+
+    // Longest time per stage since the last update
+    uint32_t receive_time = stats.take_max(STAGE_RECEIVE);
+    uint32_t decode_time = stats.take_max(STAGE_DECODE);
+    uint32_t publish_time = stats.take_max(STAGE_PUBLISH);
+    if (this->receive_time_sensor_)
+        this->receive_time_sensor_->publish_state(receive_time);
+    if (this->decode_time_sensor_)
+        this->decode_time_sensor_->publish_state(decode_time);
+    if (this->publish_time_sensor_)
+        this->publish_time_sensor_->publish_state(publish_time);
+#endif
+}
+#endif
 
-    }
+#ifdef USE_SENSOSTAR_GATEWAY
+bool SensoStarComponent::on_bus_free(uint32_t now) {
+    if (!this->gateway_request_)
+        return false;
+    const uint16_t address = this->gateway_.request_address();
+    ESP_LOGD(TAG, "Gateway: request to 0x%02X after %u ms waiting for the bus", (unsigned) address, (unsigned) (now - this->gateway_ready_));
+    this->master_.send_external(this->gateway_.request(), this->gateway_.request_size(), address, now);
+    this->gateway_.request_sent();
+    this->gateway_request_ = false;
+    this->gateway_ready_ = 0;
+    return true;
 }
+#endif
 
 float SensoStarComponent::get_setup_priority() const { return setup_priority::DATA; }
 
 
 }  // namespace sensostar
 }  // namespace esphome
-
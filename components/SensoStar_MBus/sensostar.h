@@ -2,42 +2,84 @@
 
 #include "esphome/core/component.h"
 #include "esphome/core/defines.h"
-#ifdef USE_SENSOR
-#include "esphome/components/sensor/sensor.h"
-#endif
-#ifdef USE_TEXT_SENSOR
-#include "esphome/components/text_sensor/text_sensor.h"
-#endif
+#include "esphome/core/preferences.h"
 #include "esphome/components/uart/uart.h"
 #include "esphome/components/output/binary_output.h" // LED related
 
+#include "bus_master.h"
+#include "sensostar_meter.h"
+#include "mbus_gateway.h"
+#ifdef USE_SENSOSTAR_HISTORY
+#include "history_export.h"
+#endif
+#ifdef USE_TIME
+#include "esphome/components/time/real_time_clock.h"
+#endif
+
 #include <vector>
 
 namespace esphome {
 namespace sensostar {
 
-class SensoStarComponent : public PollingComponent, public uart::UARTDevice {
+// Meters remembered from the last secondary address scan
+static const uint8_t MBUS_MAX_SCAN_RESULTS = 16;
+
+// Secondary address scan results kept in flash
+struct ScanStore {
+  uint8_t count;
+  uint32_t ids[MBUS_MAX_SCAN_RESULTS];
+};
+
+// Runs the BusMaster on the ESPHome UART and publishes what it reads
+class SensoStarComponent : public PollingComponent,
+                           public uart::UARTDevice,
+                           public BusUart,
+                           public BusClock,
+                           public BusListener {
  public:
   SensoStarComponent() = default;
 
-#ifdef USE_SENSOR
-  SUB_SENSOR(energy)
-  SUB_SENSOR(volume)
-  SUB_SENSOR(power)
-  SUB_SENSOR(flow)
-  SUB_SENSOR(temperature_flow)
-  SUB_SENSOR(temperature_return)
-  SUB_SENSOR(temperature_diff)
-  SUB_SENSOR(calculated_power)
-  SUB_SENSOR(calculated_energy_deice)
+#if defined(USE_SENSOSTAR_STATS) && defined(USE_SENSOR)
+  SUB_SENSOR(frames_per_minute)
+  SUB_SENSOR(checksum_errors)
+  SUB_SENSOR(length_errors)
+  SUB_SENSOR(framing_errors)
+  SUB_SENSOR(unknown_frames)
+  SUB_SENSOR(timeouts)
+  SUB_SENSOR(retries)
+  SUB_SENSOR(receive_time)
+  SUB_SENSOR(decode_time)
+  SUB_SENSOR(publish_time)
+#endif
+
+  void set_data_led(output::BinaryOutput *data_led) { this->data_led_ = data_led; } // flash LED
+  void add_meter(SensoStarMeter *meter) {
+    this->meters_.push_back(meter);
+    this->master_.add_meter(meter);
+  }
+  // Poll pending meters by priority instead of round-robin
+  void set_priority_scheduling(bool priority_scheduling) { this->master_.set_priority_scheduling(priority_scheduling); }
+  // Baud rate negotiated with the meters after their init sequence
+  void set_baud_rate(uint32_t baud_rate) { this->master_.set_baud_rate(baud_rate); }
+#ifdef USE_TIME
+  // Timestamps for the history, uptime is used while the clock is not valid
+  void set_time(time::RealTimeClock *time) { this->time_ = time; }
+#endif
+#ifdef USE_SENSOSTAR_HISTORY_EXPORT
+  void set_history_export(web_server_base::WebServerBase *base, const char *path) {
+    this->web_server_base_ = base;
+    this->history_path_ = path;
+  }
 #endif
 
-#ifdef USE_TEXT_SENSOR
-  SUB_TEXT_SENSOR(status)
+#ifdef USE_SENSOSTAR_GATEWAY
+  // TCP port of the raw M-Bus gateway
+  void set_gateway_port(uint16_t port) { this->gateway_port_ = port; }
 #endif
 
-  void set_data_led(output::BinaryOutput *data_led) { this->data_led_ = data_led; } // flash LED 
-  
+  // Search the bus for meters with wildcard secondary addresses again
+  void rescan() { this->master_.rescan(); }
+
   void setup() override;
   void dump_config() override;
   void update() override;
@@ -45,21 +87,62 @@ class SensoStarComponent : public PollingComponent, public uart::UARTDevice {
 
   float get_setup_priority() const override;
 
+  // BusUart and BusClock
+  size_t bus_available() override { return this->available(); }
+  bool bus_read(uint8_t *data, size_t len) override { return this->read_array(data, len); }
+  void bus_write(const uint8_t *data, size_t len) override { this->write_array(data, len); }
+  void bus_set_baud_rate(uint32_t baud_rate) override;
+  uint32_t bus_millis() override { return millis(); }
+  uint32_t bus_micros() override { return micros(); }
+
+  // BusListener
+  void on_readout(BusMeter *meter, const mbus::RspUdDecoder &decoder, uint32_t now) override;
+  void on_unavailable(BusMeter *meter) override { static_cast<SensoStarMeter *>(meter)->publish_nans(); }
+  void on_init(BusMeter *meter, uint32_t fingerprint) override;
+  void on_scan_done(const std::vector<uint32_t> &ids) override;
+  void schedule(uint32_t now) override;
+#ifdef USE_SENSOSTAR_GATEWAY
+  bool on_bus_free(uint32_t now) override;
+  void on_external_data(const uint8_t *data, size_t len) override { this->gateway_.forward(data, len); }
+#endif
+
  protected:
-  void publish_nans_();
   void flash_data_led_(); // function for flashing the LED on updated values
-    
-  std::vector<uint8_t> data_;
-  uint32_t last_transmission_{0};
-  uint32_t last_energy_calc_{0};
-  float energy_calc_{0};
-  float energy_deice_calc_{0};
-  uint32_t last_energy_deice_calc_{0};
-  uint16_t last_send_tx_offset_{0};
-  uint8_t receiving_{0};
-  uint8_t init_state_{0};
-  bool trigger_next_{true};
-  bool FCB_;
+#ifdef USE_SENSOSTAR_HISTORY
+  uint32_t history_time_(uint8_t &flags) const;
+#endif
+#ifdef USE_SENSOSTAR_STATS
+  void publish_stats_(uint32_t now);
+#endif
+#ifdef USE_SENSOSTAR_AGGREGATES
+  // Local hour, day and month for the aggregates, false while the clock is not valid
+  bool aggregate_keys_(uint32_t keys[AGGREGATE_PERIOD_COUNT], uint32_t &timestamp) const;
+#endif
+
+  std::vector<SensoStarMeter *> meters_;
+  BusMaster master_{this, this, this};
+  ESPPreferenceObject scan_pref_;
+
+#ifdef USE_SENSOSTAR_STATS
+  uint32_t stats_frames_{0}; // frame count at the last publish_stats_()
+  uint32_t stats_time_{0};
+#endif
+
+#ifdef USE_SENSOSTAR_GATEWAY
+  MBusGateway gateway_;
+  uint16_t gateway_port_{10001};
+  bool gateway_started_{false};     // listening, waits for the network
+  bool gateway_request_{false};     // client request complete, waiting for the bus
+  uint32_t gateway_ready_{0};
+#endif
+
+#ifdef USE_TIME
+  time::RealTimeClock *time_{nullptr};
+#endif
+#ifdef USE_SENSOSTAR_HISTORY_EXPORT
+  web_server_base::WebServerBase *web_server_base_{nullptr};
+  const char *history_path_{nullptr};
+#endif
 
   output::BinaryOutput *data_led_{nullptr}; // LED related
   uint32_t data_led_off_time_{0}; // LED related
@@ -67,4 +150,3 @@ class SensoStarComponent : public PollingComponent, public uart::UARTDevice {
 
 }  // namespace sensostar
 }  // namespace esphome
-
@@ -0,0 +1,401 @@
+#include "sensostar_meter.h"
+#include "esphome/core/log.h"
+#include "esphome/core/helpers.h"
+
+#include <cstdio>
+
+namespace esphome {
+namespace sensostar {
+
+static const char *const TAG = "SensoStar";
+
+void SensoStarMeter::dump_config() {
+    ESP_LOGCONFIG(TAG, "  Meter %s:", this->name_());
+    ESP_LOGCONFIG(TAG, "    Priority: %u", this->priority_);
+    if (this->selective_)
+        ESP_LOGCONFIG(TAG, "    Selective readout: 0x%04X", this->readout_mask_());
+    if (this->adaptive_)
+        ESP_LOGCONFIG(TAG, "    Adaptive polling");
+    if (this->secondary_ && mbus::id_has_wildcard(this->secondary_id_)) {
+        if (this->resolved_)
+            ESP_LOGCONFIG(TAG, "    Found by scan: ID %08X", (unsigned) this->resolved_id_);
+        else
+            ESP_LOGCONFIG(TAG, "    Found by scan: not yet");
+    }
+#ifdef USE_SENSOR
+    LOG_SENSOR("    ", "Energy", this->energy_sensor_);
+    LOG_SENSOR("    ", "Volume", this->volume_sensor_);
+    LOG_SENSOR("    ", "Power", this->power_sensor_);
+    LOG_SENSOR("    ", "Flow", this->flow_sensor_);
+    LOG_SENSOR("    ", "Flow Temperature", this->temperature_flow_sensor_);
+    LOG_SENSOR("    ", "Return Temperature", this->temperature_return_sensor_);
+    LOG_SENSOR("    ", "Temperature Difference", this->temperature_diff_sensor_);
+    LOG_SENSOR("    ", "Calculated Power", this->calculated_power_sensor_);
+    LOG_SENSOR("    ", "Calculated Energy Deice", this->calculated_energy_deice_sensor_);
+    LOG_SENSOR("    ", "Response Time", this->response_time_sensor_);
+    LOG_SENSOR("    ", "Response Time P95", this->response_time_p95_sensor_);
+    LOG_SENSOR("    ", "Suppressed Publishes", this->suppressed_publishes_sensor_);
+    LOG_SENSOR("    ", "Time To First Reading", this->time_to_first_reading_sensor_);
+    LOG_SENSOR("    ", "Effective Interval", this->effective_interval_sensor_);
+    LOG_SENSOR("    ", "Daily Polls", this->daily_polls_sensor_);
+    for (size_t i = 0; i < this->record_filters_.size(); i++) {
+        const mbus::RecordFilter &filter = this->record_filters_[i];
+        ESP_LOGCONFIG(TAG, "    Record VIF 0x%02X, function %u, storage %u, tariff %u, subunit %u:", filter.vif,
+                      filter.function, (unsigned) filter.storage, filter.tariff, filter.subunit);
+        LOG_SENSOR("      ", "Record", this->record_sensors_[i]);
+    }
+#endif
+#ifdef USE_SENSOSTAR_AGGREGATES
+    for (auto &entry : this->aggregate_sensors_)
+        LOG_SENSOR("    ", "Aggregate", entry.sensor);
+#endif
+#ifdef USE_TEXT_SENSOR
+    LOG_TEXT_SENSOR("    ", "Status", this->status_text_sensor_);
+#endif
+#ifdef USE_BINARY_SENSOR
+    LOG_BINARY_SENSOR("    ", "Temperature Sensor 1 Cable Break", this->temperature_sensor_1_cable_break_binary_sensor_);
+    LOG_BINARY_SENSOR("    ", "Temperature Sensor 1 Short Circuit", this->temperature_sensor_1_short_circuit_binary_sensor_);
+    LOG_BINARY_SENSOR("    ", "Temperature Sensor 2 Cable Break", this->temperature_sensor_2_cable_break_binary_sensor_);
+    LOG_BINARY_SENSOR("    ", "Temperature Sensor 2 Short Circuit", this->temperature_sensor_2_short_circuit_binary_sensor_);
+    LOG_BINARY_SENSOR("    ", "Flow Measurement Error", this->flow_measurement_error_binary_sensor_);
+    LOG_BINARY_SENSOR("    ", "Electronic Defect", this->electronic_defect_binary_sensor_);
+    LOG_BINARY_SENSOR("    ", "Reset", this->reset_binary_sensor_);
+    LOG_BINARY_SENSOR("    ", "Low Battery", this->low_battery_binary_sensor_);
+#endif
+}
+
+void SensoStarMeter::publish_nans(){
+    this->poll_.reset();
+    this->energy_calc_.restart();
+    this->last_flags_ = FLAGS_UNKNOWN;
+#ifdef USE_SENSOR
+    // Always published, the next valid value then passes every filter
+    this->staged_mask_ = 0;
+    for (auto &policy : this->policies_)
+        policy.reset();
+    for (auto *sensor : this->record_sensors_)
+        sensor->publish_state(NAN);
+#endif
+#ifdef USE_TEXT_SENSOR
+    if (this->status_text_sensor_)
+        this->status_text_sensor_->publish_state("No readout from heat meter");
+#endif
+#ifdef USE_SENSOR
+    if (this->energy_sensor_)
+        this->energy_sensor_->publish_state(NAN);
+    if (this->volume_sensor_)
+        this->volume_sensor_->publish_state(NAN);
+    if (this->power_sensor_)
+        this->power_sensor_->publish_state(NAN);
+    if (this->flow_sensor_)
+        this->flow_sensor_->publish_state(NAN);
+    if (this->temperature_flow_sensor_)
+        this->temperature_flow_sensor_->publish_state(NAN);
+    if (this->temperature_return_sensor_)
+        this->temperature_return_sensor_->publish_state(NAN);
+    if (this->temperature_diff_sensor_)
+        this->temperature_diff_sensor_->publish_state(NAN);
+    if (this->calculated_power_sensor_)
+        this->calculated_power_sensor_->publish_state(NAN);
+    if (this->calculated_energy_deice_sensor_)
+        this->calculated_energy_deice_sensor_->publish_state(NAN);
+#endif
+}
+
+void SensoStarMeter::publish_readout(const mbus::Readout &readout, uint32_t now) {
+    // Store values for calculated_power
+    double flow = readout.has(mbus::Quantity::VOLUME_FLOW) ? readout.get(mbus::Quantity::VOLUME_FLOW) : -127;
+    double tdiff = readout.has(mbus::Quantity::TEMPERATURE_DIFF) ? readout.get(mbus::Quantity::TEMPERATURE_DIFF) : -127;
+    // Store values for energy calculation
+    float power = readout.has(mbus::Quantity::POWER) ? readout.get(mbus::Quantity::POWER) : -127;
+    float energy = readout.has(mbus::Quantity::ENERGY) ? readout.get(mbus::Quantity::ENERGY) : -127;
+    if (this->adaptive_) {
+        const float inputs[ADAPTIVE_INPUT_COUNT] = {
+            readout.has(mbus::Quantity::VOLUME_FLOW) ? (float) flow : NAN,
+            readout.has(mbus::Quantity::POWER) ? power : NAN,
+            readout.has(mbus::Quantity::TEMPERATURE_DIFF) ? (float) tdiff : NAN,
+        };
+        this->poll_.update(inputs, now);
+        // A transient brings the next poll forward
+        const uint32_t next = this->last_poll_ + this->poll_.interval(now);
+        if ((int32_t) (next - this->next_poll_) < 0)
+            this->next_poll_ = next;
+    }
+#ifdef USE_SENSOR
+    if (readout.has(mbus::Quantity::ENERGY) && this->energy_sensor_ && this->energy_sensor_->get_accuracy_decimals() == 0)
+        this->stage_(SENSOR_ENERGY, energy);
+    if (readout.has(mbus::Quantity::VOLUME) && this->volume_sensor_)
+        this->stage_(SENSOR_VOLUME, readout.get(mbus::Quantity::VOLUME));
+    if (readout.has(mbus::Quantity::POWER) && this->power_sensor_)
+        this->stage_(SENSOR_POWER, power);
+    if (readout.has(mbus::Quantity::VOLUME_FLOW) && this->flow_sensor_)
+        this->stage_(SENSOR_FLOW, flow);
+    if (readout.has(mbus::Quantity::TEMPERATURE_FLOW) && this->temperature_flow_sensor_)
+        this->stage_(SENSOR_TEMPERATURE_FLOW, readout.get(mbus::Quantity::TEMPERATURE_FLOW));
+    if (readout.has(mbus::Quantity::TEMPERATURE_RETURN) && this->temperature_return_sensor_)
+        this->stage_(SENSOR_TEMPERATURE_RETURN, readout.get(mbus::Quantity::TEMPERATURE_RETURN));
+    if (readout.has(mbus::Quantity::TEMPERATURE_DIFF) && this->temperature_diff_sensor_)
+        this->stage_(SENSOR_TEMPERATURE_DIFF, tdiff);
+    for (size_t i = 0; i < this->record_sensors_.size(); i++) {
+        if (readout.records_present & (1 << i))
+            this->record_sensors_[i]->publish_state(readout.records[i] * this->record_multipliers_[i]);
+    }
+#endif
+    // Flag texts and binary sensors only change with the flags
+    if (readout.has(mbus::Quantity::ERROR_FLAGS)) {
+        const uint8_t flags = (uint32_t) readout.get(mbus::Quantity::ERROR_FLAGS) & 0xFF;
+        if (flags != this->last_flags_) {
+#ifdef USE_TEXT_SENSOR
+            if (this->status_text_sensor_)
+                this->status_text_sensor_->publish_state(this->status_text_.get(flags));
+#endif
+#ifdef USE_BINARY_SENSOR
+            for (uint8_t i = 0; i < STATUS_FLAG_COUNT; i++) {
+                binary_sensor::BinarySensor *flag = this->get_flag_binary_sensor_(i);
+                if (flag)
+                    flag->publish_state(flags & (1 << i));
+            }
+#endif
+            this->last_flags_ = flags;
+        }
+    }
+#ifdef USE_SENSOR
+    if (this->energy_sensor_ && this->energy_sensor_->get_accuracy_decimals() > 0 && energy > 0){
+        const double value = this->energy_calc_.update(energy, power, now);
+        if (!std::isnan(value))
+            this->stage_(SENSOR_ENERGY, value);
+    }
+
+    // Water properties at the measured temperatures; the volume is measured in the return pipe
+    float t_return = readout.has(mbus::Quantity::TEMPERATURE_RETURN) ? readout.get(mbus::Quantity::TEMPERATURE_RETURN) : WATER_DEFAULT_TEMPERATURE;
+    float t_flow = readout.has(mbus::Quantity::TEMPERATURE_FLOW) ? readout.get(mbus::Quantity::TEMPERATURE_FLOW) : t_return;
+    float t_mean = (t_flow + t_return) / 2;
+
+    if (this->calculated_power_sensor_) {
+        if (tdiff == -127 || flow == -127)
+            this->stage_(SENSOR_CALCULATED_POWER, NAN);
+        else if (flow > 0)
+            this->stage_(SENSOR_CALCULATED_POWER, thermal_power(flow, tdiff, t_return, t_mean));
+        else
+            this->stage_(SENSOR_CALCULATED_POWER, 0);
+    }
+
+    if (calculated_energy_deice_sensor_) {
+        if (flow > 0 && tdiff < 0 && tdiff != -127) {
+            this->energy_deice_calc_.add(-thermal_power(flow, tdiff, t_return, t_mean), now);
+            this->stage_(SENSOR_CALCULATED_ENERGY_DEICE, this->energy_deice_calc_.value());
+        }
+        else
+            this->energy_deice_calc_.add(0, now);
+    }
+#endif
+}
+
+void SensoStarMeter::publish_latency() {
+#ifdef USE_SENSOR
+    const LatencyStats &stats = this->latency_[REQUEST_READOUT];
+    if (stats.count() == 0)
+        return;
+    if (this->response_time_sensor_)
+        this->stage_(SENSOR_RESPONSE_TIME, stats.p50());
+    if (this->response_time_p95_sensor_)
+        this->stage_(SENSOR_RESPONSE_TIME_P95, stats.p95());
+#endif
+}
+
+#ifdef USE_SENSOSTAR_HISTORY
+void SensoStarMeter::setup_history() {
+    if (this->history_blocks_ == 0 || !this->history_.init(this->history_blocks_))
+        return;
+    if (this->history_flash_blocks_)
+        this->history_.setup_persistence(fnv1_hash(std::string("sensostar_history_") + this->name_()),
+                                         this->history_flash_blocks_);
+}
+
+void SensoStarMeter::record_history(const mbus::Readout &readout, uint32_t time, uint8_t flags, uint32_t now) {
+    static const mbus::Quantity QUANTITIES[HISTORY_FIELD_COUNT] = {
+        mbus::Quantity::ENERGY, mbus::Quantity::VOLUME, mbus::Quantity::TEMPERATURE_FLOW,
+        mbus::Quantity::TEMPERATURE_RETURN, mbus::Quantity::POWER, mbus::Quantity::VOLUME_FLOW,
+    };
+    if (this->history_.capacity() == 0)
+        return;
+
+    HistoryRecord record{};
+    record.time = time;
+    for (uint8_t i = 0; i < HISTORY_FIELD_COUNT; i++) {
+        if (readout.has(QUANTITIES[i])) {
+            record.values[i] = (int32_t) lround(readout.get(QUANTITIES[i]) * HISTORY_FIELD_SCALE[i]);
+            record.present |= 1 << i;
+        }
+    }
+    this->history_.add(record, flags, now);
+}
+#endif
+
+void SensoStarMeter::schedule_(uint32_t now) {
+    if (!this->adaptive_ || (int32_t) (now - this->next_poll_) < 0)
+        return;
+    // Still waiting for the previous readout, e.g. backing off: do not spend the budget twice
+    if (!this->pending_) {
+        this->pending_ = true;
+        this->poll_.spend(now);
+        if ((uint32_t) (now - this->poll_day_start_) >= ADAPTIVE_DAY) {
+            this->poll_day_start_ = now;
+            this->daily_polls_ = 0;
+        }
+        this->daily_polls_++;
+    }
+    const uint32_t interval = this->poll_.interval(now);
+    this->last_poll_ = now;
+    this->next_poll_ = now + interval;
+#ifdef USE_SENSOR
+    if (this->effective_interval_sensor_ && this->effective_interval_sensor_->get_raw_state() != interval / 1000.0f)
+        this->effective_interval_sensor_->publish_state(interval / 1000.0f);
+    if (this->daily_polls_sensor_)
+        this->daily_polls_sensor_->publish_state(this->daily_polls_);
+#endif
+}
+
+#ifdef USE_SENSOSTAR_AGGREGATES
+void SensoStarMeter::setup_aggregates() {
+    for (uint8_t p = 0; p < AGGREGATE_PERIOD_COUNT; p++) {
+        if ((this->aggregate_periods_ & (1 << p)) == 0)
+            continue;
+        char key[40];
+        snprintf(key, sizeof(key), "sensostar_aggregate_%s_%u", this->name_(), p);
+        this->aggregate_prefs_[p] = global_preferences->make_preference<PeriodAggregate>(fnv1_hash(key), true);
+        // A period that ended while the device was off is published with the first readout
+        if (!this->aggregate_prefs_[p].load(&this->aggregates_[p]))
+            this->aggregates_[p].start(0);
+    }
+}
+
+void SensoStarMeter::aggregate(const mbus::Readout &readout, const uint32_t keys[AGGREGATE_PERIOD_COUNT], uint32_t time,
+                               uint32_t now) {
+    AggregateSample sample;
+    sample.energy = readout.has(mbus::Quantity::ENERGY) ? readout.get(mbus::Quantity::ENERGY) : NAN;
+    sample.volume = readout.has(mbus::Quantity::VOLUME) ? readout.get(mbus::Quantity::VOLUME) : NAN;
+    sample.flow = readout.has(mbus::Quantity::VOLUME_FLOW) ? readout.get(mbus::Quantity::VOLUME_FLOW) : NAN;
+    sample.temperature_flow = readout.has(mbus::Quantity::TEMPERATURE_FLOW) ? readout.get(mbus::Quantity::TEMPERATURE_FLOW) : NAN;
+    sample.temperature_return = readout.has(mbus::Quantity::TEMPERATURE_RETURN) ? readout.get(mbus::Quantity::TEMPERATURE_RETURN) : NAN;
+
+    bool save = (uint32_t) (now - this->aggregates_saved_) >= AGGREGATE_SAVE_INTERVAL;
+    for (uint8_t p = 0; p < AGGREGATE_PERIOD_COUNT; p++) {
+        if ((this->aggregate_periods_ & (1 << p)) == 0)
+            continue;
+        PeriodAggregate &aggregate = this->aggregates_[p];
+        if (aggregate.key == 0) {
+            aggregate.start(keys[p]);
+        }
+        else if (aggregate.key != keys[p]) {
+            for (auto &entry : this->aggregate_sensors_) {
+                if (entry.period == p)
+                    entry.sensor->publish_state(aggregate.value(entry.value));
+            }
+            aggregate.roll(keys[p]);
+            save = true;
+        }
+        aggregate.add(sample, time);
+    }
+    if (save) {
+        for (uint8_t p = 0; p < AGGREGATE_PERIOD_COUNT; p++) {
+            if (this->aggregate_periods_ & (1 << p))
+                this->aggregate_prefs_[p].save(&this->aggregates_[p]);
+        }
+        this->aggregates_saved_ = now;
+    }
+}
+#endif
+
+void SensoStarMeter::commit_states(uint32_t now) {
+#ifdef USE_SENSOR
+    uint16_t due = 0;
+    for (uint8_t i = 0; i < METER_SENSOR_COUNT; i++) {
+        if ((this->staged_mask_ & (1 << i)) && this->policies_[i].is_due(this->staged_[i], now))
+            due |= 1 << i;
+    }
+
+    uint8_t published = 0, suppressed = 0;
+    for (uint8_t i = 0; i < METER_SENSOR_COUNT; i++) {
+        if ((this->staged_mask_ & (1 << i)) == 0)
+            continue;
+        // Batched values go out with the rest of the frame as soon as any value of it is due
+        if ((due & (1 << i)) || (due && this->policies_[i].is_batch())) {
+            this->get_sensor_((MeterSensor) i)->publish_state(this->staged_[i]);
+            this->policies_[i].published(this->staged_[i], now);
+            published++;
+        }
+        else
+            suppressed++;
+    }
+    this->staged_mask_ = 0;
+    this->suppressed_ += suppressed;
+    ESP_LOGV(TAG, "Meter %s: %u values published, %u suppressed", this->name_(), published, suppressed);
+
+    if (this->suppressed_publishes_sensor_ && this->suppressed_ != this->suppressed_published_
+            && (uint32_t)(now - this->last_suppressed_publish_) >= SUPPRESSED_PUBLISH_INTERVAL) {
+        this->suppressed_publishes_sensor_->publish_state(this->suppressed_);
+        this->suppressed_published_ = this->suppressed_;
+        this->last_suppressed_publish_ = now;
+    }
+#endif
+}
+
+#ifdef USE_SENSOR
+void SensoStarMeter::add_record_sensor(sensor::Sensor *sensor, uint8_t vif, uint16_t vife, uint8_t function,
+                                       uint32_t storage, uint8_t tariff, uint16_t subunit, float multiplier) {
+    if (this->record_filters_.size() >= mbus::MAX_RECORD_FILTERS) {
+        ESP_LOGE(TAG, "Meter %s: more than %u record sensors", this->name_(), mbus::MAX_RECORD_FILTERS);
+        return;
+    }
+    this->record_filters_.push_back({vif, vife, function, storage, tariff, subunit});
+    this->record_sensors_.push_back(sensor);
+    this->record_multipliers_.push_back(multiplier);
+}
+
+#endif
+
+#ifdef USE_BINARY_SENSOR
+binary_sensor::BinarySensor *SensoStarMeter::get_flag_binary_sensor_(uint8_t bit) const {
+    switch (bit) {
+        case 0: return this->temperature_sensor_1_cable_break_binary_sensor_;
+        case 1: return this->temperature_sensor_1_short_circuit_binary_sensor_;
+        case 2: return this->temperature_sensor_2_cable_break_binary_sensor_;
+        case 3: return this->temperature_sensor_2_short_circuit_binary_sensor_;
+        case 4: return this->flow_measurement_error_binary_sensor_;
+        case 5: return this->electronic_defect_binary_sensor_;
+        case 6: return this->reset_binary_sensor_;
+        case 7: return this->low_battery_binary_sensor_;
+        default: return nullptr;
+    }
+}
+#endif
+
+#ifdef USE_SENSOR
+sensor::Sensor *SensoStarMeter::get_sensor_(MeterSensor sensor) const {
+    switch (sensor) {
+        case SENSOR_ENERGY: return this->energy_sensor_;
+        case SENSOR_VOLUME: return this->volume_sensor_;
+        case SENSOR_POWER: return this->power_sensor_;
+        case SENSOR_FLOW: return this->flow_sensor_;
+        case SENSOR_TEMPERATURE_FLOW: return this->temperature_flow_sensor_;
+        case SENSOR_TEMPERATURE_RETURN: return this->temperature_return_sensor_;
+        case SENSOR_TEMPERATURE_DIFF: return this->temperature_diff_sensor_;
+        case SENSOR_CALCULATED_POWER: return this->calculated_power_sensor_;
+        case SENSOR_CALCULATED_ENERGY_DEICE: return this->calculated_energy_deice_sensor_;
+        case SENSOR_RESPONSE_TIME: return this->response_time_sensor_;
+        case SENSOR_RESPONSE_TIME_P95: return this->response_time_p95_sensor_;
+        default: return nullptr;
+    }
+}
+
+void SensoStarMeter::stage_(MeterSensor sensor, float value) {
+    if (this->get_sensor_(sensor) == nullptr)
+        return;
+    this->staged_[sensor] = value;
+    this->staged_mask_ |= 1 << sensor;
+}
+#endif
+
+}  // namespace sensostar
+}  // namespace esphome
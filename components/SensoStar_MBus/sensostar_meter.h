@@ -0,0 +1,217 @@
+#pragma once
+
+#include "esphome/core/component.h"
+#include "esphome/core/defines.h"
+#include "esphome/core/preferences.h"
+
+#include <vector>
+
+#ifdef USE_SENSOR
+#include "esphome/components/sensor/sensor.h"
+#endif
+#ifdef USE_TEXT_SENSOR
+#include "esphome/components/text_sensor/text_sensor.h"
+#endif
+#ifdef USE_BINARY_SENSOR
+#include "esphome/components/binary_sensor/binary_sensor.h"
+#endif
+
+#include "mbus_decoder.h"
+#include "bus_master.h"
+#include "publish_policy.h"
+#include "energy_integrator.h"
+#include "adaptive_poll.h"
+#include "status_flags.h"
+#ifdef USE_SENSOSTAR_HISTORY
+#include "history.h"
+#endif
+#ifdef USE_SENSOSTAR_AGGREGATES
+#include "aggregates.h"
+#endif
+
+namespace esphome {
+namespace sensostar {
+
+class SensoStarComponent;
+
+// Sensors with a publish policy, names match the keys in sensor.py
+enum MeterSensor : uint8_t {
+  SENSOR_ENERGY = 0,
+  SENSOR_VOLUME,
+  SENSOR_POWER,
+  SENSOR_FLOW,
+  SENSOR_TEMPERATURE_FLOW,
+  SENSOR_TEMPERATURE_RETURN,
+  SENSOR_TEMPERATURE_DIFF,
+  SENSOR_CALCULATED_POWER,
+  SENSOR_CALCULATED_ENERGY_DEICE,
+  SENSOR_RESPONSE_TIME,
+  SENSOR_RESPONSE_TIME_P95,
+  METER_SENSOR_COUNT,
+};
+
+// last_flags_ before the first readout and after a failed one
+static const uint16_t FLAGS_UNKNOWN = 0x100;
+
+// Running aggregates are written to flash at this interval and at the end of each period
+static const uint32_t AGGREGATE_SAVE_INTERVAL = 10 * 60 * 1000;
+
+// Minimum interval between updates of the suppressed publishes counter
+static const uint32_t SUPPRESSED_PUBLISH_INTERVAL = 60000;
+
+// One heat meter on the bus, addressed by primary or secondary address
+class SensoStarMeter : public BusMeter {
+ public:
+#ifdef USE_SENSOR
+  SUB_SENSOR(energy)
+  SUB_SENSOR(volume)
+  SUB_SENSOR(power)
+  SUB_SENSOR(flow)
+  SUB_SENSOR(temperature_flow)
+  SUB_SENSOR(temperature_return)
+  SUB_SENSOR(temperature_diff)
+  SUB_SENSOR(calculated_power)
+  SUB_SENSOR(calculated_energy_deice)
+  SUB_SENSOR(response_time)
+  SUB_SENSOR(response_time_p95)
+  SUB_SENSOR(suppressed_publishes)
+  SUB_SENSOR(time_to_first_reading)
+  SUB_SENSOR(effective_interval)
+  SUB_SENSOR(daily_polls)
+#endif
+
+#ifdef USE_TEXT_SENSOR
+  SUB_TEXT_SENSOR(status)
+#endif
+
+#ifdef USE_BINARY_SENSOR
+  // One per bit of the error flags, in the order of STATUS_FLAG_MESSAGES
+  SUB_BINARY_SENSOR(temperature_sensor_1_cable_break)
+  SUB_BINARY_SENSOR(temperature_sensor_1_short_circuit)
+  SUB_BINARY_SENSOR(temperature_sensor_2_cable_break)
+  SUB_BINARY_SENSOR(temperature_sensor_2_short_circuit)
+  SUB_BINARY_SENSOR(flow_measurement_error)
+  SUB_BINARY_SENSOR(electronic_defect)
+  SUB_BINARY_SENSOR(reset)
+  SUB_BINARY_SENSOR(low_battery)
+#endif
+
+  // Poll on its own adaptive schedule instead of every update interval of the hub
+  void set_adaptive_poll(uint32_t min_interval, uint32_t max_interval, float flow_threshold, float power_threshold,
+                         float temperature_diff_threshold, uint32_t daily_budget) {
+    this->adaptive_ = true;
+    this->poll_.set_min_interval(min_interval);
+    this->poll_.set_max_interval(max_interval);
+    this->poll_.set_threshold(ADAPTIVE_FLOW, flow_threshold);
+    this->poll_.set_threshold(ADAPTIVE_POWER, power_threshold);
+    this->poll_.set_threshold(ADAPTIVE_TEMPERATURE_DIFF, temperature_diff_threshold);
+    this->poll_.set_daily_budget(daily_budget);
+  }
+#ifdef USE_SENSOSTAR_HISTORY
+  // History ring of `blocks` x HISTORY_BLOCK_SIZE bytes, the newest `flash_blocks` are kept in flash
+  void set_history(uint16_t blocks, uint8_t flash_blocks) {
+    this->history_blocks_ = blocks;
+    this->history_flash_blocks_ = flash_blocks;
+  }
+  const HistoryBuffer *get_history() const { return this->history_.capacity() ? &this->history_ : nullptr; }
+  void setup_history();
+  void record_history(const mbus::Readout &readout, uint32_t time, uint8_t flags, uint32_t now);
+#endif
+#ifdef USE_SENSOSTAR_AGGREGATES
+  // Published with the aggregate of every completed period
+  void add_aggregate_sensor(sensor::Sensor *sensor, AggregatePeriod period, AggregateValue value) {
+    this->aggregate_sensors_.push_back({sensor, period, value});
+    this->aggregate_periods_ |= 1 << period;
+  }
+  void setup_aggregates();
+  // keys identify the current local hour, day and month, time is the UNIX time
+  void aggregate(const mbus::Readout &readout, const uint32_t keys[AGGREGATE_PERIOD_COUNT], uint32_t time, uint32_t now);
+#endif
+#ifdef USE_SENSOR
+  void set_publish_policy(MeterSensor sensor, bool on_change, float deadband, float deadband_relative,
+                          uint32_t heartbeat, bool batch) {
+    PublishPolicy &policy = this->policies_[sensor];
+    policy.set_on_change(on_change);
+    policy.set_deadband(deadband);
+    policy.set_deadband_relative(deadband_relative);
+    policy.set_heartbeat(heartbeat);
+    policy.set_batch(batch);
+  }
+  // Sensor fed by the data record matching the filter, scaled like the built-in sensors and by the multiplier
+  void add_record_sensor(sensor::Sensor *sensor, uint8_t vif, uint16_t vife, uint8_t function, uint32_t storage,
+                         uint8_t tariff, uint16_t subunit, float multiplier);
+#endif
+
+  void dump_config();
+  void publish_nans();
+  void publish_readout(const mbus::Readout &readout, uint32_t now);
+  void publish_latency();
+  // Publishes the values staged by publish_readout() and publish_latency() according to their policies
+  void commit_states(uint32_t now);
+
+ protected:
+  friend class SensoStarComponent;
+  friend class HistoryCsvWriter;
+
+  // Marks an adaptively polled meter pending once its interval has passed
+  void schedule_(uint32_t now);
+#ifdef USE_SENSOR
+  sensor::Sensor *get_sensor_(MeterSensor sensor) const;
+  void stage_(MeterSensor sensor, float value);
+#endif
+#ifdef USE_BINARY_SENSOR
+  binary_sensor::BinarySensor *get_flag_binary_sensor_(uint8_t bit) const;
+#endif
+
+  ESPPreferenceObject init_pref_; // fingerprint of the init sequence the meter last completed
+  bool first_reading_{true};
+
+  // Adaptive polling
+  AdaptivePoll poll_;
+  uint32_t last_poll_{0};
+  uint32_t next_poll_{0};
+  uint32_t poll_day_start_{0};
+  uint32_t daily_polls_{0};
+
+#ifdef USE_SENSOR
+  PublishPolicy policies_[METER_SENSOR_COUNT];
+  float staged_[METER_SENSOR_COUNT];
+  uint16_t staged_mask_{0}; // values waiting for commit_states()
+  uint32_t suppressed_{0};
+  uint32_t suppressed_published_{0};
+  uint32_t last_suppressed_publish_{0};
+  // Additional records, index i of the filters (BusMeter::record_filters_) feeds the sensor i
+  std::vector<sensor::Sensor *> record_sensors_;
+  std::vector<float> record_multipliers_;
+#endif
+
+  uint16_t last_flags_{FLAGS_UNKNOWN}; // error flags of the last readout
+#ifdef USE_TEXT_SENSOR
+  StatusText status_text_;
+#endif
+
+#ifdef USE_SENSOSTAR_AGGREGATES
+  struct AggregateSensor {
+    sensor::Sensor *sensor;
+    AggregatePeriod period;
+    AggregateValue value;
+  };
+  std::vector<AggregateSensor> aggregate_sensors_;
+  uint8_t aggregate_periods_{0}; // bit per period with sensors
+  PeriodAggregate aggregates_[AGGREGATE_PERIOD_COUNT]{};
+  ESPPreferenceObject aggregate_prefs_[AGGREGATE_PERIOD_COUNT];
+  uint32_t aggregates_saved_{0};
+#endif
+
+#ifdef USE_SENSOSTAR_HISTORY
+  HistoryBuffer history_;
+  uint16_t history_blocks_{0};
+  uint8_t history_flash_blocks_{0};
+#endif
+
+  RegisterInterpolator energy_calc_;
+  EnergyIntegrator energy_deice_calc_;
+};
+
+}  // namespace sensostar
+}  // namespace esphome
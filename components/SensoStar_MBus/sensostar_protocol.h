@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "mbus_decoder.h"
+
+// Requests and bus timing of the SensoStar readout protocol, plain C++ shared with the host simulation in tests/sim
+
+namespace esphome {
+namespace sensostar {
+
+// Power-on baud rate of the meters
+static const uint32_t MBUS_DEFAULT_BAUD_RATE = 2400;
+// Give up on a higher baud rate for a meter after this many failed negotiations
+static const uint8_t MBUS_MAX_BAUD_ATTEMPTS = 2;
+// Idle time on the bus after the last received byte before the next request is sent
+static const uint32_t MBUS_INTERFRAME_DELAY = 20;
+// Response timeout until enough latencies were measured, also the upper bound of the adaptive timeout
+// and the tolerated gap between bytes of a frame
+static const uint32_t MBUS_RESPONSE_TIMEOUT = 500;
+static const uint32_t MBUS_MIN_RESPONSE_TIMEOUT = 50;
+// Added to 1.5 x the 95th percentile latency
+static const uint32_t MBUS_TIMEOUT_MARGIN = 30;
+static const uint8_t MBUS_MIN_LATENCY_SAMPLES = 4;
+// Consecutive timeouts (including retries) before the meter is reported unavailable and backed off
+static const uint8_t MBUS_MAX_RETRIES = 3;
+static const uint32_t MBUS_BACKOFF_MIN = 5000;
+static const uint32_t MBUS_BACKOFF_MAX = 600000;
+
+// Initialization sequence, sent as SND_UD with CI 0x51
+static const uint8_t INIT_PAYLOAD_1[] = { 0x0F, 0x00, 0x00, 0x04, 0x5C };
+static const uint8_t INIT_PAYLOAD_2[] = { 0x0F, 0x00, 0x00, 0x00, 0x59, 0x2D };
+static const uint8_t INIT_PAYLOAD_3[] = { 0x0F, 0x00, 0x00, 0x00, 0x5D };
+// Configuration frame, L = 0x73; the remainder is zero
+static const uint8_t INIT_PAYLOAD_4[0x73 - 3] = { 0x0F, 0x00, 0x00, 0x06, 0x5C, 0x09, 0x02, 0x00, 0x00,
+    0x8f, 0xad, 0xce, 0xe5, 0xc7 };
+static const uint8_t INIT_PAYLOAD_5[] = { 0x0F, 0x00, 0x00, 0x00, 0x59, 0x0C };
+// Readout request with the list of requested items
+static const uint8_t POLL_PAYLOAD[] = { 0x0F, 0x00, 0x00, 0x01, 0x59, 0x02, 0x03, 0x04, 0x06, 0x05, 0x07, 0x08, 0x09, 0x0B };
+static const size_t POLL_HEADER_SIZE = 5;
+
+// Record the meter answers each item of the readout request with. UNVERIFIED: no documentation
+// or bus capture of the SensoStar confirms this assignment, it is inferred from the full request
+// and the order of the records in its answer. Only selective_readout relies on it, and a selective
+// readout missing one of its quantities falls back to the full request.
+struct ReadoutItem {
+  uint8_t item;
+  mbus::Quantity quantity;
+};
+static const ReadoutItem READOUT_ITEMS[] = {
+    { 0x02, mbus::Quantity::ENERGY },
+    { 0x03, mbus::Quantity::VOLUME },
+    { 0x04, mbus::Quantity::POWER },
+    { 0x06, mbus::Quantity::VOLUME_FLOW },
+    { 0x05, mbus::Quantity::TEMPERATURE_FLOW },
+    { 0x07, mbus::Quantity::TEMPERATURE_RETURN },
+    { 0x08, mbus::Quantity::TEMPERATURE_DIFF },
+    { 0x09, mbus::Quantity::NONE }, // not decoded, only in the full request
+    { 0x0B, mbus::Quantity::ERROR_FLAGS },
+};
+
+}  // namespace sensostar
+}  // namespace esphome
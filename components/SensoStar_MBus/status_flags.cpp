@@ -0,0 +1,40 @@
+#include "status_flags.h"
+
+#include <cstring>
+
+namespace esphome {
+namespace sensostar {
+
+const char *StatusText::get(uint8_t flags) {
+    if (flags == 0)
+        return STATUS_OK;
+    for (auto &slot : this->slots_) {
+        if (slot.used && slot.flags == flags)
+            return slot.text;
+    }
+    Slot &slot = this->slots_[this->next_];
+    this->next_ = (this->next_ + 1) % STATUS_TEXT_CACHE_SLOTS;
+    render_(flags, slot.text);
+    slot.flags = flags;
+    slot.used = true;
+    return slot.text;
+}
+
+void StatusText::render_(uint8_t flags, char *out) {
+    char *p = out;
+    for (uint8_t i = 0; i < STATUS_FLAG_COUNT; i++) {
+        if ((flags & (1 << i)) == 0)
+            continue;
+        if (p != out) {
+            memcpy(p, STATUS_SEPARATOR, const_strlen(STATUS_SEPARATOR));
+            p += const_strlen(STATUS_SEPARATOR);
+        }
+        const size_t len = strlen(STATUS_FLAG_MESSAGES[i]);
+        memcpy(p, STATUS_FLAG_MESSAGES[i], len);
+        p += len;
+    }
+    *p = '\0';
+}
+
+}  // namespace sensostar
+}  // namespace esphome
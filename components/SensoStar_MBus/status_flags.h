@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace esphome {
+namespace sensostar {
+
+// Bits of the error flags record (VIF 0xFD 0x17)
+static const uint8_t STATUS_FLAG_COUNT = 8;
+static constexpr const char *STATUS_FLAG_MESSAGES[STATUS_FLAG_COUNT] = {
+    "Temperature Sensor 1: Cable Break",
+    "Temperature Sensor 1: Short Circuit",
+    "Temperature Sensor 2: Cable Break",
+    "Temperature Sensor 2: Short Circuit",
+    "Error at Flow Measurement System",
+    "Electronic Defect",
+    "Reset",
+    "Low Battery",
+};
+static constexpr const char *STATUS_SEPARATOR = " | ";
+static constexpr const char *STATUS_OK = "OK";
+
+constexpr size_t const_strlen(const char *s) { return *s ? 1 + const_strlen(s + 1) : 0; }
+
+// Length of the status text with all flags set
+constexpr size_t status_text_length(uint8_t i = 0) {
+  return i == STATUS_FLAG_COUNT ? 0
+                                : const_strlen(STATUS_FLAG_MESSAGES[i]) + (i > 0 ? const_strlen(STATUS_SEPARATOR) : 0) +
+                                      status_text_length(i + 1);
+}
+static const size_t STATUS_TEXT_SIZE = status_text_length() + 1;
+// Flag combinations kept rendered, a meter usually alternates between very few
+static const uint8_t STATUS_TEXT_CACHE_SLOTS = 4;
+
+// Status texts of flag combinations, rendered once into fixed buffers and reused while they stay cached
+class StatusText {
+ public:
+  const char *get(uint8_t flags);
+
+ protected:
+  struct Slot {
+    bool used;
+    uint8_t flags;
+    char text[STATUS_TEXT_SIZE];
+  };
+  static void render_(uint8_t flags, char *out);
+
+  Slot slots_[STATUS_TEXT_CACHE_SLOTS]{};
+  uint8_t next_{0}; // slot replaced next
+};
+
+}  // namespace sensostar
+}  // namespace esphome
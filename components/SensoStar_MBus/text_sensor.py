@@ -5,7 +5,7 @@ from esphome.const import (
 	CONF_STATUS,
 )
 
-from . import SensoStarComponent, CONF_SENSOSTAR_ID
+from . import SensoStarMeter, Quantity, CONF_METER_ID
 
 TYPES = [
     CONF_STATUS,
@@ -13,19 +13,21 @@ TYPES = [
 
 CONFIG_SCHEMA = cv.Schema(
     {
-        cv.GenerateID(CONF_SENSOSTAR_ID): cv.use_id(SensoStarComponent),
+        cv.GenerateID(CONF_METER_ID): cv.use_id(SensoStarMeter),
 		cv.Optional(CONF_STATUS): text_sensor.text_sensor_schema(),
     }
 ).extend(cv.COMPONENT_SCHEMA)
 
 
-async def setup_conf(config, key, hub):
+async def setup_conf(config, key, meter):
     if sensor_config := config.get(key):
         sens = await text_sensor.new_text_sensor(sensor_config)
-        cg.add(getattr(hub, f"set_{key}_text_sensor")(sens))
+        cg.add(getattr(meter, f"set_{key}_text_sensor")(sens))
 
 
 async def to_code(config):
-    hub = await cg.get_variable(config[CONF_SENSOSTAR_ID])
+    meter = await cg.get_variable(config[CONF_METER_ID])
     for key in TYPES:
-        await setup_conf(config, key, hub)
\ No newline at end of file
+        await setup_conf(config, key, meter)
+    if CONF_STATUS in config:
+        cg.add(meter.request_quantity(Quantity.ERROR_FLAGS))
\ No newline at end of file
@@ -0,0 +1,75 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "history_codec.h"
+
+// Density and speed of the reading history encoding: noisy readings every 30 s, appended to blocks
+// until they are full.
+// Usage: bench_history [records]
+
+using namespace esphome::sensostar;
+
+static uint32_t rng_state = 12345;
+
+static int32_t noise(int32_t amplitude) {
+    rng_state = rng_state * 1103515245u + 12345u;
+    return (int32_t) ((rng_state >> 8) % (2 * amplitude + 1)) - amplitude;
+}
+
+int main(int argc, char **argv) {
+    unsigned long records = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+
+    // Heating at about 5 kW with noise on every reading, in the stored units
+    HistoryRecord record{};
+    record.time = 1700000000;
+    record.present = (1 << HISTORY_FIELD_COUNT) - 1;
+    record.values[HISTORY_ENERGY] = 45000000;
+    record.values[HISTORY_VOLUME] = 1200000;
+
+    HistoryBlock block{};
+    HistoryEncoder encoder;
+    unsigned long blocks = 0, in_block = 0, encoded = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < records; i++) {
+        record.time += 30;
+        record.values[HISTORY_POWER] = 5000 + noise(300);
+        record.values[HISTORY_FLOW] = 430 + noise(20);
+        record.values[HISTORY_ENERGY] += record.values[HISTORY_POWER] * 30 / 3600;
+        record.values[HISTORY_VOLUME] += record.values[HISTORY_FLOW] * 30 / 3600;
+        record.values[HISTORY_TEMPERATURE_FLOW] = 6000 + noise(50);
+        record.values[HISTORY_TEMPERATURE_RETURN] = 5000 + noise(50);
+        if (in_block == 0 || !encoder.append(record)) {
+            // Only full blocks count
+            if (in_block > 0) {
+                blocks++;
+                encoded += in_block;
+            }
+            block = HistoryBlock{};
+            block.start_time = record.time;
+            encoder.begin(&block);
+            encoder.append(record);
+            in_block = 0;
+        }
+        in_block++;
+    }
+    auto end = std::chrono::steady_clock::now();
+    const double ns = std::chrono::duration<double, std::nano>(end - start).count() / records;
+
+    HistoryBlockReader reader;
+    HistoryRecord out;
+    unsigned long decoded = 0;
+    start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < records / block.count; i++) {
+        reader.begin(block);
+        while (reader.next(out))
+            decoded++;
+    }
+    end = std::chrono::steady_clock::now();
+    const double decode_ns = std::chrono::duration<double, std::nano>(end - start).count() / (decoded ? decoded : 1);
+
+    printf("%lu blocks of %zu bytes, %.1f records/block, %.1f records/KB\n", blocks, HISTORY_BLOCK_SIZE,
+           (double) encoded / blocks, (double) encoded * 1024 / (blocks * HISTORY_BLOCK_SIZE));
+    printf("encode %.1f ns/record, decode %.1f ns/record\n", ns, decode_ns);
+    return 0;
+}
@@ -0,0 +1,324 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "mbus_frame.h"
+#include "mbus_decoder.h"
+#include "status_flags.h"
+#include "frames.h"
+#include "alloc_counter.h"
+
+// Throughput of the M-Bus protocol core on the host: parsing and decoding a SensoStar RSP_UD frame
+// while it is received, next to the receive path and if/else decoder of the original component on
+// the same frames, decoding a record area in one go, and building a request. Also the status text
+// of a frame with faults, built as a string per frame like before and through StatusText.
+// Every case also reports its heap allocations per operation.
+// Usage: bench_mbus [iterations]
+
+using namespace esphome::sensostar;
+
+// Allocations per operation of the last time_ns()
+static double allocs_per_op = 0;
+
+template<typename F> static double time_ns(unsigned long iterations, F &&f) {
+    const unsigned long allocs = alloc_count;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < iterations; i++)
+        f();
+    auto end = std::chrono::steady_clock::now();
+    allocs_per_op = (double) (alloc_count - allocs) / iterations;
+    return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+// Receive path and decoder of SensoStarComponent::loop() before the protocol core (commit 8132f7c),
+// copied verbatim apart from the sensors: values go to fields instead of publish_state(), and
+// warnings are counted instead of logged
+class BaselineDecoder {
+ public:
+    double energy{0}, volume{0}, power{0}, flow{0}, temperature_flow{0}, temperature_return{0}, tdiff{0};
+    std::string status;
+    uint32_t frames{0}, warnings{0};
+
+    void feed(uint8_t c) {
+        if (this->receiving_ != 2) {
+            if (c == 0xe5) {
+                // Acknowledge
+                this->data_.clear();
+                this->receiving_ = 0;
+            }
+            if (c != 0x68)
+                return;
+
+            this->receiving_ = 2;
+        }
+        this->data_.push_back(c);
+
+        if ( this->data_.size() > 4 && this->data_.size() == (size_t) this->data_[1]+6 ) {
+            if (this->data_[0] != 0x68 || this->data_[3] != 0x68)
+                this->warnings++;
+            else if (this->data_[1] != this->data_[2])
+                this->warnings++;
+            else if (this->data_[this->data_.size()-1] != 0x16)
+                this->warnings++;
+            else {
+                uint8_t checksum = 0;
+                for (uint8_t i = 4; i < this->data_.size()-2; i++)
+                    checksum += this->data_[i];
+
+                if (checksum != this->data_[this->data_.size()-2])
+                    this->warnings++;
+                else if (this->data_[4] != 0x08 || this->data_[6] != 0x72 )
+                    this->warnings++;
+                else
+                    this->decode_();
+            }
+            this->data_.clear();
+            this->receiving_ = 0;
+        }
+    }
+
+ protected:
+    static double convert_value(uint32_t data, int8_t decimals){
+        double value = (int32_t)data;
+        for (int8_t i=0; i<decimals; i++) value *= 10;
+        for (int8_t i=decimals; i<0; i++) value /= 10;
+        return value;
+    }
+
+    void decode_() {
+        this->frames++;
+        uint8_t i = 19; // Skip start header and fixed data header
+        while(i < this->data_.size()-3){
+
+            // Get all indexes
+            uint8_t i_DIF = i;
+            while( (this->data_[i] & 0x80) == 0x80)
+                i++;
+            i++;
+            uint8_t i_VIF = i;
+            while( (this->data_[i] & 0x80) == 0x80)
+                i++;
+            i++;
+
+            // Read data
+            uint8_t lc = this->data_[i_DIF]&0x0f; // Length and coding
+            uint32_t result = 0;
+            if (lc == 0x01){ // 8 Bit Integer
+                result = this->data_[i];
+                if ((this->data_[i]&0x80) == 0x80) // Negative
+                    result |= 0xffffff00;
+                i += 1;
+            }
+            else if (lc == 0x02){ // 16 Bit Integer
+                result = this->data_[i] | this->data_[i+1]<<8;
+                if ((this->data_[i+1]&0x80) == 0x80) // Negative
+                    result |= 0xffff0000;
+                i += 2;
+            }
+            else if (lc == 0x03){ // 24 Bit Integer
+                result = this->data_[i] | this->data_[i+1]<<8 | this->data_[i+2]<<16;
+                if ((this->data_[i+2]&0x80) == 0x80) // Negative
+                    result |= 0xff000000;
+                i += 3;
+            }
+            else if (lc == 0x04){ // 32 Bit Integer
+                result = this->data_[i] | this->data_[i+1]<<8 | this->data_[i+2]<<16 | this->data_[i+3]<<24;
+                i += 4;
+            }
+            else {
+                this->warnings++;
+                break;
+            }
+            // DIF
+            uint8_t f = ( this->data_[i_DIF]&0x30 ) >> 4; // Function (normal 0x00 for instantaneous value)
+            // VIF
+            uint8_t vif = this->data_[i_VIF] & 0x7f;
+            if ( (vif&0x78) == 0x00 && f == 0x00){ // Energy (Wh)
+                this->energy = convert_value(result, (vif&0x07) - 3) / 1000;
+            }
+            else if ( (vif&0x78) == 0x10 && f == 0x00){ // Volume (m3)
+                this->volume = convert_value(result, (vif&0x07) - 6);
+            }
+            else if ( (vif&0x78) == 0x28 && f == 0x00){ // Power (W)
+                this->power = convert_value(result, (vif&0x07) - 3);
+            }
+            else if ( (vif&0x78) == 0x38 && f == 0x00){ // Volume Flow (m3/h)
+                this->flow = convert_value(result, (vif&0x07) - 6);
+            }
+            else if ( (vif&0x7C) == 0x58 && f == 0x00){ // Flow Temperature (C)
+                this->temperature_flow = convert_value(result, (vif&0x03) - 3);
+            }
+            else if ( (vif&0x7C) == 0x5c && f == 0x00){ // Return Temperature (C)
+                this->temperature_return = convert_value(result, (vif&0x03) - 3);
+            }
+            else if ( (vif&0x7C) == 0x60 && f == 0x00){ // Temperature Difference (K)
+                this->tdiff = convert_value(result, (vif&0x03) - 3);
+            }
+            else if ( this->data_[i_VIF] == 0xfd && this->data_[i_VIF+1] == 0x17 ) { // Error flags (binary)
+                if (result == 0x00)
+                    this->status = "OK";
+                else {
+                    bool append = false;
+                    std::string state;
+                    state.reserve(256);
+                    if (result&0x01){
+                        if (append)
+                            state += " | ";
+                        state += "Temperature Sensor 1: Cable Break";
+                        append = true;
+                    }
+                    if (result&0x02){
+                        if (append)
+                            state += " | ";
+                        state += "Temperature Sensor 1: Short Circuit";
+                        append = true;
+                    }
+                    if (result&0x04){
+                        if (append)
+                            state += " | ";
+                        state += "Temperature Sensor 2: Cable Break";
+                        append = true;
+                    }
+                    if (result&0x08){
+                        if (append)
+                            state += " | ";
+                        state += "Temperature Sensor 2: Short Circuit";
+                        append = true;
+                    }
+                    if (result&0x10){
+                        if (append)
+                            state += " | ";
+                        state += "Error at Flow Measurement System";
+                        append = true;
+                    }
+                    if (result&0x20){
+                        if (append)
+                            state += " | ";
+                        state += "Electronic Defect";
+                        append = true;
+                    }
+                    if (result&0x40){
+                        if (append)
+                            state += " | ";
+                        state += "Reset";
+                        append = true;
+                    }
+                    if (result&0x80){
+                        if (append)
+                            state += " | ";
+                        state += "Low Battery";
+                        append = true;
+                    }
+                    this->status = state;
+                }
+            }
+            else {
+                // Unknown
+                this->warnings++;
+                break;
+            }
+        }
+    }
+
+    std::vector<uint8_t> data_;
+    uint8_t receiving_{0};
+};
+
+static void report(const char *name, double ns, size_t bytes) {
+    if (bytes == 0)
+        printf("%-24s %8.1f ns/op %19s %5.2f allocs/op\n", name, ns, "", allocs_per_op);
+    else
+        printf("%-24s %8.1f ns/op %8.1f MB/s %5.2f allocs/op\n", name, ns, bytes * 1e3 / ns, allocs_per_op);
+}
+
+int main(int argc, char **argv) {
+    unsigned long iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+
+    uint8_t frame[mbus::MAX_FRAME_LENGTH];
+    size_t len = test::build_sample_rsp_ud(frame, sizeof(frame));
+    volatile double sink = 0;
+
+    mbus::FrameParser parser;
+    mbus::RspUdDecoder decoder;
+    parser.set_sink(&decoder);
+    BaselineDecoder baseline;
+
+    // Both receive paths on the sample frame and on the SensoStar frame
+    struct {
+        const char *name;
+        const uint8_t *data;
+        size_t len;
+    } frames[] = {
+        {"sample", frame, len},
+        {"SensoStar", test::SENSOSTAR_RSP_UD, sizeof(test::SENSOSTAR_RSP_UD)},
+    };
+    double ns;
+    char name[32];
+    for (const auto &f : frames) {
+        ns = time_ns(iterations, [&]() {
+            for (size_t i = 0; i < f.len; i++)
+                baseline.feed(f.data[i]);
+            sink += baseline.energy;
+        });
+        snprintf(name, sizeof(name), "if/else, %s", f.name);
+        report(name, ns, f.len);
+
+        ns = time_ns(iterations, [&]() {
+            for (size_t i = 0; i < f.len; i++) {
+                if (parser.feed(f.data[i]) == mbus::ParseResult::FRAME)
+                    sink += decoder.readout().get(mbus::Quantity::ENERGY);
+            }
+        });
+        snprintf(name, sizeof(name), "parse+decode, %s", f.name);
+        report(name, ns, f.len);
+    }
+
+    static const mbus::RecordFilter FILTERS[] = {{0x06, mbus::RECORD_FILTER_NO_VIFE, 0, 1, 0, 0}};
+    decoder.set_filters(FILTERS, 1);
+    ns = time_ns(iterations, [&]() {
+        for (size_t i = 0; i < len; i++) {
+            if (parser.feed(frame[i]) == mbus::ParseResult::FRAME)
+                sink += decoder.readout().records[0];
+        }
+    });
+    report("parse+decode, 1 filter", ns, len);
+
+    mbus::Readout readout;
+    ns = time_ns(iterations, [&]() {
+        mbus::decode_records(test::SAMPLE_RECORDS, sizeof(test::SAMPLE_RECORDS), readout);
+        sink += readout.get(mbus::Quantity::ENERGY);
+    });
+    report("decode_records", ns, sizeof(test::SAMPLE_RECORDS));
+
+    static const uint8_t POLL[] = {0x0F, 0x00, 0x00, 0x01, 0x59, 0x02, 0x03, 0x04, 0x06, 0x05, 0x07, 0x08, 0x09, 0x0B};
+    uint8_t out[mbus::MAX_FRAME_LENGTH];
+    ns = time_ns(iterations, [&]() {
+        sink += mbus::build_long_frame(out, sizeof(out), mbus::C_SND_UD, 0x01, mbus::CI_DATA_SEND, POLL, sizeof(POLL));
+    });
+    report("build_long_frame", ns, sizeof(POLL) + 9);
+
+    // Flags 0x85: two cable breaks and low battery
+    volatile uint8_t flags = 0x85;
+    ns = time_ns(iterations, [&]() {
+        std::string state;
+        state.reserve(256);
+        for (uint8_t i = 0; i < STATUS_FLAG_COUNT; i++) {
+            if ((flags & (1 << i)) == 0)
+                continue;
+            if (!state.empty())
+                state += STATUS_SEPARATOR;
+            state += STATUS_FLAG_MESSAGES[i];
+        }
+        sink += state.size();
+    });
+    report("status string", ns, 0);
+
+    StatusText status;
+    ns = time_ns(iterations, [&]() { sink += status.get(flags)[0]; });
+    report("StatusText, cached", ns, 0);
+
+    (void) sink;
+    return 0;
+}
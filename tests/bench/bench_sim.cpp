@@ -0,0 +1,87 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "sim/simulation.h"
+#include "sim/trace.h"
+
+// Poll cycles on the simulated bus in accelerated time: the simulated duration of a cycle shows
+// timing regressions of the poll loop, the wall time the cost of parsing and decoding.
+// Usage: bench_sim [cycles] [meters] [--faults] [--loop-period us] [--trace FILE]
+
+using namespace esphome::sensostar;
+
+int main(int argc, char **argv) {
+    unsigned long cycles = 100000;
+    unsigned long meters = 4;
+    unsigned long loop_period = 1000;
+    bool faults = false;
+    const char *trace_path = nullptr;
+    int positional = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--faults") == 0)
+            faults = true;
+        else if (strcmp(argv[i], "--loop-period") == 0 && i + 1 < argc)
+            loop_period = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+            trace_path = argv[++i];
+        else if (positional++ == 0)
+            cycles = strtoul(argv[i], nullptr, 10);
+        else
+            meters = strtoul(argv[i], nullptr, 10);
+    }
+
+    sim::Simulation sim;
+    sim.set_loop_period(loop_period);
+    FILE *trace_file = nullptr;
+    sim::TraceWriter *trace = nullptr;
+    if (trace_path != nullptr) {
+        trace_file = fopen(trace_path, "w");
+        if (trace_file == nullptr) {
+            fprintf(stderr, "Can't write %s\n", trace_path);
+            return 1;
+        }
+        trace = new sim::TraceWriter(trace_file);
+        sim.set_trace(trace);
+    }
+    for (unsigned long i = 0; i < meters; i++) {
+        sim::VirtualMeter *meter = sim.add_meter(i + 1, 0x10000000 + i, i + 1);
+        sim::MeterFaults meter_faults;
+        meter_faults.latency = 20 + 5 * i;
+        if (faults) {
+            meter_faults.jitter = 30;
+            meter_faults.no_reply = 0.01f;
+            meter_faults.drop_byte = 0.0005f;
+            meter_faults.corrupt_byte = 0.0005f;
+        }
+        meter->set_faults(meter_faults);
+        sim.add_master_meter(i + 1);
+    }
+    unsigned long readouts = 0;
+    sim.set_readout_callback([&readouts](size_t, const mbus::FixedHeader &, const mbus::Readout &) { readouts++; });
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < cycles; i++) {
+        sim.poll();
+        // Backed off meters are polled again by a later cycle
+        sim.run_until(sim.clock.millis() + 1);
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const sim::Counters counters = sim.counters();
+    printf("%lu cycles of %lu meters, %.1f h simulated in %.2f s\n", cycles, meters, sim.clock.us / 3.6e9, wall);
+    printf("cycle time: %.1f ms mean, %u ms max (simulated)\n",
+           counters.cycles > 0 ? (double) counters.cycle_time / counters.cycles : 0.0, counters.cycle_time_max);
+    printf("%lu readouts, %u timeouts, %u retries, %u frame errors\n", readouts, counters.timeouts, counters.retries,
+           counters.errors);
+    printf("%.0f cycles/s, %.0f readouts/s, %.1f MB/s received (wall time)\n", cycles / wall, readouts / wall,
+           counters.bytes / wall / 1e6);
+
+    if (trace_file != nullptr) {
+        sim.set_trace(nullptr);
+        delete trace;
+        fclose(trace_file);
+    }
+    return 0;
+}
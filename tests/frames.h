@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "mbus_frame.h"
+
+// Sample frames shared by the host tests, fuzzer seeds and the benchmark
+
+namespace esphome {
+namespace sensostar {
+namespace test {
+
+// Fixed data header: ID 12345678, manufacturer EFE (Engelmann), heat medium, access number 1
+static const uint8_t SAMPLE_HEADER[mbus::FIXED_HEADER_LENGTH] = {0x78, 0x56, 0x34, 0x12, 0xC5, 0x14,
+                                                                 0x00, 0x04, 0x01, 0x00, 0x00, 0x00};
+
+// Record area of a SensoStar readout
+static const uint8_t SAMPLE_RECORDS[] = {
+    0x04, 0x06, 0x39, 0x30, 0x00, 0x00,  // energy 12345 kWh
+    0x04, 0x14, 0x10, 0x27, 0x00, 0x00,  // volume 100.00 m3
+    0x02, 0x2B, 0xE8, 0x03,              // power 1000 W
+    0x02, 0x3B, 0x2C, 0x01,              // flow 0.300 m3/h
+    0x02, 0x5A, 0xC2, 0x01,              // flow temperature 45.0 C
+    0x02, 0x5E, 0x5E, 0x01,              // return temperature 35.0 C
+    0x02, 0x61, 0xE8, 0x03,              // temperature difference 10.00 K
+    0x04, 0x6D, 0x00, 0x0C, 0x11, 0x2A,  // date and time, not decoded
+    0x44, 0x06, 0x10, 0x27, 0x00, 0x00,  // storage 1: energy 10000 kWh
+    0x01, 0xFD, 0x17, 0x04,              // error flags
+};
+
+// A complete RSP_UD frame as it appears on the wire, from address 1, ID 67357241. Written out byte
+// by byte in the record layout of a SensoStar readout, checksum included. Hand-assembled, not captured
+// from a meter: the project has no bus recording of one yet, replace this once it has.
+static const uint8_t SENSOSTAR_RSP_UD[] = {
+    0x68, 0x43, 0x43, 0x68, 0x08, 0x01, 0x72,              // start, length 67, RSP_UD from 1, CI 0x72
+    0x41, 0x72, 0x35, 0x67, 0xC5, 0x14, 0x00, 0x04,        // ID 67357241, EFE, version 0, heat
+    0x2A, 0x00, 0x00, 0x00,                                // access number 42, status, signature
+    0x04, 0x06, 0x2B, 0x1A, 0x00, 0x00,                    // energy 6699 kWh
+    0x04, 0x13, 0x5C, 0x8F, 0x04, 0x00,                    // volume 298.844 m3
+    0x02, 0x2B, 0x3A, 0x02,                                // power 570 W
+    0x02, 0x3B, 0x4C, 0x00,                                // flow 0.076 m3/h
+    0x02, 0x59, 0xF4, 0x18,                                // flow temperature 63.88 C
+    0x02, 0x5D, 0x5E, 0x16,                                // return temperature 57.26 C
+    0x02, 0x61, 0x96, 0x02,                                // temperature difference 6.62 K
+    0x04, 0x6D, 0x2A, 0x0E, 0x31, 0x2A,                    // date and time, not decoded
+    0x01, 0xFD, 0x17, 0x00,                                // error flags
+    0x44, 0x06, 0x10, 0x19, 0x00, 0x00,                    // storage 1: energy 6416 kWh
+    0x42, 0x6C, 0x3F, 0x2C,                                // storage 1: date, not decoded
+    0xF2, 0x16,                                            // checksum, stop
+};
+
+// Long RSP_UD frame from address 1 around the given record area, returns its length or 0
+inline size_t build_rsp_ud(uint8_t *out, size_t out_size, const uint8_t *records, size_t len) {
+  uint8_t payload[252];
+  if (len > sizeof(payload) - sizeof(SAMPLE_HEADER))
+    return 0;
+  memcpy(payload, SAMPLE_HEADER, sizeof(SAMPLE_HEADER));
+  memcpy(payload + sizeof(SAMPLE_HEADER), records, len);
+  return mbus::build_long_frame(out, out_size, mbus::C_RSP_UD, 0x01, mbus::CI_RSP_UD, payload,
+                                sizeof(SAMPLE_HEADER) + len);
+}
+
+inline size_t build_sample_rsp_ud(uint8_t *out, size_t out_size) {
+  return build_rsp_ud(out, out_size, SAMPLE_RECORDS, sizeof(SAMPLE_RECORDS));
+}
+
+}  // namespace test
+}  // namespace sensostar
+}  // namespace esphome
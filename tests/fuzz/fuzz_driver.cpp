@@ -0,0 +1,222 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sanitizer/common_interface_defs.h>
+
+#include "frames.h"
+
+// Standalone replacement for libFuzzer where clang is not available. Accepts the libFuzzer options
+// ctest uses (-runs=N, -dict=FILE, -seed=N) and input files or directories to replay. Without inputs
+// it mutates built-in seeds (SensoStar RSP_UD frames and a record area) and the dictionary tokens.
+// The input that crashed is written to crash-input.
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+using Input = std::vector<uint8_t>;
+
+static const Input *current = nullptr;
+
+static void write_crash_input() {
+    if (current == nullptr)
+        return;
+    FILE *f = fopen("crash-input", "wb");
+    if (f == nullptr)
+        return;
+    fwrite(current->data(), 1, current->size(), f);
+    fclose(f);
+    fprintf(stderr, "Input written to crash-input (%zu bytes)\n", current->size());
+}
+
+static void run(const Input &input) {
+    current = &input;
+    LLVMFuzzerTestOneInput(input.data(), input.size());
+    current = nullptr;
+}
+
+static bool read_file(const std::string &path, Input &out) {
+    FILE *f = fopen(path.c_str(), "rb");
+    if (f == nullptr)
+        return false;
+    uint8_t buf[4096];
+    size_t n;
+    out.clear();
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        out.insert(out.end(), buf, buf + n);
+    fclose(f);
+    return true;
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// libFuzzer dictionary: one quoted token per line, "\xNN" escapes, # comments
+static void read_dict(const std::string &path, std::vector<Input> &tokens) {
+    FILE *f = fopen(path.c_str(), "r");
+    if (f == nullptr) {
+        fprintf(stderr, "Can't read dictionary %s\n", path.c_str());
+        return;
+    }
+    char line[512];
+    while (fgets(line, sizeof(line), f) != nullptr) {
+        const char *p = strchr(line, '"');
+        if (line[0] == '#' || p == nullptr)
+            continue;
+        Input token;
+        for (p++; *p != '\0' && *p != '"'; p++) {
+            if (p[0] == '\\' && p[1] == 'x' && hex_digit(p[2]) >= 0 && hex_digit(p[3]) >= 0) {
+                token.push_back((uint8_t) (hex_digit(p[2]) << 4 | hex_digit(p[3])));
+                p += 3;
+            } else if (p[0] == '\\' && p[1] != '\0') {
+                token.push_back((uint8_t) *++p);
+            } else {
+                token.push_back((uint8_t) *p);
+            }
+        }
+        if (!token.empty())
+            tokens.push_back(token);
+    }
+    fclose(f);
+}
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static uint32_t rnd(uint32_t n) {
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (uint32_t) ((rng_state * 0x2545F4914F6CDD1Dull) >> 32) % n;
+}
+
+static void mutate(Input &input, const std::vector<Input> &seeds, const std::vector<Input> &tokens) {
+    uint32_t steps = 1 + rnd(4);
+    for (uint32_t s = 0; s < steps; s++) {
+        switch (rnd(7)) {
+            case 0: // flip bits
+                if (!input.empty())
+                    input[rnd(input.size())] ^= (uint8_t) (1 << rnd(8));
+                break;
+            case 1: // random byte
+                if (!input.empty())
+                    input[rnd(input.size())] = (uint8_t) rnd(256);
+                break;
+            case 2: // insert random bytes
+                for (uint32_t n = 1 + rnd(8); n > 0; n--)
+                    input.insert(input.begin() + rnd(input.size() + 1), (uint8_t) rnd(256));
+                break;
+            case 3: // erase a range
+                if (!input.empty()) {
+                    size_t at = rnd(input.size());
+                    size_t n = 1 + rnd(std::min<size_t>(input.size() - at, 16));
+                    input.erase(input.begin() + at, input.begin() + at + n);
+                }
+                break;
+            case 4: // insert a dictionary token
+                if (!tokens.empty()) {
+                    const Input &token = tokens[rnd(tokens.size())];
+                    input.insert(input.begin() + rnd(input.size() + 1), token.begin(), token.end());
+                }
+                break;
+            case 5: { // splice with a seed
+                const Input &other = seeds[rnd(seeds.size())];
+                size_t at = rnd(input.size() + 1);
+                size_t from = rnd(other.size());
+                input.resize(at);
+                input.insert(input.end(), other.begin() + from, other.end());
+                break;
+            }
+            default: // duplicate a range, repeats records and frames
+                if (!input.empty()) {
+                    size_t at = rnd(input.size());
+                    size_t n = 1 + rnd(std::min<size_t>(input.size() - at, 32));
+                    Input range(input.begin() + at, input.begin() + at + n);
+                    input.insert(input.begin() + rnd(input.size() + 1), range.begin(), range.end());
+                }
+                break;
+        }
+    }
+    if (input.size() > 1024)
+        input.resize(1024);
+}
+
+int main(int argc, char **argv) {
+    unsigned long runs = 100000;
+    std::vector<Input> tokens;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("-runs=", 0) == 0)
+            runs = strtoul(arg.c_str() + 6, nullptr, 10);
+        else if (arg.rfind("-dict=", 0) == 0)
+            read_dict(arg.substr(6), tokens);
+        else if (arg.rfind("-seed=", 0) == 0)
+            rng_state = strtoull(arg.c_str() + 6, nullptr, 10) | 1;
+        else if (arg[0] == '-')
+            fprintf(stderr, "Ignoring option %s\n", arg.c_str());
+        else
+            paths.push_back(arg);
+    }
+    __sanitizer_set_death_callback(write_crash_input);
+
+    // Replay given inputs
+    if (!paths.empty()) {
+        for (const std::string &path : paths) {
+            DIR *dir = opendir(path.c_str());
+            std::vector<std::string> files;
+            if (dir != nullptr) {
+                while (dirent *entry = readdir(dir)) {
+                    if (entry->d_name[0] != '.')
+                        files.push_back(path + "/" + entry->d_name);
+                }
+                closedir(dir);
+            } else {
+                files.push_back(path);
+            }
+            for (const std::string &file : files) {
+                Input input;
+                if (!read_file(file, input)) {
+                    fprintf(stderr, "Can't read %s\n", file.c_str());
+                    return 1;
+                }
+                run(input);
+            }
+            printf("Replayed %zu input(s) from %s\n", files.size(), path.c_str());
+        }
+        return 0;
+    }
+
+    std::vector<Input> seeds;
+    uint8_t frame[esphome::sensostar::mbus::MAX_FRAME_LENGTH];
+    size_t len = esphome::sensostar::test::build_sample_rsp_ud(frame, sizeof(frame));
+    seeds.emplace_back(frame, frame + len);
+    seeds.emplace_back(std::begin(esphome::sensostar::test::SENSOSTAR_RSP_UD),
+                       std::end(esphome::sensostar::test::SENSOSTAR_RSP_UD));
+    Input records{0x02};
+    records.insert(records.end(), std::begin(esphome::sensostar::test::SAMPLE_RECORDS),
+                   std::end(esphome::sensostar::test::SAMPLE_RECORDS));
+    seeds.push_back(records);
+    for (const Input &token : tokens)
+        seeds.push_back(token);
+
+    for (const Input &seed : seeds)
+        run(seed);
+    for (unsigned long i = 0; i < runs; i++) {
+        Input input = seeds[rnd(seeds.size())];
+        mutate(input, seeds, tokens);
+        run(input);
+    }
+    printf("Done %lu runs\n", runs);
+    return 0;
+}
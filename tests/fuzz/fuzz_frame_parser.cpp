@@ -0,0 +1,47 @@
+#include <cstddef>
+#include <cstdint>
+
+#include "mbus_frame.h"
+#include "mbus_decoder.h"
+
+// Feeds arbitrary bytes to the frame parser with the streaming RSP_UD decoder attached,
+// and touches everything a caller may read once a frame is reported
+
+using namespace esphome::sensostar;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    static const mbus::RecordFilter FILTERS[] = {
+        {0x06, mbus::RECORD_FILTER_NO_VIFE, 0, 1, 0, 0},
+        {0x2B, mbus::RECORD_FILTER_NO_VIFE, 1, 0, 0, 0},
+    };
+    mbus::FrameParser parser;
+    mbus::RspUdDecoder decoder;
+    decoder.set_filters(FILTERS, 2);
+    parser.set_sink(&decoder);
+
+    volatile uint32_t sink = 0;
+    for (size_t i = 0; i < size; i++) {
+        mbus::ParseResult result = parser.feed(data[i]);
+        if (result == mbus::ParseResult::NONE || result == mbus::ParseResult::ACK)
+            continue;
+        sink += parser.frame_size();
+        if (result != mbus::ParseResult::FRAME)
+            continue;
+        const uint8_t *payload = parser.payload();
+        for (uint16_t k = 0; k < parser.payload_size(); k++)
+            sink += payload[k];
+        if (decoder.is_rsp_ud() && decoder.complete()) {
+            const mbus::Readout &readout = decoder.readout();
+            sink += readout.present + readout.records_present + decoder.header().id;
+
+            // The whole-buffer decoder must agree with the streaming one
+            mbus::Readout whole;
+            decode_records(payload + mbus::FIXED_HEADER_LENGTH, parser.payload_size() - mbus::FIXED_HEADER_LENGTH,
+                           whole);
+            if (whole.present != readout.present)
+                __builtin_trap();
+        }
+    }
+    (void) sink;
+    return 0;
+}
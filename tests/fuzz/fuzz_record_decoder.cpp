@@ -0,0 +1,41 @@
+#include <cstddef>
+#include <cstdint>
+
+#include "mbus_decoder.h"
+
+// Feeds arbitrary bytes to the record decoder as the record area of a RSP_UD frame.
+// The first byte selects the filters, so matching records are exercised as well.
+
+using namespace esphome::sensostar;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    static mbus::RecordFilter filters[mbus::MAX_RECORD_FILTERS];
+    if (size == 0)
+        return 0;
+    uint8_t count = data[0] % (mbus::MAX_RECORD_FILTERS + 1);
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t b = data[(1 + i) % size];
+        filters[i] = mbus::RecordFilter{(uint8_t) (b & 0x7F), (uint16_t) (b & 0x80 ? mbus::RECORD_FILTER_NO_VIFE : 0x17),
+                                        (uint8_t) (b & 0x03), (uint32_t) (i & 0x03), 0, 0};
+    }
+
+    mbus::RecordDecoder decoder;
+    decoder.set_filters(filters, count);
+    decoder.reset();
+    for (size_t i = 1; i < size && decoder.ok(); i++)
+        decoder.feed(data[i]);
+
+    volatile double sink = 0;
+    const mbus::Readout &readout = decoder.readout();
+    for (uint8_t q = 0; q < mbus::QUANTITY_COUNT; q++) {
+        if (readout.has((mbus::Quantity) q))
+            sink += readout.get((mbus::Quantity) q);
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        if (readout.records_present & (1 << i))
+            sink += readout.records[i];
+    }
+    (void) decoder.complete();
+    (void) sink;
+    return 0;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+// The subset of ESPHome's socket API used by MBusGateway, on POSIX sockets
+
+namespace esphome {
+namespace socket {
+
+class Socket {
+ public:
+  explicit Socket(int fd) : fd_(fd) {}
+  ~Socket() { this->close(); }
+  Socket(const Socket &) = delete;
+  Socket &operator=(const Socket &) = delete;
+
+  std::unique_ptr<Socket> accept(struct sockaddr *addr, socklen_t *addrlen);
+  int bind(const struct sockaddr *addr, socklen_t addrlen);
+  int close();
+  int listen(int backlog);
+  ssize_t read(void *buf, size_t len);
+  ssize_t write(const void *buf, size_t len);
+  int setblocking(bool blocking);
+  int setsockopt(int level, int optname, const void *optval, socklen_t optlen);
+
+ protected:
+  int fd_;
+};
+
+std::unique_ptr<Socket> socket_ip(int type, int protocol);
+socklen_t set_sockaddr_any(struct sockaddr *addr, socklen_t addrlen, uint16_t port);
+
+}  // namespace socket
+}  // namespace esphome
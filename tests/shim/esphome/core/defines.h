@@ -0,0 +1,7 @@
+#pragma once
+
+// Host build: the parts of ESPHome the gateway and the bus master use, the gateway backed by POSIX
+// sockets, the bus trace written by the simulation (sim/trace.cpp)
+#define USE_SENSOSTAR_GATEWAY
+#define USE_SENSOSTAR_TRACE
+#define USE_SENSOSTAR_STATS
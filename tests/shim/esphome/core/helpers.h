@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace esphome {
+
+// "68.1F.1F.68", like ESPHome's version
+inline std::string format_hex_pretty(const uint8_t *data, size_t length) {
+  static const char HEX_DIGITS[] = "0123456789ABCDEF";
+  std::string out;
+  for (size_t i = 0; i < length; i++) {
+    if (i > 0)
+      out += '.';
+    out += HEX_DIGITS[data[i] >> 4];
+    out += HEX_DIGITS[data[i] & 0x0F];
+  }
+  return out;
+}
+
+}  // namespace esphome
@@ -0,0 +1,63 @@
+#include "esphome/components/socket/socket.h"
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace esphome {
+namespace socket {
+
+std::unique_ptr<Socket> Socket::accept(struct sockaddr *addr, socklen_t *addrlen) {
+    int fd = ::accept(this->fd_, addr, addrlen);
+    if (fd < 0)
+        return nullptr;
+    return std::unique_ptr<Socket>(new Socket(fd));
+}
+
+int Socket::bind(const struct sockaddr *addr, socklen_t addrlen) { return ::bind(this->fd_, addr, addrlen); }
+
+int Socket::close() {
+    if (this->fd_ < 0)
+        return 0;
+    int ret = ::close(this->fd_);
+    this->fd_ = -1;
+    return ret;
+}
+
+int Socket::listen(int backlog) { return ::listen(this->fd_, backlog); }
+
+ssize_t Socket::read(void *buf, size_t len) { return ::read(this->fd_, buf, len); }
+
+ssize_t Socket::write(const void *buf, size_t len) { return ::send(this->fd_, buf, len, MSG_NOSIGNAL); }
+
+int Socket::setblocking(bool blocking) {
+    int flags = fcntl(this->fd_, F_GETFL, 0);
+    return fcntl(this->fd_, F_SETFL, blocking ? flags & ~O_NONBLOCK : flags | O_NONBLOCK);
+}
+
+int Socket::setsockopt(int level, int optname, const void *optval, socklen_t optlen) {
+    return ::setsockopt(this->fd_, level, optname, optval, optlen);
+}
+
+std::unique_ptr<Socket> socket_ip(int type, int protocol) {
+    int fd = ::socket(AF_INET, type, protocol);
+    if (fd < 0)
+        return nullptr;
+    return std::unique_ptr<Socket>(new Socket(fd));
+}
+
+socklen_t set_sockaddr_any(struct sockaddr *addr, socklen_t addrlen, uint16_t port) {
+    if (addrlen < sizeof(struct sockaddr_in))
+        return 0;
+    auto *server = reinterpret_cast<struct sockaddr_in *>(addr);
+    memset(server, 0, sizeof(struct sockaddr_in));
+    server->sin_family = AF_INET;
+    // Loopback only, unlike the device: the test must not open a port to the network
+    server->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    server->sin_port = htons(port);
+    return sizeof(struct sockaddr_in);
+}
+
+}  // namespace socket
+}  // namespace esphome
@@ -0,0 +1,56 @@
+#include "replay.h"
+
+#include "mbus_frame.h"
+
+namespace esphome {
+namespace sensostar {
+namespace sim {
+
+ReplayResult replay(const std::vector<TraceEntry> &trace, const ReplayCallback &on_readout) {
+    ReplayResult result;
+    mbus::FrameParser parser;
+    mbus::RspUdDecoder decoder;
+    parser.set_sink(&decoder);
+    uint8_t address = 0;
+    for (const TraceEntry &entry : trace) {
+        switch (entry.event) {
+            case TraceEvent::TX:
+                parser.reset();
+                result.requests++;
+                // Short frame 0x10 C A, long frame 0x68 L L 0x68 C A
+                if (entry.data.size() >= 3)
+                    address = entry.data[0] == mbus::FRAME_START_SHORT ? entry.data[2]
+                                                                        : entry.data.size() >= 6 ? entry.data[5] : 0;
+                break;
+            case TraceEvent::RX:
+                result.bytes += entry.data.size();
+                for (uint8_t c : entry.data) {
+                    mbus::ParseResult parsed = parser.feed(c);
+                    if (parsed == mbus::ParseResult::ACK) {
+                        result.acks++;
+                    } else if (parsed == mbus::ParseResult::FRAME) {
+                        result.frames++;
+                        if (decoder.is_rsp_ud() && decoder.complete()) {
+                            result.readouts++;
+                            if (on_readout)
+                                on_readout(entry.time, address, decoder.header(), decoder.readout());
+                        }
+                    } else if (parsed != mbus::ParseResult::NONE) {
+                        result.errors++;
+                    }
+                }
+                break;
+            case TraceEvent::TIMEOUT:
+                parser.reset();
+                result.timeouts++;
+                break;
+            case TraceEvent::BAUD:
+                break;
+        }
+    }
+    return result;
+}
+
+}  // namespace sim
+}  // namespace sensostar
+}  // namespace esphome
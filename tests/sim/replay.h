@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "mbus_decoder.h"
+#include "trace.h"
+
+// Replays the received bytes of a bus trace through the frame parser and the record decoder,
+// the parser is reset on every request like in the component
+
+namespace esphome {
+namespace sensostar {
+namespace sim {
+
+struct ReplayResult {
+  uint32_t requests{0};
+  uint32_t acks{0};
+  uint32_t frames{0};
+  uint32_t readouts{0};  // complete RSP_UD frames
+  uint32_t errors{0};    // start, length, stop and checksum errors
+  uint32_t timeouts{0};
+  uint64_t bytes{0};     // received
+};
+
+// time and A field of the request the frame answers
+using ReplayCallback =
+    std::function<void(uint32_t time, uint8_t address, const mbus::FixedHeader &, const mbus::Readout &)>;
+
+ReplayResult replay(const std::vector<TraceEntry> &trace, const ReplayCallback &on_readout = nullptr);
+
+}  // namespace sim
+}  // namespace sensostar
+}  // namespace esphome
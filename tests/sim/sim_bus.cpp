@@ -0,0 +1,80 @@
+#include "sim_bus.h"
+
+#include <algorithm>
+
+namespace esphome {
+namespace sensostar {
+namespace sim {
+
+void Bus::set_baud_rate(uint32_t baud_rate) {
+    this->baud_rate_ = baud_rate;
+    this->rx_.clear();
+}
+
+void Bus::write(const uint8_t *data, size_t len) {
+    const uint64_t byte_time = byte_time_us(this->baud_rate_);
+    uint64_t start = std::max(this->clock_.us, this->tx_end_);
+    for (size_t i = 0; i < len; i++, start += byte_time)
+        this->to_stations_.push_back({start, start + byte_time, this->baud_rate_, data[i]});
+    this->tx_end_ = start;
+}
+
+size_t Bus::read(uint8_t *out, size_t len) {
+    size_t n = std::min(len, this->rx_.size());
+    std::copy(this->rx_.begin(), this->rx_.begin() + n, out);
+    this->rx_.erase(this->rx_.begin(), this->rx_.begin() + n);
+    return n;
+}
+
+void Bus::send(uint8_t c, uint32_t baud_rate, uint64_t start) {
+    const uint64_t end = start + byte_time_us(baud_rate);
+    for (WireByte &other : this->to_master_) {
+        if (other.start < end && start < other.end) {
+            // Collision
+            other.value &= c;
+            other.end = std::max(other.end, end);
+            return;
+        }
+    }
+    WireByte byte{start, end, baud_rate, c};
+    auto at = std::upper_bound(this->to_master_.begin(), this->to_master_.end(), byte,
+                               [](const WireByte &a, const WireByte &b) { return a.end < b.end; });
+    this->to_master_.insert(at, byte);
+}
+
+void Bus::run() {
+    const uint64_t now = this->clock_.us;
+    // Stations answer with bytes that may complete before now as well
+    while (true) {
+        const bool to_stations = !this->to_stations_.empty() && this->to_stations_.front().end <= now;
+        const bool to_master = !this->to_master_.empty() && this->to_master_.front().end <= now;
+        if (to_stations && (!to_master || this->to_stations_.front().end <= this->to_master_.front().end)) {
+            WireByte byte = this->to_stations_.front();
+            this->to_stations_.pop_front();
+            for (Station *station : this->stations_) {
+                if (station->baud_rate() == byte.baud_rate)
+                    station->on_byte(byte.value, byte.end);
+            }
+        } else if (to_master) {
+            WireByte byte = this->to_master_.front();
+            this->to_master_.pop_front();
+            if (byte.baud_rate == this->baud_rate_)
+                this->rx_.push_back(byte.value);
+        } else {
+            return;
+        }
+    }
+}
+
+uint64_t Bus::next_event() const {
+    uint64_t next = NEVER;
+    if (!this->to_stations_.empty())
+        next = this->to_stations_.front().end;
+    if (!this->to_master_.empty())
+        next = std::min(next, this->to_master_.front().end);
+    return next;
+}
+
+}  // namespace sim
+}  // namespace sensostar
+}  // namespace esphome
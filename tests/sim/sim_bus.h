@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "bus_master.h"
+
+// Simulated M-Bus in accelerated time: a fake clock, the master's UART and the wire to the meters
+
+namespace esphome {
+namespace sensostar {
+namespace sim {
+
+// Simulated time in microseconds, millis() like on the device
+struct Clock : public BusClock {
+  uint64_t us{0};
+  uint32_t millis() const { return (uint32_t) (this->us / 1000); }
+
+  uint32_t bus_millis() override { return this->millis(); }
+  uint32_t bus_micros() override { return (uint32_t) this->us; }
+};
+
+static const uint64_t NEVER = UINT64_MAX;
+
+// 11 bits per character: start, 8 data, parity, stop
+inline uint64_t byte_time_us(uint32_t baud_rate) { return 11000000ull / baud_rate; }
+
+// A meter on the bus
+class Station {
+ public:
+  virtual ~Station() = default;
+  // A byte from the master was received completely at `at`, only called at the station's baud rate
+  virtual void on_byte(uint8_t c, uint64_t at) = 0;
+  virtual uint32_t baud_rate() const = 0;
+};
+
+// Carries the bytes of the master to every station at the same baud rate and the bytes of the
+// stations back to the master. Bytes at a different baud rate than the receiver's are lost.
+// Overlapping bytes of several stations reach the master as one byte, the AND of both (a space
+// on the bus wins), like an acknowledge answered by two meters at once.
+class Bus {
+ public:
+  explicit Bus(Clock &clock) : clock_(clock) {}
+  void attach(Station *station) { this->stations_.push_back(station); }
+
+  // Fake UART of the master
+  void set_baud_rate(uint32_t baud_rate);
+  uint32_t baud_rate() const { return this->baud_rate_; }
+  // Queued behind the bytes still being sent
+  void write(const uint8_t *data, size_t len);
+  // End of the last byte written
+  uint64_t tx_end() const { return this->tx_end_; }
+  size_t available() const { return this->rx_.size(); }
+  size_t read(uint8_t *out, size_t len);
+
+  // A station sends one byte starting at `start`
+  void send(uint8_t c, uint32_t baud_rate, uint64_t start);
+
+  // Delivers every byte completed by the current time
+  void run();
+  // Time the next byte on the wire completes, NEVER if the bus is idle
+  uint64_t next_event() const;
+
+ protected:
+  struct WireByte {
+    uint64_t start;
+    uint64_t end;
+    uint32_t baud_rate;
+    uint8_t value;
+  };
+
+  Clock &clock_;
+  std::vector<Station *> stations_;
+  uint32_t baud_rate_{2400};
+  uint64_t tx_end_{0};
+  std::deque<WireByte> to_stations_;
+  std::deque<WireByte> to_master_;  // ordered by end
+  std::deque<uint8_t> rx_;
+};
+
+}  // namespace sim
+}  // namespace sensostar
+}  // namespace esphome
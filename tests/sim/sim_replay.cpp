@@ -0,0 +1,74 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "replay.h"
+#include "trace.h"
+
+// Replays a bus trace, a device log taken with `trace: true` or one written by bench_sim --trace,
+// and prints every decoded readout. With --bench N the trace is decoded N times for the throughput.
+// Usage: sim_replay [--quiet] [--bench N] trace.log
+// Exits with 1 if the trace holds no readout.
+
+using namespace esphome::sensostar;
+
+int main(int argc, char **argv) {
+    const char *path = nullptr;
+    unsigned long bench = 0;
+    bool quiet = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc)
+            bench = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--quiet") == 0)
+            quiet = true;
+        else
+            path = argv[i];
+    }
+    if (path == nullptr) {
+        fprintf(stderr, "Usage: %s [--quiet] [--bench N] trace.log\n", argv[0]);
+        return 2;
+    }
+    FILE *file = fopen(path, "r");
+    if (file == nullptr) {
+        fprintf(stderr, "Can't read %s\n", path);
+        return 2;
+    }
+    std::vector<sim::TraceEntry> trace = sim::read_trace(file);
+    fclose(file);
+
+    sim::ReplayResult result = sim::replay(trace, [quiet](uint32_t time, uint8_t address, const mbus::FixedHeader &header,
+                                                          const mbus::Readout &readout) {
+        if (quiet)
+            return;
+        printf("%8u 0x%02X %08X #%-3u", (unsigned) time, address, (unsigned) header.id, header.access_number);
+        static const struct {
+            mbus::Quantity quantity;
+            const char *name;
+        } COLUMNS[] = {
+            {mbus::Quantity::ENERGY, "energy"},
+            {mbus::Quantity::VOLUME, "volume"},
+            {mbus::Quantity::POWER, "power"},
+            {mbus::Quantity::VOLUME_FLOW, "flow"},
+            {mbus::Quantity::TEMPERATURE_FLOW, "t_flow"},
+            {mbus::Quantity::TEMPERATURE_RETURN, "t_return"},
+        };
+        for (const auto &column : COLUMNS) {
+            if (readout.has(column.quantity))
+                printf(" %s=%g", column.name, readout.get(column.quantity));
+        }
+        printf("\n");
+    });
+    printf("%u requests, %u acknowledges, %u frames, %u readouts, %u errors, %u timeouts\n", result.requests,
+           result.acks, result.frames, result.readouts, result.errors, result.timeouts);
+
+    if (bench > 0) {
+        auto start = std::chrono::steady_clock::now();
+        uint32_t readouts = 0;
+        for (unsigned long i = 0; i < bench; i++)
+            readouts += sim::replay(trace).readouts;
+        double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("Replayed %lu times: %.1f MB/s, %.0f readouts/s\n", bench, result.bytes * bench / s / 1e6, readouts / s);
+    }
+    return result.readouts > 0 ? 0 : 1;
+}
@@ -0,0 +1,123 @@
+#include "simulation.h"
+
+#include <algorithm>
+
+namespace esphome {
+namespace sensostar {
+namespace sim {
+
+bool SimUart::bus_read(uint8_t *data, size_t len) {
+    size_t n = this->bus_.read(data, len);
+    this->bytes_ += n;
+    return n == len;
+}
+
+void SimUart::bus_write(const uint8_t *data, size_t len) {
+    this->bus_.write(data, len);
+    if (this->tx_fifo_ == 0)
+        return;
+    const uint64_t fifo_time = this->tx_fifo_ * byte_time_us(this->bus_.baud_rate());
+    if (this->bus_.tx_end() > this->clock_.us + fifo_time)
+        this->clock_.us = this->bus_.tx_end() - fifo_time;
+}
+
+VirtualMeter *Simulation::add_meter(uint8_t address, uint32_t id, uint32_t seed) {
+    this->meters_.emplace_back(new VirtualMeter(this->bus, address, id, seed));
+    return this->meters_.back().get();
+}
+
+SimMeter *Simulation::add_master_meter(uint8_t address, uint32_t id) {
+    SimMeter *meter = new SimMeter(this->master_meters_.size());
+    this->master_meters_.emplace_back(meter);
+    if (address == mbus::ADDRESS_SECONDARY)
+        meter->set_secondary_address(id);
+    else
+        meter->set_address(address);
+    this->master.add_meter(meter);
+    return meter;
+}
+
+Counters Simulation::counters() {
+    BusStats &stats = this->master.get_stats();
+    Counters counters;
+    counters.bytes = this->uart.bytes();
+    counters.frames = stats.get(COUNTER_FRAMES);
+    counters.acks = stats.get(COUNTER_ACKS);
+    counters.errors = stats.get(COUNTER_ERROR_START) + stats.get(COUNTER_ERROR_LENGTH) + stats.get(COUNTER_ERROR_STOP) +
+                      stats.get(COUNTER_ERROR_CHECKSUM);
+    counters.unknown_frames = stats.get(COUNTER_UNKNOWN_FRAMES);
+    counters.timeouts = stats.get(COUNTER_TIMEOUTS);
+    counters.retries = stats.get(COUNTER_RETRIES);
+    counters.cycles = this->cycles_;
+    counters.cycle_time = this->cycle_time_;
+    counters.cycle_time_max = this->cycle_time_max_;
+    counters.cycle_loop_max = this->cycle_loop_max_;
+    return counters;
+}
+
+void Simulation::on_readout(BusMeter *bus_meter, const mbus::RspUdDecoder &decoder, uint32_t /*now*/) {
+    SimMeter *meter = static_cast<SimMeter *>(bus_meter);
+    meter->readouts++;
+    meter->header = decoder.header();
+    if (this->on_readout_)
+        this->on_readout_(meter->index, decoder.header(), decoder.readout());
+}
+
+void Simulation::on_unavailable(BusMeter *meter) { static_cast<SimMeter *>(meter)->unavailable++; }
+
+void Simulation::on_cycle(const PollCycle &cycle) {
+    this->cycles_++;
+    this->cycle_time_ += cycle.duration;
+    this->cycle_time_max_ = std::max(this->cycle_time_max_, cycle.duration);
+    this->cycle_loop_max_ = std::max(this->cycle_loop_max_, cycle.loop_time_max);
+}
+
+bool Simulation::on_bus_free(uint32_t now) {
+    if (this->external_.empty())
+        return false;
+    // Like GatewayClient::request_address(): a long frame carries the address in its A field at index 5,
+    // a short one at index 2, a single character has none
+    const std::vector<uint8_t> &frame = this->external_;
+    uint16_t address = mbus::ADDRESS_NONE;
+    if (frame[0] == mbus::FRAME_START_SHORT && frame.size() >= 3)
+        address = frame[2];
+    else if (frame[0] == mbus::FRAME_START_LONG && frame.size() >= 6)
+        address = frame[5];
+    this->master.send_external(this->external_.data(), this->external_.size(), address, now);
+    this->external_.clear();
+    return true;
+}
+
+bool Simulation::run_until(uint32_t until) {
+    const uint64_t end = until * 1000ull;
+    while (true) {
+        uint64_t next = this->bus.next_event();
+        uint32_t wakeup;
+        if (this->master.next_wakeup(wakeup))
+            next = std::min<uint64_t>(next, wakeup * 1000ull);
+        // A waiting gateway frame goes out on the next loop()
+        if (!this->external_.empty())
+            next = std::min(next, this->clock.us);
+        if (next == NEVER)
+            return true;
+        // The next loop() at or after the event
+        next = std::max(next, this->clock.us + 1);
+        next = (next + this->loop_period_ - 1) / this->loop_period_ * this->loop_period_;
+        if (next > end) {
+            this->clock.us = end;
+            return false;
+        }
+        this->clock.us = next;
+        this->bus.run();
+        this->master.loop();
+    }
+}
+
+bool Simulation::poll(uint32_t limit) {
+    this->master.update();
+    return this->run_until(this->clock.millis() + limit);
+}
+
+}  // namespace sim
+}  // namespace sensostar
+}  // namespace esphome
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "bus_master.h"
+#include "sim_bus.h"
+#include "trace.h"
+#include "virtual_meter.h"
+
+// The component's bus master (bus_master.h) and virtual meters on one simulated bus. Time jumps
+// from one event to the next, loop() runs on a fixed period like on the device.
+
+namespace esphome {
+namespace sensostar {
+namespace sim {
+
+// A meter of the master's configuration, with the bus state the tests look at
+class SimMeter : public BusMeter {
+ public:
+  explicit SimMeter(size_t index) : index(index) {}
+
+  bool initialized() const { return this->is_initialized(); }
+  uint32_t retry_after() const { return this->retry_after_; }
+  uint32_t baud_rate() const { return this->baud_rate_; }
+  uint8_t baud_attempts() const { return this->baud_attempts_; }
+  bool selective() const { return this->selective_; }
+
+  const size_t index;
+  uint32_t readouts{0};
+  uint32_t unavailable{0};  // BusListener::on_unavailable(), invalid answers and exhausted retries
+  mbus::FixedHeader header{};
+};
+
+// The master's UART on the simulated bus
+class SimUart : public BusUart {
+ public:
+  SimUart(Bus &bus, Clock &clock) : bus_(bus), clock_(clock) {}
+
+  // Hardware FIFO of a UART driver without a transmit buffer: a write returns once the bytes that
+  // don't fit have gone out, the time passes inside the caller's loop(). 0 never blocks.
+  void set_tx_fifo(size_t size) { this->tx_fifo_ = size; }
+
+  size_t bus_available() override { return this->bus_.available(); }
+  bool bus_read(uint8_t *data, size_t len) override;
+  void bus_write(const uint8_t *data, size_t len) override;
+  void bus_set_baud_rate(uint32_t baud_rate) override { this->bus_.set_baud_rate(baud_rate); }
+
+  uint64_t bytes() const { return this->bytes_; }
+
+ protected:
+  Bus &bus_;
+  Clock &clock_;
+  size_t tx_fifo_{0};
+  uint64_t bytes_{0};  // received
+};
+
+struct Counters {
+  uint64_t bytes{0};  // received
+  uint32_t frames{0};
+  uint32_t acks{0};
+  uint32_t errors{0};  // start, length, stop and checksum errors
+  uint32_t unknown_frames{0};
+  uint32_t timeouts{0};
+  uint32_t retries{0};
+  uint32_t cycles{0};
+  uint64_t cycle_time{0};  // ms over all completed poll cycles
+  uint32_t cycle_time_max{0};
+  uint32_t cycle_loop_max{0};  // us, longest BusMaster::loop() of any cycle
+};
+
+class Simulation : protected BusListener {
+ public:
+  using ReadoutCallback = std::function<void(size_t meter, const mbus::FixedHeader &, const mbus::Readout &)>;
+
+  Clock clock;
+  Bus bus{clock};
+  SimUart uart{bus, clock};
+  BusMaster master{&uart, &clock, this};
+
+  ~Simulation() { set_bus_trace(nullptr); }
+
+  // Period of loop() in us; 1 ms is the best case on the device, a busy loop takes longer
+  void set_loop_period(uint32_t us) { this->loop_period_ = us; }
+
+  // Virtual meter on the bus
+  VirtualMeter *add_meter(uint8_t address, uint32_t id, uint32_t seed = 1);
+  VirtualMeter *meter(size_t index) { return this->meters_[index].get(); }
+  // Meter the master polls: a primary address, or mbus::ADDRESS_SECONDARY and the ID, which may contain wildcards
+  SimMeter *add_master_meter(uint8_t address, uint32_t id = 0);
+  SimMeter *master_meter(size_t index) { return this->master_meters_[index].get(); }
+
+  void set_readout_callback(ReadoutCallback callback) { this->on_readout_ = std::move(callback); }
+  // Frame of a gateway client, sent through BusMaster::send_external() once the bus is free; run_until()
+  // alone puts it on the bus without a poll cycle
+  void send_external(const uint8_t *frame, size_t len) { this->external_.assign(frame, frame + len); }
+  // Bus trace of the master (bus_trace.h), one per process
+  void set_trace(TraceWriter *trace) { set_bus_trace(trace); }
+  // Bus statistics of the master and the poll cycles completed
+  Counters counters();
+
+  // Runs loop() until nothing is left to do or `until` (ms) is reached, false in the latter case
+  bool run_until(uint32_t until);
+  // One poll cycle: update(), then run until the master is idle, at most `limit` ms
+  bool poll(uint32_t limit = 60000);
+
+ protected:
+  void on_readout(BusMeter *meter, const mbus::RspUdDecoder &decoder, uint32_t now) override;
+  void on_unavailable(BusMeter *meter) override;
+  void on_cycle(const PollCycle &cycle) override;
+  bool on_bus_free(uint32_t now) override;
+
+  uint32_t loop_period_{1000};
+  std::vector<std::unique_ptr<VirtualMeter>> meters_;
+  std::vector<std::unique_ptr<SimMeter>> master_meters_;
+  ReadoutCallback on_readout_;
+  std::vector<uint8_t> external_;
+  uint32_t cycles_{0};
+  uint64_t cycle_time_{0};
+  uint32_t cycle_time_max_{0};
+  uint32_t cycle_loop_max_{0};
+};
+
+}  // namespace sim
+}  // namespace sensostar
+}  // namespace esphome
@@ -0,0 +1,155 @@
+#include "trace.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+namespace esphome {
+namespace sensostar {
+namespace sim {
+
+static const char *const TRACE_NAMES[] = {"TX", "RX", "BAUD", "TIMEOUT"};
+static const char *const TRACE_TAG = "sensostar.trace";
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+void TraceWriter::write(TraceEvent event, uint32_t now, const uint8_t *data, size_t len) {
+    char line[2 * TRACE_BYTES_PER_LINE + 32];
+    size_t pos = 0;
+    do {
+        int n = snprintf(line, sizeof(line), "%u %s ", (unsigned) now, TRACE_NAMES[(uint8_t) event]);
+        for (size_t i = 0; i < TRACE_BYTES_PER_LINE && pos < len; i++, pos++) {
+            line[n++] = HEX_DIGITS[data[pos] >> 4];
+            line[n++] = HEX_DIGITS[data[pos] & 0x0F];
+        }
+        line[n] = '\0';
+        this->line_(line);
+    } while (pos < len);
+}
+
+void TraceWriter::write(TraceEvent event, uint32_t now, uint32_t value) {
+    char line[48];
+    snprintf(line, sizeof(line), "%u %s %u", (unsigned) now, TRACE_NAMES[(uint8_t) event], (unsigned) value);
+    this->line_(line);
+}
+
+void TraceWriter::line_(const char *line) {
+    if (this->file_ != nullptr) {
+        fprintf(this->file_, "%s\n", line);
+        return;
+    }
+    this->text_ += line;
+    this->text_ += '\n';
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+bool parse_trace_line(const char *line, TraceEntry &entry) {
+    // Device log: "[12:00:00][I][sensostar.trace:024]: 1234 RX 6868...", possibly colored
+    const char *p = strstr(line, TRACE_TAG);
+    if (p != nullptr) {
+        p = strstr(p, ": ");
+        if (p == nullptr)
+            return false;
+        p += 2;
+    } else {
+        p = line;
+    }
+    if (!isdigit((unsigned char) *p))
+        return false;
+    char *end;
+    entry.time = strtoul(p, &end, 10);
+    p = end;
+    while (*p == ' ')
+        p++;
+
+    uint8_t event = 0;
+    size_t name_len = 0;
+    for (; event < sizeof(TRACE_NAMES) / sizeof(TRACE_NAMES[0]); event++) {
+        name_len = strlen(TRACE_NAMES[event]);
+        if (strncmp(p, TRACE_NAMES[event], name_len) == 0 && p[name_len] == ' ')
+            break;
+    }
+    if (event == sizeof(TRACE_NAMES) / sizeof(TRACE_NAMES[0]))
+        return false;
+    entry.event = (TraceEvent) event;
+    p += name_len + 1;
+
+    entry.data.clear();
+    entry.value = 0;
+    if (entry.event == TraceEvent::BAUD || entry.event == TraceEvent::TIMEOUT) {
+        if (!isdigit((unsigned char) *p))
+            return false;
+        entry.value = strtoul(p, nullptr, 10);
+        return true;
+    }
+    for (; hex_digit(p[0]) >= 0 && hex_digit(p[1]) >= 0; p += 2)
+        entry.data.push_back((uint8_t) (hex_digit(p[0]) << 4 | hex_digit(p[1])));
+    return true;
+}
+
+// Appends the entry, or its data to the previous entry it continues
+static void add_entry(std::vector<TraceEntry> &entries, const TraceEntry &entry) {
+    if (!entries.empty()) {
+        TraceEntry &previous = entries.back();
+        if (previous.time == entry.time && previous.event == entry.event && entry.event == TraceEvent::TX &&
+            previous.data.size() % TRACE_BYTES_PER_LINE == 0) {
+            previous.data.insert(previous.data.end(), entry.data.begin(), entry.data.end());
+            return;
+        }
+    }
+    entries.push_back(entry);
+}
+
+std::vector<TraceEntry> read_trace(FILE *file) {
+    std::vector<TraceEntry> entries;
+    char line[1024];
+    TraceEntry entry;
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        if (parse_trace_line(line, entry))
+            add_entry(entries, entry);
+    }
+    return entries;
+}
+
+static TraceWriter *bus_trace = nullptr;
+
+void set_bus_trace(TraceWriter *trace) { bus_trace = trace; }
+
+std::vector<TraceEntry> read_trace(const std::string &text) {
+    std::vector<TraceEntry> entries;
+    TraceEntry entry;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        if (end == std::string::npos)
+            end = text.size();
+        if (parse_trace_line(text.substr(start, end - start).c_str(), entry))
+            add_entry(entries, entry);
+        start = end + 1;
+    }
+    return entries;
+}
+
+}  // namespace sim
+
+// TraceEvent and sim::TraceEvent share the order
+void trace_bus(TraceEvent event, uint32_t now, const uint8_t *data, size_t len) {
+    if (sim::bus_trace != nullptr)
+        sim::bus_trace->write((sim::TraceEvent) event, now, data, len);
+}
+
+void trace_bus(TraceEvent event, uint32_t now, uint32_t value) {
+    if (sim::bus_trace != nullptr)
+        sim::bus_trace->write((sim::TraceEvent) event, now, value);
+}
+
+}  // namespace sensostar
+}  // namespace esphome
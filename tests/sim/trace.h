@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "bus_trace.h"
+
+// Bus traces in the format of the component's `trace: true` option (bus_trace.h):
+// lines "<ms> <event> <hex or value>", as logged on the device or written by the simulation
+
+namespace esphome {
+namespace sensostar {
+namespace sim {
+
+enum class TraceEvent : uint8_t {
+  TX = 0,   // request handed to the transmitter, complete frame
+  RX,       // bytes as read from the UART
+  BAUD,     // UART switched, value is the new baud rate
+  TIMEOUT,  // response timeout expired
+};
+
+struct TraceEntry {
+  uint32_t time;
+  TraceEvent event;
+  std::vector<uint8_t> data;  // TX and RX
+  uint32_t value;             // BAUD and TIMEOUT
+};
+
+// Writes trace lines to a file, or to a string when no file is given
+class TraceWriter {
+ public:
+  explicit TraceWriter(FILE *file = nullptr) : file_(file) {}
+  void write(TraceEvent event, uint32_t now, const uint8_t *data, size_t len);
+  void write(TraceEvent event, uint32_t now, uint32_t value);
+  const std::string &text() const { return this->text_; }
+
+ protected:
+  void line_(const char *line);
+
+  FILE *file_;
+  std::string text_;
+};
+
+// Sink of the master's trace_bus() calls (bus_trace.h), which the host build defines in trace.cpp
+// instead of logging them. nullptr drops the trace.
+void set_bus_trace(TraceWriter *trace);
+
+// Parses one trace line. Device log lines are accepted as they are: everything up to the
+// "sensostar.trace" tag and its ": " is skipped. False for lines with other tags.
+bool parse_trace_line(const char *line, TraceEntry &entry);
+
+// Reads a whole trace, joining data continued over several lines
+std::vector<TraceEntry> read_trace(FILE *file);
+std::vector<TraceEntry> read_trace(const std::string &text);
+
+}  // namespace sim
+}  // namespace sensostar
+}  // namespace esphome
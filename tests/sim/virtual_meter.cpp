@@ -0,0 +1,219 @@
+#include "virtual_meter.h"
+
+#include <cstring>
+
+#include "frames.h"
+#include "mbus_scan.h"
+#include "sensostar_protocol.h"
+
+namespace esphome {
+namespace sensostar {
+namespace sim {
+
+// A request with a longer gap between two of its bytes is dropped
+static const uint64_t METER_BYTE_GAP = 50000;
+
+// Record of test::SAMPLE_RECORDS each item of the readout request is answered with, as assumed by
+// READOUT_ITEMS. Only the full request also returns the stored energy.
+struct ItemRecord {
+    uint8_t item;
+    uint8_t offset;
+    uint8_t size;
+};
+static const ItemRecord ITEM_RECORDS[] = {
+    {0x02, 0, 6}, {0x03, 6, 6}, {0x04, 12, 4}, {0x06, 16, 4}, {0x05, 20, 4},
+    {0x07, 24, 4}, {0x08, 28, 4}, {0x09, 32, 6}, {0x0B, 44, 4},
+};
+
+VirtualMeter::VirtualMeter(Bus &bus, uint8_t address, uint32_t id, uint32_t seed)
+    : bus_(bus), address_(address), id_(id), rng_state_(seed | 1) {
+    bus.attach(this);
+}
+
+float VirtualMeter::random_() {
+    // xorshift32
+    this->rng_state_ ^= this->rng_state_ << 13;
+    this->rng_state_ ^= this->rng_state_ >> 17;
+    this->rng_state_ ^= this->rng_state_ << 5;
+    return (this->rng_state_ >> 8) / 16777216.0f;
+}
+
+void VirtualMeter::power_cycle() {
+    this->baud_rate_ = 2400;
+    this->selected_ = false;
+    this->fcb_valid_ = false;
+    this->rx_length_ = 0;
+}
+
+void VirtualMeter::on_byte(uint8_t c, uint64_t at) {
+    if (this->rx_length_ > 0 && at - this->rx_last_ > METER_BYTE_GAP)
+        this->rx_length_ = 0;
+    this->rx_last_ = at;
+    if (this->rx_length_ == 0 && c != mbus::FRAME_START_SHORT && c != mbus::FRAME_START_LONG)
+        return;
+    this->rx_[this->rx_length_++] = c;
+
+    size_t expected = this->rx_[0] == mbus::FRAME_START_SHORT ? 5 : this->rx_length_ < 2 ? 0 : this->rx_[1] + 6;
+    if (expected == 0 || this->rx_length_ < expected)
+        return;
+    this->rx_length_ = 0;
+    this->handle_request_(at);
+}
+
+bool VirtualMeter::addressed_(uint8_t address) const {
+    return address == this->address_ || address == mbus::ADDRESS_BROADCAST_REPLY ||
+           (address == mbus::ADDRESS_SECONDARY && this->selected_);
+}
+
+void VirtualMeter::handle_request_(uint64_t at) {
+    // Frames with a wrong checksum or stop byte are ignored, like by a real meter
+    if (this->rx_[0] == mbus::FRAME_START_SHORT) {
+        if (this->rx_[4] != mbus::FRAME_STOP || (uint8_t) (this->rx_[1] + this->rx_[2]) != this->rx_[3])
+            return;
+        const uint8_t control = this->rx_[1];
+        if (!this->addressed_(this->rx_[2]))
+            return;
+        this->requests_++;
+        if (control == mbus::C_SND_NKE) {
+            // To the secondary address it also ends the selection
+            this->fcb_valid_ = false;
+            if (this->rx_[2] == mbus::ADDRESS_SECONDARY)
+                this->selected_ = false;
+            this->ack_(at);
+        } else if ((control & ~mbus::C_FCB) == mbus::C_REQ_UD2) {
+            // Every item, like the full readout request
+            this->readout_(control, POLL_PAYLOAD + POLL_HEADER_SIZE, sizeof(POLL_PAYLOAD) - POLL_HEADER_SIZE, at);
+        }
+        return;
+    }
+    this->handle_long_frame_(at);
+}
+
+void VirtualMeter::handle_long_frame_(uint64_t at) {
+    const uint8_t length = this->rx_[1];
+    if (this->rx_[2] != length || this->rx_[3] != mbus::FRAME_START_LONG || length < 3 ||
+        this->rx_[length + 5] != mbus::FRAME_STOP)
+        return;
+    uint8_t checksum = 0;
+    for (size_t i = 4; i < length + 4u; i++)
+        checksum += this->rx_[i];
+    if (checksum != this->rx_[length + 4])
+        return;
+
+    const uint8_t control = this->rx_[4];
+    const uint8_t address = this->rx_[5];
+    const uint8_t ci = this->rx_[6];
+    const uint8_t *payload = &this->rx_[7];
+    const size_t len = length - 3;
+    if ((control & ~mbus::C_FCB) != mbus::C_SND_UD)
+        return;
+
+    if (address == mbus::ADDRESS_SECONDARY && ci == mbus::CI_SELECT) {
+        // ID LSB first, manufacturer, version and medium are not checked
+        if (len < 4)
+            return;
+        uint32_t mask = payload[0] | payload[1] << 8 | payload[2] << 16 | (uint32_t) payload[3] << 24;
+        this->selected_ = mbus::id_matches(mask, this->id_);
+        if (this->selected_) {
+            this->requests_++;
+            this->ack_(at);
+        }
+        return;
+    }
+
+    if (ci >= mbus::CI_BAUD_RATE_300 && ci <= mbus::CI_BAUD_RATE_300 + 7) {
+        if (!this->baud_switch_)
+            return;
+        if (address == mbus::ADDRESS_BROADCAST) {
+            this->baud_rate_ = 300 << (ci - mbus::CI_BAUD_RATE_300);
+            return;
+        }
+        if (!this->addressed_(address))
+            return;
+        // Acknowledged at the old rate
+        this->requests_++;
+        this->ack_(at);
+        this->baud_rate_ = 300 << (ci - mbus::CI_BAUD_RATE_300);
+        return;
+    }
+
+    if (!this->addressed_(address) || ci != mbus::CI_DATA_SEND)
+        return;
+    this->requests_++;
+    if (len >= POLL_HEADER_SIZE && memcmp(payload, POLL_PAYLOAD, POLL_HEADER_SIZE) == 0)
+        this->readout_(control, payload + POLL_HEADER_SIZE, len - POLL_HEADER_SIZE, at);
+    else
+        this->ack_(at);  // init sequence
+}
+
+void VirtualMeter::readout_(uint8_t control, const uint8_t *items, size_t count, uint64_t at) {
+    if (this->random_() < this->faults_.no_reply)
+        return;
+    // The frame count bit is only followed for readouts, the init sequence does not toggle it
+    const bool fcb = control & mbus::C_FCB;
+    if (this->fcb_valid_ && fcb == this->fcb_ && this->last_frame_size_ > 0) {
+        // The master did not get the last answer: the same readout again
+        this->repeats_++;
+        this->reply_(this->last_frame_, this->last_frame_size_, at);
+        return;
+    }
+    this->fcb_valid_ = true;
+    this->fcb_ = fcb;
+    this->energy_ += this->energy_step_;
+    this->access_number_++;
+    this->readouts_++;
+
+    uint8_t payload[mbus::FIXED_HEADER_LENGTH + sizeof(test::SAMPLE_RECORDS)];
+    memcpy(payload, test::SAMPLE_HEADER, mbus::FIXED_HEADER_LENGTH);
+    for (int i = 0; i < 4; i++)
+        payload[i] = this->id_ >> (8 * i);
+    payload[8] = this->access_number_;
+    size_t len = mbus::FIXED_HEADER_LENGTH;
+    if (count == sizeof(POLL_PAYLOAD) - POLL_HEADER_SIZE && memcmp(items, POLL_PAYLOAD + POLL_HEADER_SIZE, count) == 0) {
+        memcpy(payload + len, test::SAMPLE_RECORDS, sizeof(test::SAMPLE_RECORDS));
+        len += sizeof(test::SAMPLE_RECORDS);
+    }
+    else {
+        for (const ItemRecord &record : ITEM_RECORDS) {
+            if (memchr(items, record.item, count) == nullptr)
+                continue;
+            memcpy(payload + len, test::SAMPLE_RECORDS + record.offset, record.size);
+            len += record.size;
+        }
+    }
+    // The energy is the first record, INT32
+    if (len > mbus::FIXED_HEADER_LENGTH && payload[mbus::FIXED_HEADER_LENGTH + 1] == 0x06) {
+        uint8_t *energy = payload + mbus::FIXED_HEADER_LENGTH + 2;
+        for (int i = 0; i < 4; i++)
+            energy[i] = this->energy_ >> (8 * i);
+    }
+    this->last_frame_size_ = mbus::build_long_frame(this->last_frame_, sizeof(this->last_frame_), mbus::C_RSP_UD,
+                                                    this->address_, mbus::CI_RSP_UD, payload, len);
+    this->reply_(this->last_frame_, this->last_frame_size_, at);
+}
+
+void VirtualMeter::ack_(uint64_t at) {
+    if (this->random_() < this->faults_.no_reply)
+        return;
+    this->reply_(&mbus::FRAME_ACK, 1, at);
+}
+
+void VirtualMeter::reply_(const uint8_t *data, size_t len, uint64_t at) {
+    uint32_t latency = this->faults_.latency;
+    if (this->faults_.jitter > 0)
+        latency += (uint32_t) (this->random_() * (this->faults_.jitter + 1));
+    const uint64_t byte_time = byte_time_us(this->baud_rate_);
+    uint64_t start = at + latency * 1000ull;
+    for (size_t i = 0; i < len; i++, start += byte_time) {
+        if (this->faults_.drop_byte > 0 && this->random_() < this->faults_.drop_byte)
+            continue;
+        uint8_t c = data[i];
+        if (this->faults_.corrupt_byte > 0 && this->random_() < this->faults_.corrupt_byte)
+            c ^= 1 << (this->rng_state_ & 7);
+        this->bus_.send(c, this->baud_rate_, start);
+    }
+}
+
+}  // namespace sim
+}  // namespace sensostar
+}  // namespace esphome
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "mbus_frame.h"
+#include "sim_bus.h"
+
+// Simulated SensoStar meter: answers the init sequence with acknowledges and the readout request
+// with a RSP_UD frame of the requested items, and takes secondary address selection and baud rate
+// switches
+
+namespace esphome {
+namespace sensostar {
+namespace sim {
+
+// Faults injected into the answers, drawn from the meter's own random sequence
+struct MeterFaults {
+  uint32_t latency{30};       // ms from the end of the request to the first response byte
+  uint32_t jitter{0};         // ms added at random to the latency
+  float no_reply{0.0f};       // probability a request is not answered
+  float drop_byte{0.0f};      // probability per response byte that it is lost
+  float corrupt_byte{0.0f};   // probability per response byte that a bit flips
+};
+
+class VirtualMeter : public Station {
+ public:
+  VirtualMeter(Bus &bus, uint8_t address, uint32_t id, uint32_t seed = 1);
+
+  void set_faults(const MeterFaults &faults) { this->faults_ = faults; }
+  // Consumption added between two readouts
+  void set_energy_step(uint32_t step) { this->energy_step_ = step; }
+
+  // A meter without the baud rate switch ignores CI 0xB8 to 0xBF
+  void set_baud_switch(bool supported) { this->baud_switch_ = supported; }
+  // Rate kept from an earlier session, e.g. one before the master rebooted
+  void set_baud_rate(uint32_t baud_rate) { this->baud_rate_ = baud_rate; }
+
+  // Back to the power-on state: 2400 baud, not selected, the next readout request is a new one
+  void power_cycle();
+
+  void on_byte(uint8_t c, uint64_t at) override;
+  uint32_t baud_rate() const override { return this->baud_rate_; }
+
+  uint32_t id() const { return this->id_; }
+  // Energy and access number of the last new readout
+  uint32_t energy() const { return this->energy_; }
+  uint8_t access_number() const { return this->access_number_; }
+  // Readout requests answered with a new readout, and with the last one again (same FCB)
+  uint32_t readouts() const { return this->readouts_; }
+  uint32_t repeats() const { return this->repeats_; }
+  uint32_t requests() const { return this->requests_; }
+
+ protected:
+  void handle_request_(uint64_t at);
+  void handle_long_frame_(uint64_t at);
+  // items: list of the readout request after its header
+  void readout_(uint8_t control, const uint8_t *items, size_t count, uint64_t at);
+  void reply_(const uint8_t *data, size_t len, uint64_t at);
+  void ack_(uint64_t at);
+  bool addressed_(uint8_t address) const;
+  float random_();
+
+  Bus &bus_;
+  uint8_t address_;
+  uint32_t id_;
+  uint32_t rng_state_;
+  MeterFaults faults_;
+  uint32_t baud_rate_{2400};
+  bool baud_switch_{true};
+  bool selected_{false};
+
+  uint8_t rx_[mbus::MAX_FRAME_LENGTH];
+  size_t rx_length_{0};
+  uint64_t rx_last_{0};
+
+  uint32_t energy_{12345};
+  uint32_t energy_step_{1};
+  uint8_t access_number_{0};
+  // Frame count bit of the last readout request, false after SND_NKE until the next request
+  bool fcb_valid_{false};
+  bool fcb_{false};
+  uint8_t last_frame_[mbus::MAX_FRAME_LENGTH];
+  size_t last_frame_size_{0};
+
+  uint32_t readouts_{0};
+  uint32_t repeats_{0};
+  uint32_t requests_{0};
+};
+
+}  // namespace sim
+}  // namespace sensostar
+}  // namespace esphome
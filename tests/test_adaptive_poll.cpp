@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <cmath>
+
+#include "adaptive_poll.h"
+#include "test_util.h"
+
+using namespace esphome::sensostar;
+
+static const uint32_t SECOND = 1000;
+static const uint32_t MINUTE = 60 * SECOND;
+
+// Readings at a time in ms
+using Readings = void (*)(uint32_t now, float values[ADAPTIVE_INPUT_COUNT]);
+
+// The schedule of SensoStarMeter: a poll is spent when it is due and its readout arrives at once
+struct Scheduler {
+    AdaptivePoll poll;
+    uint32_t next_poll{0};
+    uint32_t polls{0};
+    uint32_t max_interval_seen{0};
+    uint32_t min_interval_seen{UINT32_MAX};
+
+    // Polls from start until end, the intervals seen are only recorded from start on
+    void run(Readings readings, uint32_t start, uint32_t end) {
+        this->max_interval_seen = 0;
+        this->min_interval_seen = UINT32_MAX;
+        while (this->next_poll < end) {
+            const uint32_t now = this->next_poll;
+            this->poll.spend(now);
+            this->polls++;
+            float values[ADAPTIVE_INPUT_COUNT];
+            readings(now, values);
+            this->poll.update(values, now);
+            const uint32_t interval = this->poll.interval(now);
+            this->next_poll = now + interval;
+            if (now >= start) {
+                this->max_interval_seen = std::max(this->max_interval_seen, interval);
+                this->min_interval_seen = std::min(this->min_interval_seen, interval);
+            }
+        }
+    }
+};
+
+static void steady(uint32_t, float values[ADAPTIVE_INPUT_COUNT]) {
+    values[ADAPTIVE_FLOW] = 0.0f;
+    values[ADAPTIVE_POWER] = 0.0f;
+    values[ADAPTIVE_TEMPERATURE_DIFF] = 2.0f;
+}
+
+// Power switching on and off between two readouts
+static void changing(uint32_t, float values[ADAPTIVE_INPUT_COUNT]) {
+    static bool on = false;
+    on = !on;
+    values[ADAPTIVE_FLOW] = 0.0f;
+    values[ADAPTIVE_POWER] = on ? 8000.0f : 0.0f;
+    values[ADAPTIVE_TEMPERATURE_DIFF] = NAN;
+}
+
+// Heating burst from minute 60 to 90: power ramps up over 5 minutes, holds, then drops
+static void burst(uint32_t now, float values[ADAPTIVE_INPUT_COUNT]) {
+    const float minute = now / (float) MINUTE;
+    float power = 0.0f;
+    if (minute >= 60 && minute < 65)
+        power = 8000.0f * (minute - 60) / 5;
+    else if (minute >= 65 && minute < 90)
+        power = 8000.0f + 500.0f * std::sin(minute);
+    values[ADAPTIVE_FLOW] = power > 0 ? power / 12000.0f : 0.0f;
+    values[ADAPTIVE_POWER] = power;
+    values[ADAPTIVE_TEMPERATURE_DIFF] = power > 0 ? 10.0f : 0.0f;
+}
+
+static void configure(AdaptivePoll &poll) {
+    poll.set_min_interval(10 * SECOND);
+    poll.set_max_interval(5 * MINUTE);
+    poll.set_threshold(ADAPTIVE_FLOW, 0.05f);
+    poll.set_threshold(ADAPTIVE_POWER, 200.0f);
+    poll.set_threshold(ADAPTIVE_TEMPERATURE_DIFF, 1.0f);
+}
+
+static void test_intervals() {
+    AdaptivePoll poll;
+    configure(poll);
+    float values[ADAPTIVE_INPUT_COUNT];
+    // The minimum interval until the first readout, and after it
+    CHECK_EQ(poll.interval(0), 10 * SECOND);
+    steady(0, values);
+    poll.update(values, 0);
+    CHECK_EQ(poll.interval(0), 10 * SECOND);
+    // Doubling while steady, up to the maximum
+    uint32_t now = 0;
+    for (uint32_t expected : {20, 40, 80, 160, 300, 300}) {
+        now += poll.interval(now);
+        poll.update(values, now);
+        CHECK_EQ(poll.interval(now), expected * SECOND);
+    }
+    // Power rising by 2 kW in 5 minutes, faster than 200 W per minute
+    values[ADAPTIVE_POWER] = 2000.0f;
+    now += 5 * MINUTE;
+    poll.update(values, now);
+    CHECK_EQ(poll.interval(now), 10 * SECOND);
+
+    // Missing and unwatched readings do not count
+    poll.set_threshold(ADAPTIVE_TEMPERATURE_DIFF, 0.0f);
+    values[ADAPTIVE_POWER] = NAN;
+    values[ADAPTIVE_TEMPERATURE_DIFF] = 50.0f;
+    now += 10 * SECOND;
+    poll.update(values, now);
+    CHECK_EQ(poll.interval(now), 20 * SECOND);
+    // After reset() the next readout starts over at the minimum
+    poll.reset();
+    steady(now, values);
+    now += 20 * SECOND;
+    poll.update(values, now);
+    CHECK_EQ(poll.interval(now), 10 * SECOND);
+}
+
+static void test_burst() {
+    Scheduler scheduler;
+    configure(scheduler.poll);
+    // Steady at the maximum before the burst
+    scheduler.run(steady, 30 * MINUTE, 60 * MINUTE);
+    CHECK_EQ(scheduler.min_interval_seen, 5 * MINUTE);
+    // Fast polls while the power changes
+    scheduler.run(burst, 60 * MINUTE, 66 * MINUTE);
+    CHECK(scheduler.max_interval_seen <= 40 * SECOND);
+    // The burst ends at minute 90, from minute 100 on the interval is back at the maximum
+    scheduler.run(burst, 66 * MINUTE, 100 * MINUTE);
+    scheduler.run(burst, 100 * MINUTE, 130 * MINUTE);
+    CHECK_EQ(scheduler.min_interval_seen, 5 * MINUTE);
+}
+
+static void test_budget() {
+    Scheduler scheduler;
+    configure(scheduler.poll);
+    scheduler.poll.set_daily_budget(200);
+    // Readings that always change: only the budget limits the polls, an hour's share in a burst
+    scheduler.run(changing, 0, ADAPTIVE_DAY);
+    CHECK(scheduler.polls >= 200);
+    CHECK(scheduler.polls <= 200 + 200 / 24 + 1);
+    CHECK(scheduler.min_interval_seen == 10 * SECOND);
+    CHECK(scheduler.max_interval_seen >= ADAPTIVE_DAY / 200 - SECOND);
+
+    // Unlimited without a budget
+    Scheduler unlimited;
+    configure(unlimited.poll);
+    unlimited.run(changing, 0, 60 * MINUTE);
+    CHECK_EQ(unlimited.polls, 360u);
+}
+
+int main() {
+    test_intervals();
+    test_burst();
+    test_budget();
+    return TEST_RESULT();
+}
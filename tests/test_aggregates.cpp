@@ -0,0 +1,103 @@
+#include <cmath>
+
+#include "aggregates.h"
+#include "test_util.h"
+
+using namespace esphome::sensostar;
+
+static const uint32_t START = 1700000000;  // UNIX time
+
+static AggregateSample sample(double energy, double volume, float flow, float t_flow, float t_return) {
+    AggregateSample s;
+    s.energy = energy;
+    s.volume = volume;
+    s.flow = flow;
+    s.temperature_flow = t_flow;
+    s.temperature_return = t_return;
+    return s;
+}
+
+static void test_period() {
+    PeriodAggregate aggregate;
+    aggregate.start(1);
+    // Nothing known before the first readout
+    CHECK(std::isnan(aggregate.value(AGGREGATE_ENERGY)));
+    CHECK(std::isnan(aggregate.value(AGGREGATE_TEMPERATURE_FLOW_MIN)));
+    CHECK(std::isnan(aggregate.value(AGGREGATE_TEMPERATURE_RETURN_MEAN)));
+    CHECK_EQ(aggregate.value(AGGREGATE_OPERATING_HOURS), 0.0f);
+
+    aggregate.add(sample(1000, 50, 0.5f, 60, 40), START);
+    aggregate.add(sample(1002, 50.1, 0.0f, 70, NAN), START + 600);
+    aggregate.add(sample(1003, 50.2, 0.5f, 50, 30), START + 1200);
+    CHECK_NEAR(aggregate.value(AGGREGATE_ENERGY), 3.0, 1e-9);
+    CHECK_NEAR(aggregate.value(AGGREGATE_VOLUME), 0.2, 1e-6);
+    CHECK_EQ(aggregate.value(AGGREGATE_TEMPERATURE_FLOW_MIN), 50.0f);
+    CHECK_EQ(aggregate.value(AGGREGATE_TEMPERATURE_FLOW_MAX), 70.0f);
+    CHECK_NEAR(aggregate.value(AGGREGATE_TEMPERATURE_FLOW_MEAN), 60.0, 1e-6);
+    // The missing return temperature is not counted
+    CHECK_NEAR(aggregate.value(AGGREGATE_TEMPERATURE_RETURN_MEAN), 35.0, 1e-6);
+    // Flowing during the first interval only
+    CHECK_NEAR(aggregate.value(AGGREGATE_OPERATING_HOURS), 600 / 3600.0, 1e-6);
+
+    // A gap longer than AGGREGATE_MAX_GAP is not operating time
+    aggregate.add(sample(1004, 50.3, 0.5f, 50, 30), START + 1200 + AGGREGATE_MAX_GAP + 1);
+    CHECK_NEAR(aggregate.value(AGGREGATE_OPERATING_HOURS), 600 / 3600.0, 1e-6);
+}
+
+static void test_roll() {
+    PeriodAggregate aggregate;
+    aggregate.start(1);
+    aggregate.add(sample(1000, 50, 1.0f, 60, 40), START);
+    aggregate.add(sample(1010, 51, 1.0f, 60, 40), START + 300);
+    aggregate.roll(2);
+    CHECK_EQ(aggregate.key, 2u);
+    // The new period starts from the last counter values and keeps counting the running interval
+    CHECK_EQ(aggregate.value(AGGREGATE_ENERGY), 0.0f);
+    CHECK(std::isnan(aggregate.value(AGGREGATE_TEMPERATURE_FLOW_MAX)));
+    aggregate.add(sample(1015, 51.5, 1.0f, 60, 40), START + 600);
+    CHECK_NEAR(aggregate.value(AGGREGATE_ENERGY), 5.0, 1e-9);
+    CHECK_NEAR(aggregate.value(AGGREGATE_VOLUME), 0.5, 1e-6);
+    CHECK_NEAR(aggregate.value(AGGREGATE_OPERATING_HOURS), 300 / 3600.0, 1e-6);
+}
+
+// A day of 10 s readouts: the hourly deltas add up to the consumption of the day, the operating
+// hours to the time with flow
+static void test_day() {
+    PeriodAggregate hour, day;
+    hour.start(0);
+    day.start(0);
+    double energy = 45000.0, volume = 1200.0;
+    double energy_sum = 0, volume_sum = 0, hours_sum = 0;
+    for (uint32_t t = 0; t <= 24 * 3600; t += 10) {
+        const uint32_t h = t / 3600;
+        if (h != hour.key) {
+            energy_sum += hour.value(AGGREGATE_ENERGY);
+            volume_sum += hour.value(AGGREGATE_VOLUME);
+            hours_sum += hour.value(AGGREGATE_OPERATING_HOURS);
+            hour.roll(h);
+        }
+        // Heating for 20 minutes of every hour
+        const bool on = (t % 3600) < 1200;
+        const AggregateSample s = sample(energy, volume, on ? 0.6f : 0.0f, on ? 65 : 35, 30);
+        hour.add(s, START + t);
+        day.add(s, START + t);
+        if (on) {
+            energy += 0.002;
+            volume += 0.0017;
+        }
+    }
+    CHECK_NEAR(energy_sum, day.value(AGGREGATE_ENERGY), 1e-6);
+    CHECK_NEAR(volume_sum, day.value(AGGREGATE_VOLUME), 1e-6);
+    CHECK_NEAR(day.value(AGGREGATE_ENERGY), 24 * 120 * 0.002, 1e-6);
+    CHECK_NEAR(hours_sum, 8.0, 1e-4);
+    CHECK_NEAR(day.value(AGGREGATE_OPERATING_HOURS), 8.0, 1e-4);
+    CHECK_EQ(day.value(AGGREGATE_TEMPERATURE_FLOW_MIN), 35.0f);
+    CHECK_EQ(day.value(AGGREGATE_TEMPERATURE_FLOW_MAX), 65.0f);
+}
+
+int main() {
+    test_period();
+    test_roll();
+    test_day();
+    return TEST_RESULT();
+}
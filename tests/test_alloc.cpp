@@ -0,0 +1,127 @@
+#include <cstring>
+
+#include "alloc_counter.h"
+#include "frames.h"
+#include "mbus_decoder.h"
+#include "mbus_frame.h"
+#include "test_util.h"
+
+// The receive path does not allocate: frames streamed through FrameParser and RspUdDecoder, with
+// and without record filters, broken frames and acknowledges in between
+
+using namespace esphome::sensostar;
+
+static const int FRAMES = 1000;
+
+// Feeds the frame byte by byte like BusMaster::loop(), returns the result of the last byte
+static mbus::ParseResult feed(mbus::FrameParser &parser, const uint8_t *frame, size_t len) {
+    mbus::ParseResult result = mbus::ParseResult::NONE;
+    for (size_t i = 0; i < len; i++)
+        result = parser.feed(frame[i]);
+    return result;
+}
+
+static void test_sample_frames() {
+    uint8_t frame[mbus::MAX_FRAME_LENGTH];
+    const size_t len = test::build_sample_rsp_ud(frame, sizeof(frame));
+    mbus::FrameParser parser;
+    mbus::RspUdDecoder decoder;
+    parser.set_sink(&decoder);
+
+    const unsigned long before = alloc_count;
+    int readouts = 0;
+    for (int i = 0; i < FRAMES; i++) {
+        if (feed(parser, frame, len) == mbus::ParseResult::FRAME && decoder.is_rsp_ud() && decoder.complete())
+            readouts += decoder.readout().get(mbus::Quantity::ENERGY) == 12345;
+    }
+    CHECK_EQ(readouts, FRAMES);
+    CHECK_EQ(alloc_count - before, 0u);
+}
+
+static void test_sensostar_frame() {
+    mbus::FrameParser parser;
+    mbus::RspUdDecoder decoder;
+    parser.set_sink(&decoder);
+
+    const unsigned long before = alloc_count;
+    int readouts = 0;
+    for (int i = 0; i < FRAMES; i++) {
+        if (feed(parser, test::SENSOSTAR_RSP_UD, sizeof(test::SENSOSTAR_RSP_UD)) == mbus::ParseResult::FRAME)
+            readouts += decoder.readout().get(mbus::Quantity::ENERGY) == 6699;
+    }
+    CHECK_EQ(readouts, FRAMES);
+    CHECK_EQ(alloc_count - before, 0u);
+}
+
+static void test_filtered_frames() {
+    uint8_t frame[mbus::MAX_FRAME_LENGTH];
+    const size_t len = test::build_sample_rsp_ud(frame, sizeof(frame));
+    static const mbus::RecordFilter FILTERS[] = {
+        {0x06, mbus::RECORD_FILTER_NO_VIFE, 0, 1, 0, 0},
+        {0x7D, 0x17, 0, 0, 0, 0},
+    };
+    mbus::FrameParser parser;
+    mbus::RspUdDecoder decoder;
+    parser.set_sink(&decoder);
+    decoder.set_filters(FILTERS, 2);
+
+    const unsigned long before = alloc_count;
+    int readouts = 0;
+    for (int i = 0; i < FRAMES; i++) {
+        if (feed(parser, frame, len) == mbus::ParseResult::FRAME)
+            readouts += decoder.readout().records[0] == 10000 && decoder.readout().records[1] == 4;
+    }
+    CHECK_EQ(readouts, FRAMES);
+    CHECK_EQ(alloc_count - before, 0u);
+}
+
+// A long frame of the maximum length, a corrupted copy and an acknowledge in turn
+static void test_mixed_traffic() {
+    uint8_t records[mbus::MAX_FRAME_LENGTH];
+    size_t records_len = 0;
+    while (records_len + sizeof(test::SAMPLE_RECORDS) <= 252 - mbus::FIXED_HEADER_LENGTH) {
+        memcpy(records + records_len, test::SAMPLE_RECORDS, sizeof(test::SAMPLE_RECORDS));
+        records_len += sizeof(test::SAMPLE_RECORDS);
+    }
+    uint8_t frame[mbus::MAX_FRAME_LENGTH];
+    const size_t len = test::build_rsp_ud(frame, sizeof(frame), records, records_len);
+    CHECK(len > 200);
+    uint8_t corrupted[mbus::MAX_FRAME_LENGTH];
+    memcpy(corrupted, frame, len);
+    corrupted[len / 2] ^= 0x10;
+
+    mbus::FrameParser parser;
+    mbus::RspUdDecoder decoder;
+    parser.set_sink(&decoder);
+
+    const unsigned long before = alloc_count;
+    int frames = 0, errors = 0, acks = 0;
+    for (int i = 0; i < FRAMES; i++) {
+        frames += feed(parser, frame, len) == mbus::ParseResult::FRAME;
+        errors += feed(parser, corrupted, len) == mbus::ParseResult::ERROR_CHECKSUM;
+        acks += parser.feed(mbus::FRAME_ACK) == mbus::ParseResult::ACK;
+    }
+    CHECK_EQ(frames, FRAMES);
+    CHECK_EQ(errors, FRAMES);
+    CHECK_EQ(acks, FRAMES);
+    CHECK_EQ(alloc_count - before, 0u);
+}
+
+// The counter itself works; the pointer escapes so the allocation is not optimized away
+static int *volatile escaped;
+
+static void test_counter() {
+    const unsigned long before = alloc_count;
+    escaped = new int(1);
+    delete escaped;
+    CHECK_EQ(alloc_count - before, 1u);
+}
+
+int main() {
+    test_counter();
+    test_sample_frames();
+    test_sensostar_frame();
+    test_filtered_frames();
+    test_mixed_traffic();
+    return TEST_RESULT();
+}
@@ -0,0 +1,170 @@
+#include <cstring>
+
+#include "mbus_decoder.h"
+#include "frames.h"
+#include "test_util.h"
+
+using namespace esphome::sensostar;
+
+static bool decode(const uint8_t *data, size_t len, mbus::Readout &readout, const mbus::RecordFilter *filters = nullptr,
+                   uint8_t count = 0) {
+    mbus::RecordDecoder decoder;
+    decoder.set_filters(filters, count);
+    decoder.reset();
+    for (size_t i = 0; i < len && decoder.ok(); i++)
+        decoder.feed(data[i]);
+    readout = decoder.readout();
+    return decoder.ok() && decoder.complete();
+}
+
+static void test_sample_records() {
+    mbus::Readout readout;
+    CHECK(decode(test::SAMPLE_RECORDS, sizeof(test::SAMPLE_RECORDS), readout));
+    CHECK_NEAR(readout.get(mbus::Quantity::ENERGY), 12345, 1e-9);
+    CHECK_NEAR(readout.get(mbus::Quantity::VOLUME), 100.0, 1e-9);
+    CHECK_NEAR(readout.get(mbus::Quantity::POWER), 1000, 1e-9);
+    CHECK_NEAR(readout.get(mbus::Quantity::VOLUME_FLOW), 0.3, 1e-9);
+    CHECK_NEAR(readout.get(mbus::Quantity::TEMPERATURE_FLOW), 45.0, 1e-9);
+    CHECK_NEAR(readout.get(mbus::Quantity::TEMPERATURE_RETURN), 35.0, 1e-9);
+    CHECK_NEAR(readout.get(mbus::Quantity::TEMPERATURE_DIFF), 10.0, 1e-9);
+    CHECK_EQ(readout.get(mbus::Quantity::ERROR_FLAGS), 4);
+    // The stored month-end energy does not overwrite the current one, the date is not decoded
+    CHECK_EQ(readout.unknown_records, 2);
+}
+
+// An LVAR record must be skipped by its own length, whatever its type, without losing the next record
+static void test_lvar() {
+    static const uint8_t NEGATIVE_BCD[] = {
+        0x0D, 0x06, 0xD4, 0x45, 0x23, 0x01, 0x00,  // negative BCD, 4 bytes
+        0x04, 0x06, 0x39, 0x30, 0x00, 0x00,        // energy 12345 kWh
+    };
+    mbus::Readout readout;
+    CHECK(decode(NEGATIVE_BCD, sizeof(NEGATIVE_BCD), readout));
+    CHECK(readout.has(mbus::Quantity::ENERGY));
+    CHECK_NEAR(readout.get(mbus::Quantity::ENERGY), 12345, 1e-9);
+
+    static const uint8_t OTHER_TYPES[] = {
+        0x0D, 0x06, 0x03, 'A', 'B', 'C',  // ASCII, 3 bytes
+        0x0D, 0x06, 0xC2, 0x45, 0x23,     // positive BCD, 2 bytes
+        0x0D, 0x06, 0xDF,                 // negative BCD, 15 bytes
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x0D, 0x06, 0xE3, 0x01, 0x02, 0x03,  // binary, 3 bytes
+        0x0D, 0x06, 0xF0,                    // big number, 16 bytes
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x02, 0x2B, 0xE8, 0x03,  // power 1000 W
+    };
+    CHECK(decode(OTHER_TYPES, sizeof(OTHER_TYPES), readout));
+    CHECK_NEAR(readout.get(mbus::Quantity::POWER), 1000, 1e-9);
+    CHECK_EQ(readout.unknown_records, 5);
+
+    // Reserved LVAR: the record can't be sized, so the frame is not complete
+    static const uint8_t RESERVED[] = {0x0D, 0x06, 0xF7, 0x04, 0x06, 0x39, 0x30, 0x00, 0x00};
+    CHECK(!decode(RESERVED, sizeof(RESERVED), readout));
+}
+
+static void test_dife() {
+    // Storage 3 (DIF bit 1, DIFE 0x01), tariff 1 (DIFE 0x10), subunit 1 (DIFE 0x40)
+    static const uint8_t RECORDS[] = {
+        0xC4, 0x01, 0x06, 0x01, 0x00, 0x00, 0x00,  // energy, storage 3
+        0x84, 0x10, 0x06, 0x02, 0x00, 0x00, 0x00,  // energy, tariff 1
+        0x84, 0x40, 0x06, 0x03, 0x00, 0x00, 0x00,  // energy, subunit 1
+        0x04, 0x06, 0x04, 0x00, 0x00, 0x00,        // current energy
+    };
+    static const mbus::RecordFilter FILTERS[] = {
+        {0x06, mbus::RECORD_FILTER_NO_VIFE, 0, 3, 0, 0},
+        {0x06, mbus::RECORD_FILTER_NO_VIFE, 0, 0, 1, 0},
+        {0x06, mbus::RECORD_FILTER_NO_VIFE, 0, 0, 0, 1},
+    };
+    mbus::Readout readout;
+    CHECK(decode(RECORDS, sizeof(RECORDS), readout, FILTERS, 3));
+    CHECK_EQ(readout.records_present, 0x07);
+    CHECK_EQ(readout.records[0], 1);
+    CHECK_EQ(readout.records[1], 2);
+    CHECK_EQ(readout.records[2], 3);
+    CHECK_EQ(readout.get(mbus::Quantity::ENERGY), 4);
+
+    // A complete chain of 10 DIFEs, the storage number is cut to 32 bits
+    static const uint8_t LONG_CHAIN[] = {
+        0x84, 0x8F, 0x8F, 0x8F, 0x8F, 0x8F, 0x8F, 0x8F, 0x8F, 0x8F, 0x0F, 0x06, 0x01, 0x00, 0x00, 0x00,
+        0x04, 0x06, 0x39, 0x30, 0x00, 0x00,
+    };
+    static const mbus::RecordFilter TRUNCATED[] = {{0x06, mbus::RECORD_FILTER_NO_VIFE, 0, 0xFFFFFFFE, 0, 0}};
+    CHECK(decode(LONG_CHAIN, sizeof(LONG_CHAIN), readout, TRUNCATED, 1));
+    CHECK_EQ(readout.records_present, 0x01);
+    CHECK_NEAR(readout.get(mbus::Quantity::ENERGY), 12345, 1e-9);
+}
+
+static void test_function_and_vife() {
+    static const uint8_t RECORDS[] = {
+        0x12, 0x2B, 0x10, 0x27,        // maximum power 10000 W
+        0x22, 0x2B, 0x64, 0x00,        // minimum power 100 W
+        0x02, 0xAB, 0x3C, 0xE8, 0x03,  // power with VIFE 0x3C
+        0x02, 0x2B, 0xE8, 0x03,        // power 1000 W
+    };
+    static const mbus::RecordFilter FILTERS[] = {
+        {0x2B, mbus::RECORD_FILTER_NO_VIFE, 1, 0, 0, 0},
+        {0x2B, mbus::RECORD_FILTER_NO_VIFE, 2, 0, 0, 0},
+        {0x2B, 0x3C, 0, 0, 0, 0},
+    };
+    mbus::Readout readout;
+    CHECK(decode(RECORDS, sizeof(RECORDS), readout, FILTERS, 3));
+    CHECK_EQ(readout.records_present, 0x07);
+    CHECK_EQ(readout.records[0], 10000);
+    CHECK_EQ(readout.records[1], 100);
+    CHECK_EQ(readout.records[2], 1000);
+    CHECK_EQ(readout.get(mbus::Quantity::POWER), 1000);
+}
+
+static void test_codings() {
+    double value = 0;
+    const uint8_t int16[] = {0xFE, 0xFF};
+    CHECK(mbus::decode_value(0x02, int16, value));
+    CHECK_EQ(value, -2);
+    const uint8_t int24[] = {0x00, 0x00, 0x80};
+    CHECK(mbus::decode_value(0x03, int24, value));
+    CHECK_EQ(value, -8388608);
+    const uint8_t int48[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    CHECK(mbus::decode_value(0x06, int48, value));
+    CHECK_EQ(value, -1);
+    const uint8_t int64[] = {0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00};
+    CHECK(mbus::decode_value(0x07, int64, value));
+    CHECK_EQ(value, 4294967296.0);
+    float f = 21.5f;
+    uint8_t real[4];
+    memcpy(real, &f, sizeof(real));
+    CHECK(mbus::decode_value(0x05, real, value));
+    CHECK_EQ(value, 21.5);
+
+    const uint8_t bcd8[] = {0x78, 0x56, 0x34, 0x12};
+    CHECK(mbus::decode_value(0x0C, bcd8, value));
+    CHECK_EQ(value, 12345678);
+    const uint8_t negative_bcd4[] = {0x23, 0xF1};
+    CHECK(mbus::decode_value(0x0A, negative_bcd4, value));
+    CHECK_EQ(value, -123);
+    const uint8_t invalid_bcd[] = {0x3A};
+    CHECK(!mbus::decode_value(0x09, invalid_bcd, value));
+    CHECK(!mbus::decode_value(0x00, bcd8, value));
+    CHECK(!mbus::decode_value(0x08, bcd8, value));
+}
+
+static void test_filler_and_manufacturer() {
+    static const uint8_t RECORDS[] = {
+        0x2F, 0x2F,                          // idle filler
+        0x04, 0x06, 0x39, 0x30, 0x00, 0x00,  // energy
+        0x0F, 0x04, 0x06, 0x01, 0x00,        // manufacturer specific data, not records
+    };
+    mbus::Readout readout;
+    CHECK(decode(RECORDS, sizeof(RECORDS), readout));
+    CHECK_NEAR(readout.get(mbus::Quantity::ENERGY), 12345, 1e-9);
+    CHECK_EQ(readout.unknown_records, 0);
+}
+
+int main() {
+    test_sample_records();
+    test_lvar();
+    test_dife();
+    test_function_and_vife();
+    test_codings();
+    test_filler_and_manufacturer();
+    return TEST_RESULT();
+}
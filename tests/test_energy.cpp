@@ -0,0 +1,183 @@
+#include <cmath>
+#include <cstdio>
+
+#include "energy_integrator.h"
+#include "frames.h"
+#include "mbus_decoder.h"
+#include "mbus_frame.h"
+#include "test_util.h"
+
+using namespace esphome::sensostar;
+
+static void test_water_tables() {
+    CHECK_EQ(water_table_lookup(WATER_DENSITY, 0.0f), WATER_DENSITY[0]);
+    CHECK_EQ(water_table_lookup(WATER_DENSITY, 40.0f), WATER_DENSITY[4]);
+    CHECK_NEAR(water_table_lookup(WATER_DENSITY, 45.0f), (WATER_DENSITY[4] + WATER_DENSITY[5]) / 2, 1e-3);
+    // Clamped to 0..100 °C
+    CHECK_EQ(water_table_lookup(WATER_DENSITY, -5.0f), WATER_DENSITY[0]);
+    CHECK_EQ(water_table_lookup(WATER_DENSITY, 130.0f), WATER_DENSITY[WATER_TABLE_SIZE - 1]);
+    CHECK_EQ(water_table_lookup(WATER_HEAT_CAPACITY, NAN), WATER_HEAT_CAPACITY[0]);
+
+    // 1 m3/h and 10 K at 50 °C
+    CHECK_NEAR(thermal_power(1.0, 10.0, 50.0f, 50.0f), 988.03 / 3600.0 * 4180.6 * 10.0, 0.01);
+    CHECK_EQ(thermal_power(0.0, 10.0, 50.0f, 50.0f), 0.0);
+}
+
+static void test_trapezoid() {
+    EnergyIntegrator integrator;
+    integrator.reset(100.0);
+    // The first sample only sets the reference
+    integrator.add(1000, 5000);
+    CHECK_EQ(integrator.value(), 100.0);
+    // 1000 W rising to 3000 W over an hour: 2 kWh
+    integrator.add(3000, 5000 + 3600000);
+    CHECK_NEAR(integrator.value(), 102.0, 1e-9);
+
+    // No energy across a gap after restart()
+    integrator.restart();
+    integrator.add(1000, 20000000);
+    CHECK_NEAR(integrator.value(), 102.0, 1e-9);
+    // Across the millis() overflow
+    integrator.reset(0.0);
+    integrator.add(3600, 0xFFFFFFFF - 499);
+    integrator.add(3600, 500);
+    CHECK_NEAR(integrator.value(), 3600.0 * 1000 / 3.6e9, 1e-12);
+}
+
+// A day of 10 s samples on a 45000 kWh register: a float sum loses the increments to rounding,
+// the compensated sum does not
+static void test_large_register() {
+    EnergyIntegrator integrator;
+    integrator.reset(45000.0);
+    float float_sum = 45000.0f;
+    double exact = 45000.0;
+    double last_power = 0;
+    uint32_t now = 0;
+    for (int i = 0; i <= 8640; i++, now += 10000) {
+        const double power = 5000 + 3000 * sin(i / 100.0);
+        if (i > 0) {
+            exact += (last_power + power) / 2 * 10000 / 3.6e9;
+            float_sum += (float) power / 3600.0f * 10000.0f / 1000000.0f;
+        }
+        integrator.add(power, now);
+        last_power = power;
+    }
+    CHECK(std::fabs(float_sum - exact) > 0.5);
+    CHECK_NEAR(integrator.value(), exact, 1e-6);
+}
+
+// RSP_UD frame with the energy register in kWh and the power in W, as the meter reports them
+static size_t build_readout(uint8_t *out, uint32_t energy, uint32_t power) {
+    const uint8_t records[] = {
+        0x04, 0x06, (uint8_t) energy, (uint8_t) (energy >> 8), (uint8_t) (energy >> 16), (uint8_t) (energy >> 24),
+        0x04, 0x2B, (uint8_t) power,  (uint8_t) (power >> 8),  (uint8_t) (power >> 16),  (uint8_t) (power >> 24),
+    };
+    return test::build_rsp_ud(out, mbus::MAX_FRAME_LENGTH, records, sizeof(records));
+}
+
+struct Decoded {
+    double energy;
+    double power;
+};
+
+static Decoded decode_readout(const uint8_t *frame, size_t len) {
+    mbus::FrameParser parser;
+    mbus::RspUdDecoder decoder;
+    parser.set_sink(&decoder);
+    mbus::ParseResult result = mbus::ParseResult::NONE;
+    for (size_t i = 0; i < len; i++)
+        result = parser.feed(frame[i]);
+    CHECK(result == mbus::ParseResult::FRAME);
+    return {decoder.readout().get(mbus::Quantity::ENERGY), decoder.readout().get(mbus::Quantity::POWER)};
+}
+
+// A day of readouts every 30 s from a heating with a daily power curve. The register is the exact
+// energy rounded down to kWh like the meter's, the power is rounded to W. Each frame goes through
+// the parser and decoder, the interpolated value must stay within the register's kWh step, take the
+// register at every step, never go backwards, and stay within a readout's energy of the exact one.
+static void test_day_replay() {
+    static const uint32_t PERIOD = 30000;  // ms
+    static const int READOUTS = 24 * 3600 * 1000 / PERIOD;
+    const double start = 45000.3;  // kWh, the fraction is hidden by the register
+    // W; the exact energy is its integral
+    auto power_at = [](double t) { return 6000 + 4000 * sin(2 * M_PI * t / 86400.0 - 1); };
+    auto energy_at = [start](double t) {
+        return start + (6000 * t - 4000 * 86400.0 / (2 * M_PI) * (cos(2 * M_PI * t / 86400.0 - 1) - cos(-1))) / 3.6e6;
+    };
+
+    RegisterInterpolator interpolator;
+    uint8_t frame[mbus::MAX_FRAME_LENGTH];
+    double published = 0, last_register = -1, max_error = 0;
+    int steps = 0, resyncs = 0, publishes = 0;
+    bool synced = false;
+    for (int i = 0; i <= READOUTS; i++) {
+        const uint32_t now = 1000 + i * PERIOD;
+        const double t = i * (PERIOD / 1000.0);
+        const size_t len = build_readout(frame, (uint32_t) floor(energy_at(t)), (uint32_t) lround(power_at(t)));
+        const Decoded readout = decode_readout(frame, len);
+
+        const double value = interpolator.update(readout.energy, readout.power, now);
+        const bool stepped = last_register >= 0 && readout.energy != last_register;
+        steps += stepped;
+        if (stepped) {
+            CHECK_EQ(value, readout.energy);
+            resyncs += value == readout.energy;
+            synced = true;
+        }
+        last_register = readout.energy;
+        if (std::isnan(value))
+            continue;
+        publishes++;
+        CHECK(value >= readout.energy && value < readout.energy + 1);
+        CHECK(value >= published);
+        published = value;
+        if (synced)
+            max_error = std::max(max_error, std::fabs(value - energy_at(t)));
+    }
+    const int expected_steps = (int) (floor(energy_at(86400)) - floor(start));
+    printf("Day of %d readouts: %d kWh steps, %d values published, %.4f kWh largest error after the first step\n",
+           READOUTS + 1, steps, publishes, max_error);
+    CHECK_EQ(steps, expected_steps);
+    CHECK_EQ(resyncs, steps);
+    CHECK(publishes > READOUTS * 9 / 10);
+    // At a step the energy since the step is dropped: at most one readout period at the peak power
+    CHECK(max_error < 10000.0 * PERIOD / 3.6e9);
+}
+
+// The meter reports more power than goes into the register: the value holds below the next step
+// instead of running ahead and falling back when the register steps
+static void test_overshoot() {
+    RegisterInterpolator interpolator;
+    CHECK_EQ(interpolator.update(100, 3600, 0), 100.0);
+    // 3600 W for 0.5 h: 1.8 kWh, more than the step
+    CHECK_NEAR(interpolator.update(100, 3600, 500000), 100.5, 1e-9);
+    CHECK(std::isnan(interpolator.update(100, 3600, 1000000)));
+    CHECK(std::isnan(interpolator.update(100, 3600, 1500000)));
+    CHECK_EQ(interpolator.update(101, 3600, 1800000), 101.0);
+}
+
+static void test_register_reset() {
+    RegisterInterpolator interpolator;
+    interpolator.update(45000, 1000, 0);
+    CHECK_NEAR(interpolator.update(45000, 1000, 1800000), 45000.5, 1e-9);
+    // Meter replaced: the new register is taken as it is and interpolated from there
+    CHECK_EQ(interpolator.update(12, 1000, 1900000), 12.0);
+    CHECK_NEAR(interpolator.update(12, 1000, 2620000), 12.2, 1e-9);
+    // No power reported: hold, then start over from the next sample
+    CHECK(std::isnan(interpolator.update(12, -127, 3000000)));
+    CHECK_NEAR(interpolator.update(12, 1000, 3600000), 12.2, 1e-9);
+    // After missed readouts the gap is not integrated
+    interpolator.restart();
+    CHECK_NEAR(interpolator.update(12, 1000, 7200000), 12.2, 1e-9);
+    CHECK_NEAR(interpolator.update(12, 1000, 7560000), 12.3, 1e-9);
+}
+
+int main() {
+    test_water_tables();
+    test_trapezoid();
+    test_large_register();
+    test_day_replay();
+    test_overshoot();
+    test_register_reset();
+    return TEST_RESULT();
+}
@@ -0,0 +1,150 @@
+#include "mbus_frame.h"
+#include "mbus_decoder.h"
+#include "frames.h"
+#include "test_util.h"
+
+using namespace esphome::sensostar;
+
+static mbus::ParseResult feed_all(mbus::FrameParser &parser, const uint8_t *data, size_t len) {
+    mbus::ParseResult result = mbus::ParseResult::NONE;
+    for (size_t i = 0; i < len; i++) {
+        result = parser.feed(data[i]);
+        if (result != mbus::ParseResult::NONE && i + 1 != len)
+            return mbus::ParseResult::NONE; // finished early
+    }
+    return result;
+}
+
+static void test_sample_frame() {
+    uint8_t frame[mbus::MAX_FRAME_LENGTH];
+    size_t len = test::build_sample_rsp_ud(frame, sizeof(frame));
+    CHECK(len > 0);
+
+    mbus::FrameParser parser;
+    mbus::RspUdDecoder decoder;
+    parser.set_sink(&decoder);
+    CHECK(feed_all(parser, frame, len) == mbus::ParseResult::FRAME);
+    CHECK_EQ(parser.frame_size(), len);
+    CHECK_EQ(parser.control(), mbus::C_RSP_UD);
+    CHECK_EQ(parser.address(), 0x01);
+    CHECK_EQ(parser.ci(), mbus::CI_RSP_UD);
+    CHECK_EQ(parser.payload_size(), mbus::FIXED_HEADER_LENGTH + sizeof(test::SAMPLE_RECORDS));
+    CHECK(!parser.in_frame());
+
+    // Decoded while the frame was received
+    CHECK(decoder.is_rsp_ud());
+    CHECK(decoder.complete());
+    CHECK_EQ(decoder.header().id, 0x12345678u);
+    CHECK_EQ(decoder.header().manufacturer, 0x14C5);
+    CHECK(decoder.readout().has(mbus::Quantity::ENERGY));
+    CHECK_NEAR(decoder.readout().get(mbus::Quantity::ENERGY), 12345, 1e-9);
+}
+
+static void test_sensostar_frame() {
+    mbus::FrameParser parser;
+    mbus::RspUdDecoder decoder;
+    parser.set_sink(&decoder);
+    CHECK(feed_all(parser, test::SENSOSTAR_RSP_UD, sizeof(test::SENSOSTAR_RSP_UD)) == mbus::ParseResult::FRAME);
+    CHECK_EQ(parser.frame_size(), sizeof(test::SENSOSTAR_RSP_UD));
+    CHECK(decoder.complete());
+    CHECK_EQ(decoder.header().id, 0x67357241u);
+    CHECK_EQ(decoder.header().access_number, 42);
+
+    const mbus::Readout &readout = decoder.readout();
+    CHECK_NEAR(readout.get(mbus::Quantity::ENERGY), 6699, 1e-9);
+    CHECK_NEAR(readout.get(mbus::Quantity::VOLUME), 298.844, 1e-9);
+    CHECK_NEAR(readout.get(mbus::Quantity::POWER), 570, 1e-9);
+    CHECK_NEAR(readout.get(mbus::Quantity::VOLUME_FLOW), 0.076, 1e-9);
+    CHECK_NEAR(readout.get(mbus::Quantity::TEMPERATURE_FLOW), 63.88, 1e-9);
+    CHECK_NEAR(readout.get(mbus::Quantity::TEMPERATURE_RETURN), 57.26, 1e-9);
+    CHECK_NEAR(readout.get(mbus::Quantity::TEMPERATURE_DIFF), 6.62, 1e-9);
+    CHECK_EQ(readout.get(mbus::Quantity::ERROR_FLAGS), 0);
+    // Date and time, stored energy and stored date
+    CHECK_EQ(readout.unknown_records, 3);
+}
+
+static void test_ack_and_noise() {
+    mbus::FrameParser parser;
+    CHECK(parser.feed(mbus::FRAME_ACK) == mbus::ParseResult::ACK);
+    // Bytes outside a frame are dropped
+    CHECK(parser.feed(0x00) == mbus::ParseResult::NONE);
+    CHECK(parser.feed(0x16) == mbus::ParseResult::NONE);
+    CHECK(!parser.in_frame());
+
+    uint8_t frame[mbus::MAX_FRAME_LENGTH];
+    size_t len = test::build_sample_rsp_ud(frame, sizeof(frame));
+    CHECK(feed_all(parser, frame, len) == mbus::ParseResult::FRAME);
+    // A second frame right after the first
+    CHECK(feed_all(parser, frame, len) == mbus::ParseResult::FRAME);
+}
+
+static void test_errors() {
+    uint8_t frame[mbus::MAX_FRAME_LENGTH];
+    size_t len = test::build_sample_rsp_ud(frame, sizeof(frame));
+    mbus::FrameParser parser;
+
+    uint8_t bad[mbus::MAX_FRAME_LENGTH];
+    memcpy(bad, frame, len);
+    bad[len - 2] ^= 0x01;
+    CHECK(feed_all(parser, bad, len) == mbus::ParseResult::ERROR_CHECKSUM);
+
+    memcpy(bad, frame, len);
+    bad[len - 1] = 0x17;
+    CHECK(feed_all(parser, bad, len) == mbus::ParseResult::ERROR_STOP);
+
+    memcpy(bad, frame, len);
+    bad[3] = 0x69;
+    CHECK(feed_all(parser, bad, len) == mbus::ParseResult::ERROR_START);
+
+    // Both length fields must match, C, A and CI are mandatory
+    memcpy(bad, frame, len);
+    bad[2] = bad[1] - 1;
+    CHECK(feed_all(parser, bad, len) == mbus::ParseResult::ERROR_LENGTH);
+    const uint8_t short_length[] = {0x68, 0x02, 0x02, 0x68, 0x08, 0x01, 0x09, 0x16};
+    CHECK(feed_all(parser, short_length, sizeof(short_length)) == mbus::ParseResult::ERROR_LENGTH);
+
+    // The parser recovers after an error
+    CHECK(feed_all(parser, frame, len) == mbus::ParseResult::FRAME);
+}
+
+static void test_max_length() {
+    uint8_t payload[252];
+    for (size_t i = 0; i < sizeof(payload); i++)
+        payload[i] = (uint8_t) i;
+    uint8_t frame[mbus::MAX_FRAME_LENGTH];
+    size_t len = mbus::build_long_frame(frame, sizeof(frame), mbus::C_SND_UD, 0x01, mbus::CI_DATA_SEND, payload,
+                                        sizeof(payload));
+    CHECK_EQ(len, mbus::MAX_FRAME_LENGTH);
+    mbus::FrameParser parser;
+    CHECK(feed_all(parser, frame, len) == mbus::ParseResult::FRAME);
+    CHECK_EQ(parser.payload_size(), sizeof(payload));
+    CHECK(memcmp(parser.payload(), payload, sizeof(payload)) == 0);
+
+    // Too long for the length field, or for the output buffer
+    uint8_t big[300] = {0};
+    CHECK_EQ(mbus::build_long_frame(frame, sizeof(frame), mbus::C_SND_UD, 0x01, mbus::CI_DATA_SEND, big, 253), 0u);
+    CHECK_EQ(mbus::build_long_frame(frame, 20, mbus::C_SND_UD, 0x01, mbus::CI_DATA_SEND, big, 12), 0u);
+}
+
+static void test_builders() {
+    uint8_t frame[5];
+    CHECK_EQ(mbus::build_short_frame(frame, mbus::C_REQ_UD2, 0xFE), 5u);
+    const uint8_t expected[] = {0x10, 0x5B, 0xFE, 0x59, 0x16};
+    CHECK(memcmp(frame, expected, sizeof(expected)) == 0);
+
+    CHECK_EQ(mbus::baud_rate_to_ci(300), 0xB8);
+    CHECK_EQ(mbus::baud_rate_to_ci(2400), 0xBB);
+    CHECK_EQ(mbus::baud_rate_to_ci(9600), 0xBD);
+    CHECK_EQ(mbus::baud_rate_to_ci(38400), 0xBF);
+    CHECK_EQ(mbus::baud_rate_to_ci(1234), 0);
+}
+
+int main() {
+    test_sample_frame();
+    test_sensostar_frame();
+    test_ack_and_noise();
+    test_errors();
+    test_max_length();
+    test_builders();
+    return TEST_RESULT();
+}
@@ -0,0 +1,199 @@
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#include "frames.h"
+#include "mbus_gateway.h"
+#include "test_util.h"
+
+// Loopback test of the M-Bus over TCP gateway with a scripted client. The test plays the hub:
+// it takes the requests from the gateway and forwards a response for each as the UART would.
+
+using namespace esphome::sensostar;
+using Clock = std::chrono::steady_clock;
+
+static const uint8_t REQ_UD2[] = {0x10, 0x7B, 0x01, 0x7C, 0x16};
+
+static int connect_client(uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in server {};
+    server.sin_family = AF_INET;
+    server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    server.sin_port = htons(port);
+    if (::connect(fd, (struct sockaddr *) &server, sizeof(server)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    int enable = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+    return fd;
+}
+
+static void send_all(int fd, const uint8_t *data, size_t len) { CHECK_EQ(::send(fd, data, len, 0), (ssize_t) len); }
+
+static bool receive_all(int fd, uint8_t *data, size_t len) {
+    for (size_t got = 0; got < len;) {
+        ssize_t n = ::recv(fd, data + got, len - got, 0);
+        if (n <= 0)
+            return false;
+        got += n;
+    }
+    return true;
+}
+
+// Polls the gateway like loop() does, until a request is complete or a second passed
+static bool wait_request(MBusGateway &gateway) {
+    const auto deadline = Clock::now() + std::chrono::seconds(1);
+    while (Clock::now() < deadline) {
+        if (gateway.poll())
+            return true;
+    }
+    return false;
+}
+
+static bool same_request(const MBusGateway &gateway, const uint8_t *frame, size_t len) {
+    return gateway.request_size() == len && memcmp(gateway.request(), frame, len) == 0;
+}
+
+// Listens on a free port from a range, the gateway takes a fixed port like on the device
+static uint16_t start(MBusGateway &gateway) {
+    for (uint16_t port = 20000 + getpid() % 20000, tries = 0; tries < 100; port++, tries++) {
+        if (gateway.setup(port))
+            return port;
+    }
+    return 0;
+}
+
+static void test_frames(MBusGateway &gateway, uint16_t port) {
+    int client = connect_client(port);
+    CHECK(client >= 0);
+
+    // A short frame, then a long frame split over two writes
+    send_all(client, REQ_UD2, sizeof(REQ_UD2));
+    CHECK(wait_request(gateway));
+    CHECK(gateway.connected());
+    CHECK(same_request(gateway, REQ_UD2, sizeof(REQ_UD2)));
+    CHECK_EQ(gateway.request_address(), 0x01);
+    // Still waiting until the hub put it on the bus
+    CHECK(gateway.poll());
+    gateway.request_sent();
+    CHECK(!gateway.poll());
+
+    static const uint8_t POLL[] = {0x0F, 0x00, 0x00, 0x01, 0x59};
+    uint8_t frame[mbus::MAX_FRAME_LENGTH];
+    size_t len = mbus::build_long_frame(frame, sizeof(frame), mbus::C_SND_UD, 0x05, mbus::CI_DATA_SEND, POLL,
+                                        sizeof(POLL));
+    send_all(client, frame, 6);
+    const auto deadline = Clock::now() + std::chrono::milliseconds(50);
+    while (Clock::now() < deadline)
+        CHECK(!gateway.poll());
+    send_all(client, frame + 6, len - 6);
+    CHECK(wait_request(gateway));
+    CHECK(same_request(gateway, frame, len));
+    CHECK_EQ(gateway.request_address(), 0x05);
+    gateway.request_sent();
+
+    // Back to back frames: only the first is read, the second waits in the socket
+    uint8_t both[2 * sizeof(REQ_UD2)];
+    memcpy(both, REQ_UD2, sizeof(REQ_UD2));
+    memcpy(both + sizeof(REQ_UD2), REQ_UD2, sizeof(REQ_UD2));
+    both[sizeof(REQ_UD2) + 2] = 0x02;
+    both[sizeof(REQ_UD2) + 3] = 0x7D;
+    send_all(client, both, sizeof(both));
+    CHECK(wait_request(gateway));
+    CHECK(same_request(gateway, both, sizeof(REQ_UD2)));
+    gateway.request_sent();
+    CHECK(wait_request(gateway));
+    CHECK_EQ(gateway.request_address(), 0x02);
+    gateway.request_sent();
+
+    // A single character has no A field
+    const uint8_t ack = mbus::FRAME_ACK;
+    send_all(client, &ack, 1);
+    CHECK(wait_request(gateway));
+    CHECK_EQ(gateway.request_size(), 1);
+    CHECK_EQ(gateway.request_address(), mbus::ADDRESS_NONE);
+    gateway.request_sent();
+
+    // Garbage before a frame and a broken long frame header are skipped
+    static const uint8_t NOISE[] = {0x00, 0xFF, 0x68, 0x05, 0x06, 0x68};
+    send_all(client, NOISE, sizeof(NOISE));
+    send_all(client, REQ_UD2, sizeof(REQ_UD2));
+    CHECK(wait_request(gateway));
+    CHECK(same_request(gateway, REQ_UD2, sizeof(REQ_UD2)));
+
+    // The response reaches the client unchanged
+    size_t response_len = test::build_sample_rsp_ud(frame, sizeof(frame));
+    gateway.forward(frame, 10);
+    gateway.forward(frame + 10, response_len - 10);
+    gateway.request_sent();
+    std::vector<uint8_t> received(response_len);
+    CHECK(receive_all(client, received.data(), response_len));
+    CHECK(memcmp(received.data(), frame, response_len) == 0);
+
+    // A closed client is dropped, the next one is accepted
+    ::close(client);
+    const auto closed = Clock::now() + std::chrono::seconds(1);
+    while (gateway.connected() && Clock::now() < closed)
+        gateway.poll();
+    CHECK(!gateway.connected());
+}
+
+// Round trips of REQ_UD2 and a RSP_UD answer, the gateway's share of the time is what it adds to a
+// request on the device besides the bus itself
+static void test_latency(MBusGateway &gateway, uint16_t port, int requests) {
+    int client = connect_client(port);
+    CHECK(client >= 0);
+    uint8_t response[mbus::MAX_FRAME_LENGTH];
+    size_t response_len = test::build_sample_rsp_ud(response, sizeof(response));
+    uint8_t received[mbus::MAX_FRAME_LENGTH];
+
+    Clock::duration gateway_time{}, round_trip{};
+    int served = 0;
+    for (int i = 0; i < requests; i++) {
+        const auto sent = Clock::now();
+        send_all(client, REQ_UD2, sizeof(REQ_UD2));
+        // Busy polling like loop(), only the calls that made progress count as the gateway's time
+        bool ready = false;
+        while (!ready && Clock::now() - sent < std::chrono::seconds(1)) {
+            const auto before = Clock::now();
+            ready = gateway.poll();
+            if (ready)
+                gateway_time += Clock::now() - before;
+        }
+        if (!ready)
+            break;
+        const auto before = Clock::now();
+        gateway.request_sent();
+        gateway.forward(response, response_len);
+        gateway_time += Clock::now() - before;
+        if (!receive_all(client, received, response_len))
+            break;
+        round_trip += Clock::now() - sent;
+        served++;
+    }
+    CHECK_EQ(served, requests);
+    CHECK(memcmp(received, response, response_len) == 0);
+    ::close(client);
+
+    using us = std::chrono::duration<double, std::micro>;
+    printf("%d requests, gateway %.1f us/request, round trip %.1f us\n", served,
+           us(gateway_time).count() / (served ? served : 1), us(round_trip).count() / (served ? served : 1));
+}
+
+int main() {
+    MBusGateway gateway;
+    const uint16_t port = start(gateway);
+    CHECK(port != 0);
+    if (port == 0)
+        return TEST_RESULT();
+    test_frames(gateway, port);
+    test_latency(gateway, port, 1000);
+    return TEST_RESULT();
+}
@@ -0,0 +1,146 @@
+#include <cstring>
+#include <vector>
+
+#include "history_codec.h"
+#include "test_util.h"
+
+using namespace esphome::sensostar;
+
+static uint32_t rng_state = 4711;
+
+static uint32_t rnd(uint32_t n) {
+    rng_state = rng_state * 1103515245u + 12345u;
+    return (rng_state >> 8) % n;
+}
+
+static HistoryRecord reading(uint32_t time, int32_t energy) {
+    HistoryRecord record;
+    record.time = time;
+    record.present = (1 << HISTORY_FIELD_COUNT) - 1;
+    record.values[HISTORY_ENERGY] = energy;
+    record.values[HISTORY_VOLUME] = energy / 3;
+    record.values[HISTORY_TEMPERATURE_FLOW] = 6000 + (int32_t) rnd(200) - 100;
+    record.values[HISTORY_TEMPERATURE_RETURN] = 4000 + (int32_t) rnd(200) - 100;
+    record.values[HISTORY_POWER] = (int32_t) rnd(8000);
+    record.values[HISTORY_FLOW] = (int32_t) rnd(700);
+    return record;
+}
+
+static bool same(const HistoryRecord &a, const HistoryRecord &b) {
+    if (a.time != b.time || a.present != b.present)
+        return false;
+    for (uint8_t i = 0; i < HISTORY_FIELD_COUNT; i++) {
+        if ((a.present & (1 << i)) && a.values[i] != b.values[i])
+            return false;
+    }
+    return true;
+}
+
+static void test_round_trip() {
+    HistoryBlock block{};
+    block.start_time = 1700000000;
+    HistoryEncoder encoder;
+    encoder.begin(&block);
+
+    std::vector<HistoryRecord> written;
+    uint32_t time = block.start_time;
+    int32_t energy = 45000000;
+    for (;;) {
+        HistoryRecord record = reading(time, energy);
+        // Missing fields, negative deltas and extreme values
+        if (written.size() % 7 == 3)
+            record.present &= ~(1 << HISTORY_POWER);
+        if (written.size() == 5)
+            record.values[HISTORY_TEMPERATURE_RETURN] = -2147483647 - 1;
+        if (written.size() == 6)
+            record.values[HISTORY_TEMPERATURE_RETURN] = 2147483647;
+        const uint16_t used = block.used;
+        if (!encoder.append(record)) {
+            // A record that does not fit leaves the block as it was
+            CHECK_EQ(block.used, used);
+            CHECK_EQ(block.count, written.size());
+            break;
+        }
+        written.push_back(record);
+        time += 30 + rnd(3);
+        energy += rnd(20);
+    }
+    CHECK(written.size() > 10);
+
+    HistoryBlockReader reader(block);
+    HistoryRecord record;
+    size_t read = 0;
+    // Missing fields keep the previous value
+    int32_t power = 0;
+    while (reader.next(record)) {
+        CHECK(same(record, written[read]));
+        if (written[read].present & (1 << HISTORY_POWER))
+            power = written[read].values[HISTORY_POWER];
+        CHECK_EQ(record.values[HISTORY_POWER], power);
+        read++;
+    }
+    CHECK_EQ(read, written.size());
+}
+
+// An encoder started on a restored block continues after its records
+static void test_resume() {
+    HistoryBlock block{};
+    block.start_time = 1000;
+    HistoryEncoder encoder;
+    encoder.begin(&block);
+    for (uint32_t i = 0; i < 5; i++)
+        CHECK(encoder.append(reading(1000 + 30 * i, 100 * i)));
+
+    HistoryBlock restored;
+    memcpy(&restored, &block, sizeof(block));
+    HistoryEncoder resumed;
+    resumed.begin(&restored);
+    // Older than the last record
+    CHECK(!resumed.append(reading(1000, 0)));
+    const HistoryRecord next = reading(1150, 500);
+    CHECK(resumed.append(next));
+    CHECK(encoder.append(next));
+    CHECK_EQ(restored.count, 6);
+    CHECK_EQ(restored.used, block.used);
+    CHECK(memcmp(restored.data, block.data, block.used) == 0);
+
+    HistoryBlockReader reader(restored);
+    HistoryRecord record;
+    uint8_t count = 0;
+    while (reader.next(record))
+        count++;
+    CHECK_EQ(count, 6);
+    CHECK_EQ(record.time, 1150u);
+    CHECK_EQ(record.values[HISTORY_ENERGY], 500);
+}
+
+// A block with a broken record area, e.g. from flash, stops at the last complete record
+static void test_truncated() {
+    HistoryBlock block{};
+    HistoryEncoder encoder;
+    encoder.begin(&block);
+    CHECK(encoder.append(reading(10, 1)));
+    const uint16_t first = block.used;
+    CHECK(encoder.append(reading(40, 2)));
+    block.used = first + 3;
+
+    HistoryBlockReader reader(block);
+    HistoryRecord record;
+    CHECK(reader.next(record));
+    CHECK(!reader.next(record));
+
+    // A varint running over 5 bytes
+    HistoryBlock garbage{};
+    garbage.count = 1;
+    garbage.used = 10;
+    memset(garbage.data, 0xFF, 10);
+    reader.begin(garbage);
+    CHECK(!reader.next(record));
+}
+
+int main() {
+    test_round_trip();
+    test_resume();
+    test_truncated();
+    return TEST_RESULT();
+}
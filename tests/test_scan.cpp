@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include "mbus_scan.h"
+#include "test_util.h"
+
+using namespace esphome::sensostar;
+
+// Simulated bus: meters matching a probe answer at once, two or more always collide
+struct SimulatedBus {
+    std::vector<uint32_t> ids;
+
+    mbus::ScanResult probe(uint32_t mask, uint32_t &id) const {
+        size_t matches = 0;
+        for (uint32_t candidate : this->ids) {
+            if (mbus::id_matches(mask, candidate)) {
+                matches++;
+                id = candidate;
+            }
+        }
+        return matches == 0 ? mbus::ScanResult::NONE : matches == 1 ? mbus::ScanResult::SINGLE : mbus::ScanResult::COLLISION;
+    }
+};
+
+static uint32_t rng_state = 12345;
+
+static uint32_t rnd(uint32_t n) {
+    rng_state = rng_state * 1103515245u + 12345u;
+    return (rng_state >> 8) % n;
+}
+
+static uint32_t random_id() {
+    uint32_t id = 0;
+    for (int digit = 0; digit < 8; digit++)
+        id = id << 4 | rnd(10);
+    return id;
+}
+
+// Runs a scan over the bus, returns the IDs found
+static std::vector<uint32_t> scan(const SimulatedBus &bus, uint32_t mask, uint16_t &probes) {
+    mbus::SecondaryScan scan;
+    std::vector<uint32_t> found;
+    scan.start(mask);
+    while (scan.running()) {
+        uint32_t id = 0;
+        mbus::ScanResult result = bus.probe(scan.probe(), id);
+        if (result == mbus::ScanResult::SINGLE)
+            found.push_back(id);
+        scan.result(result);
+    }
+    probes = scan.probes();
+    std::sort(found.begin(), found.end());
+    return found;
+}
+
+static void test_id_helpers() {
+    CHECK(mbus::id_has_wildcard(0x1234567F));
+    CHECK(mbus::id_has_wildcard(0xF2345678));
+    CHECK(!mbus::id_has_wildcard(0x12345678));
+    CHECK(mbus::id_matches(0x12FF5678, 0x12345678));
+    CHECK(!mbus::id_matches(0x12FF5679, 0x12345678));
+    CHECK(mbus::id_matches(0xFFFFFFFF, 0x00000000));
+}
+
+static void test_simple() {
+    SimulatedBus bus;
+    uint16_t probes;
+    // Empty bus: the ten first digits
+    CHECK(scan(bus, 0xFFFFFFFF, probes).empty());
+    CHECK_EQ(probes, 10);
+
+    // IDs sharing all but the last digit collide down to the last digit
+    bus.ids = {0x12345670, 0x12345671, 0x98765432};
+    std::vector<uint32_t> found = scan(bus, 0xFFFFFFFF, probes);
+    CHECK(found == (std::vector<uint32_t>{0x12345670, 0x12345671, 0x98765432}));
+    CHECK_EQ(probes, 10 + 7 * 10);
+
+    // Only below the configured mask
+    found = scan(bus, 0x1234567F, probes);
+    CHECK(found == (std::vector<uint32_t>{0x12345670, 0x12345671}));
+    CHECK_EQ(probes, 10);
+
+    // Without a wildcard there is nothing to scan
+    scan(bus, 0x12345670, probes);
+    CHECK_EQ(probes, 0);
+}
+
+// Random IDs over the whole address space: every meter is found, probes grow with the number of meters
+static void test_random(size_t meters) {
+    const int trials = 1000;
+    unsigned long total = 0;
+    uint16_t worst = 0;
+    for (int trial = 0; trial < trials; trial++) {
+        SimulatedBus bus;
+        while (bus.ids.size() < meters) {
+            uint32_t id = random_id();
+            if (std::find(bus.ids.begin(), bus.ids.end(), id) == bus.ids.end())
+                bus.ids.push_back(id);
+        }
+        uint16_t probes;
+        std::vector<uint32_t> found = scan(bus, 0xFFFFFFFF, probes);
+        std::sort(bus.ids.begin(), bus.ids.end());
+        CHECK(found == bus.ids);
+        total += probes;
+        worst = std::max(worst, probes);
+    }
+    printf("%2zu meters: %.1f probes on average, %u at most\n", meters, (double) total / trials, worst);
+    // Each meter costs at most one collision per digit, each collision ten probes
+    CHECK(worst <= 10 + meters * 7 * 10);
+}
+
+int main() {
+    test_id_helpers();
+    test_simple();
+    test_random(1);
+    test_random(5);
+    test_random(10);
+    test_random(20);
+    return TEST_RESULT();
+}
@@ -0,0 +1,708 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "sim/replay.h"
+#include "sim/simulation.h"
+#include "sim/trace.h"
+#include "test_util.h"
+
+using namespace esphome::sensostar;
+
+// Energies the master published for a meter, in order
+struct Published {
+    std::vector<uint32_t> energies;
+
+    void attach(sim::Simulation &sim) {
+        sim.set_readout_callback([this](size_t, const mbus::FixedHeader &, const mbus::Readout &readout) {
+            this->energies.push_back((uint32_t) readout.get(mbus::Quantity::ENERGY));
+        });
+    }
+    // Readouts the meter made but the master never published
+    size_t gaps() const {
+        size_t gaps = 0;
+        for (size_t i = 1; i < this->energies.size(); i++)
+            gaps += this->energies[i] - this->energies[i - 1] - 1;
+        return gaps;
+    }
+};
+
+static void test_poll_cycle() {
+    sim::Simulation sim;
+    sim::VirtualMeter *meter = sim.add_meter(0x01, 0x12345678);
+    sim.add_master_meter(0x01);
+    Published published;
+    published.attach(sim);
+
+    for (int i = 0; i < 100; i++)
+        CHECK(sim.poll());
+    const sim::SimMeter &state = *sim.master_meter(0);
+    CHECK(state.initialized());
+    CHECK_EQ(state.readouts, 100u);
+    CHECK_EQ(meter->readouts(), 100u);
+    CHECK_EQ(meter->repeats(), 0u);
+    CHECK_EQ(sim.counters().timeouts, 0u);
+    CHECK_EQ(sim.counters().errors, 0u);
+    CHECK_EQ(published.energies.back(), meter->energy());
+    CHECK_EQ(published.gaps(), 0u);
+    CHECK_EQ(state.header.id, 0x12345678u);
+    // Request (23 bytes), 30 ms latency and response (69 bytes) at 2400 baud
+    const sim::Counters counters = sim.counters();
+    CHECK_EQ(counters.cycles, 100u);
+    CHECK(counters.cycle_time_max < 3000);  // the first cycle runs the init sequence
+    CHECK((counters.cycle_time - counters.cycle_time_max) / 99 < 500);
+}
+
+// Several meters on one bus, one of them selected by its secondary address: each runs its own
+// init sequence and is read once per cycle, round-robin. The selected meter stays selected and
+// goes first while pending, so no cycle selects it twice.
+static void test_multi_meter() {
+    static const size_t METERS = 5;
+    sim::Simulation sim;
+    for (size_t i = 0; i < METERS; i++)
+        sim.add_meter(i + 1, 0x10000000 + i, i + 1);
+    for (size_t i = 0; i + 1 < METERS; i++)
+        sim.add_master_meter(i + 1);
+    sim.add_master_meter(mbus::ADDRESS_SECONDARY, 0x10000000 + METERS - 1);
+    std::vector<size_t> order;
+    sim.set_readout_callback([&order](size_t meter, const mbus::FixedHeader &, const mbus::Readout &) {
+        order.push_back(meter);
+    });
+
+    static const uint32_t CYCLES = 20;
+    for (uint32_t i = 0; i < CYCLES; i++)
+        CHECK(sim.poll());
+    for (size_t i = 0; i < METERS; i++) {
+        CHECK(sim.master_meter(i)->initialized());
+        CHECK_EQ(sim.master_meter(i)->readouts, CYCLES);
+        CHECK_EQ(sim.meter(i)->readouts(), CYCLES);
+        CHECK_EQ(sim.master_meter(i)->header.id, 0x10000000 + i);
+    }
+    CHECK_EQ(order.size(), CYCLES * METERS);
+    for (size_t i = 0; i < order.size(); i++)
+        CHECK_EQ(order[i], (i + METERS - 1) % METERS);
+
+    // Throughput at 2400 baud once initialized, the longest cycle is the first one with the init sequences
+    const sim::Counters counters = sim.counters();
+    CHECK_EQ(counters.timeouts, 0u);
+    const double cycle = (double) (counters.cycle_time - counters.cycle_time_max) / (CYCLES - 1);
+    const double per_minute = METERS * 60000.0 / cycle;
+    printf("%zu meters at 2400 baud: %.0f ms per cycle, %.1f meters/min\n", METERS, cycle, per_minute);
+    CHECK(per_minute > 100);
+}
+
+// Priority scheduling serves the pending meter with the highest priority first. A meter that does
+// not answer is backed off and does not hold up the others.
+static void test_priority() {
+    static const uint8_t PRIORITIES[] = {1, 5, 3};
+    sim::Simulation sim;
+    sim.master.set_priority_scheduling(true);
+    for (size_t i = 0; i < 3; i++) {
+        sim.add_meter(i + 1, 0x10000000 + i, i + 1);
+        sim.add_master_meter(i + 1)->set_priority(PRIORITIES[i]);
+    }
+    std::vector<size_t> order;
+    sim.set_readout_callback([&order](size_t meter, const mbus::FixedHeader &, const mbus::Readout &) {
+        order.push_back(meter);
+    });
+    CHECK(sim.poll());
+    order.clear();
+    CHECK(sim.poll());
+    CHECK(order == (std::vector<size_t>{1, 2, 0}));
+
+    sim::MeterFaults faults;
+    faults.no_reply = 1.0f;
+    sim.meter(1)->set_faults(faults);
+    for (int i = 0; i < 5; i++)
+        sim.poll(10000);
+    CHECK(sim.master_meter(1)->unavailable > 0);
+    CHECK(sim.master_meter(1)->retry_after() > 0);
+    CHECK_EQ(sim.master_meter(0)->readouts, 7u);
+    CHECK_EQ(sim.master_meter(2)->readouts, 7u);
+}
+
+// A response lost on the way is requested again with the same FCB, the meter repeats it
+static void test_lost_responses() {
+    sim::Simulation sim;
+    sim::VirtualMeter *meter = sim.add_meter(0x01, 0x12345678, 7);
+    sim::MeterFaults faults;
+    faults.jitter = 20;
+    faults.drop_byte = 0.002f;
+    faults.corrupt_byte = 0.002f;
+    faults.no_reply = 0.05f;
+    meter->set_faults(faults);
+    sim.add_master_meter(0x01);
+    Published published;
+    published.attach(sim);
+
+    for (int i = 0; i < 1000; i++)
+        sim.poll();
+    const sim::Counters counters = sim.counters();
+    CHECK(counters.timeouts > 0);
+    CHECK(counters.errors > 0);
+    CHECK(meter->repeats() > 0);
+    CHECK(sim.master_meter(0)->readouts > 850);
+    // Every readout of the meter reaches the master, none twice
+    CHECK_EQ(sim.master_meter(0)->readouts, meter->readouts());
+    CHECK_EQ(published.gaps(), 0u);
+    CHECK(std::adjacent_find(published.energies.begin(), published.energies.end()) == published.energies.end());
+}
+
+static void test_timeout_backoff() {
+    sim::Simulation sim;
+    sim::VirtualMeter *meter = sim.add_meter(0x01, 0x12345678);
+    sim.add_master_meter(0x01);
+    // Init sequence and the first readout
+    CHECK(sim.poll());
+    CHECK_EQ(sim.master_meter(0)->readouts, 1u);
+    CHECK_EQ(meter->requests(), 6u);
+
+    // Retries with a doubled timeout, then the meter is reported unavailable and backed off
+    sim::MeterFaults faults;
+    faults.no_reply = 1.0f;
+    meter->set_faults(faults);
+    const uint32_t start = sim.clock.millis();
+    CHECK(sim.poll());
+    const sim::SimMeter &state = *sim.master_meter(0);
+    CHECK_EQ(sim.counters().timeouts, 3u);
+    CHECK_EQ(sim.counters().retries, 2u);
+    CHECK_EQ(state.unavailable, 1u);
+    CHECK_EQ(state.retry_after() - sim.clock.millis(), MBUS_BACKOFF_MIN);
+    // 500, 1000 and 2000 ms timeouts, each after a request of 23 bytes and the interframe delay
+    CHECK(sim.clock.millis() - start >= 3500);
+    CHECK(sim.clock.millis() - start < 4000);
+
+    // Not polled again before the backoff expired
+    faults.no_reply = 0.0f;
+    meter->set_faults(faults);
+    sim.master.update();
+    CHECK(!sim.run_until(state.retry_after() - 1));
+    CHECK_EQ(meter->requests(), 9u);
+    CHECK(sim.run_until(state.retry_after() + 2000));
+    CHECK_EQ(state.readouts, 2u);
+}
+
+// The timeout follows the measured latency. When the meter becomes slow, its late answers collide
+// with the retries until the timeout adapted, without losing a readout of the meter.
+static void test_adaptive_timeout() {
+    sim::Simulation sim;
+    sim::VirtualMeter *meter = sim.add_meter(0x01, 0x12345678);
+    sim.add_master_meter(0x01);
+    Published published;
+    published.attach(sim);
+    for (int i = 0; i < 10; i++)
+        sim.poll();
+    CHECK_EQ(sim.counters().timeouts, 0u);
+
+    sim::MeterFaults faults;
+    faults.latency = 200;
+    meter->set_faults(faults);
+    for (int i = 0; i < 10; i++)
+        sim.poll();
+    const uint32_t timeouts = sim.counters().timeouts;
+    const uint32_t errors = sim.counters().errors;
+    CHECK(timeouts > 0);
+    // Garbled answers are reported, but the retries never run out and the meter is not backed off
+    CHECK_EQ(sim.master_meter(0)->retry_after(), 0u);
+
+    const uint32_t readouts = sim.master_meter(0)->readouts;
+    for (int i = 0; i < 10; i++)
+        sim.poll();
+    CHECK_EQ(sim.counters().timeouts, timeouts);
+    CHECK_EQ(sim.counters().errors, errors);
+    CHECK_EQ(sim.master_meter(0)->readouts, readouts + 10);
+    CHECK_EQ(sim.master_meter(0)->readouts, meter->readouts());
+    CHECK_EQ(published.gaps(), 0u);
+}
+
+static void test_baud_rate() {
+    sim::Simulation sim;
+    sim::VirtualMeter *meter = sim.add_meter(0x01, 0x12345678);
+    sim.add_master_meter(0x01);
+    sim.master.set_baud_rate(9600);
+    Published published;
+    published.attach(sim);
+    for (int i = 0; i < 5; i++)
+        CHECK(sim.poll());
+    CHECK_EQ(meter->baud_rate(), 9600u);
+    CHECK_EQ(sim.master_meter(0)->baud_rate(), 9600u);
+    CHECK_EQ(sim.master_meter(0)->readouts, 5u);
+
+    // The meter restarts at 2400 baud: after the retries at 9600 the master starts over at 2400,
+    // runs the init sequence and negotiates 9600 again
+    meter->power_cycle();
+    for (int i = 0; i < 5; i++)
+        sim.poll();
+    CHECK_EQ(meter->baud_rate(), 9600u);
+    CHECK_EQ(sim.master_meter(0)->baud_attempts(), 1);
+    CHECK(sim.master_meter(0)->readouts >= 8);
+    CHECK_EQ(published.gaps(), 0u);
+}
+
+// The ESP rebooted, the meter kept 9600 baud: after the retries at 2400 the next attempt probes 9600
+static void test_baud_rate_reboot() {
+    sim::Simulation sim;
+    sim::VirtualMeter *meter = sim.add_meter(0x01, 0x12345678);
+    meter->set_baud_rate(9600);
+    sim.add_master_meter(0x01);
+    sim.master.set_baud_rate(9600);
+    // Unavailable once, then found at 9600 after the backoff, all within the first cycle
+    CHECK(sim.poll());
+    CHECK_EQ(sim.master_meter(0)->unavailable, 1u);
+    CHECK_EQ(sim.master_meter(0)->readouts, 1u);
+    for (int i = 0; i < 3; i++)
+        CHECK(sim.poll());
+    CHECK_EQ(meter->baud_rate(), 9600u);
+    CHECK_EQ(sim.master_meter(0)->baud_rate(), 9600u);
+    CHECK(sim.master_meter(0)->initialized());
+    CHECK_EQ(sim.master_meter(0)->readouts, 4u);
+}
+
+// A meter that does not acknowledge the switch stays at 2400 baud after MBUS_MAX_BAUD_ATTEMPTS
+static void test_baud_rate_unsupported() {
+    sim::Simulation sim;
+    sim::VirtualMeter *meter = sim.add_meter(0x01, 0x12345678);
+    meter->set_baud_switch(false);
+    sim.add_master_meter(0x01);
+    sim.master.set_baud_rate(9600);
+    for (int i = 0; i < 5; i++)
+        CHECK(sim.poll());
+    CHECK_EQ(sim.master_meter(0)->baud_attempts(), MBUS_MAX_BAUD_ATTEMPTS);
+    CHECK_EQ(sim.master_meter(0)->baud_rate(), 2400u);
+    CHECK_EQ(sim.master_meter(0)->readouts, 5u);
+    CHECK_EQ(sim.master_meter(0)->unavailable, 0u);
+}
+
+// Mean poll cycle of one meter once initialized, in ms
+static double steady_cycle(uint32_t baud_rate) {
+    static const int CYCLES = 20;
+    sim::Simulation sim;
+    sim.add_meter(0x01, 0x12345678);
+    sim.add_master_meter(0x01);
+    sim.master.set_baud_rate(baud_rate);
+    for (int i = 0; i < CYCLES; i++)
+        sim.poll();
+    // The longest cycle is the first one with the init sequence and the switch
+    const sim::Counters counters = sim.counters();
+    return (double) (counters.cycle_time - counters.cycle_time_max) / (CYCLES - 1);
+}
+
+static void test_baud_rate_cycle() {
+    const double slow = steady_cycle(2400);
+    const double fast = steady_cycle(9600);
+    printf("Poll cycle of one meter: %.0f ms at 2400 baud, %.0f ms at 9600 baud\n", slow, fast);
+    CHECK(fast < slow / 2);
+}
+
+// Steady poll cycle of one meter asked for the items of the given quantities, 0 for the full
+// request. Returns the cycle in ms, the answer length in bytes through `frame`.
+static double selective_cycle(unsigned quantities, uint32_t &frame) {
+    static const uint32_t CYCLES = 20;
+    sim::Simulation sim;
+    sim::VirtualMeter *meter = sim.add_meter(0x01, 0x12345678);
+    sim::SimMeter *state = sim.add_master_meter(0x01);
+    state->set_selective_readout(quantities != 0);
+    for (uint8_t q = 0; q < mbus::QUANTITY_COUNT; q++) {
+        if (quantities & (1 << q))
+            state->request_quantity((mbus::Quantity) q);
+    }
+    sim.poll();
+    const sim::Counters first = sim.counters();
+    for (uint32_t i = 1; i < CYCLES; i++)
+        sim.poll();
+    const sim::Counters counters = sim.counters();
+    CHECK_EQ(state->readouts, CYCLES);
+    CHECK_EQ(meter->readouts(), CYCLES);
+    // Answered with every requested quantity, no fallback to the full request
+    CHECK_EQ(state->selective(), quantities != 0);
+    frame = (uint32_t) ((counters.bytes - first.bytes) / (CYCLES - 1));
+    return (double) (counters.cycle_time - first.cycle_time) / (CYCLES - 1);
+}
+
+static unsigned bit(mbus::Quantity q) { return 1 << static_cast<uint8_t>(q); }
+
+// Answer length and poll cycle per sensor subset, at 2400 baud with 30 ms latency
+static void test_selective_readout() {
+    static const struct {
+        const char *name;
+        unsigned quantities;
+    } SUBSETS[] = {
+        {"full request", 0},
+        {"all sensors", bit(mbus::Quantity::VOLUME) | bit(mbus::Quantity::POWER) | bit(mbus::Quantity::VOLUME_FLOW) |
+                            bit(mbus::Quantity::TEMPERATURE_FLOW) | bit(mbus::Quantity::TEMPERATURE_RETURN) |
+                            bit(mbus::Quantity::TEMPERATURE_DIFF) | bit(mbus::Quantity::ERROR_FLAGS)},
+        {"energy and temperatures", bit(mbus::Quantity::TEMPERATURE_FLOW) | bit(mbus::Quantity::TEMPERATURE_RETURN) |
+                                        bit(mbus::Quantity::TEMPERATURE_DIFF)},
+        {"energy and power", bit(mbus::Quantity::POWER)},
+        {"energy only", bit(mbus::Quantity::ENERGY)},
+    };
+    double last = 1e9;
+    uint32_t last_frame = 1000;
+    for (const auto &subset : SUBSETS) {
+        uint32_t frame;
+        const double cycle = selective_cycle(subset.quantities, frame);
+        printf("Readout, %-23s: %3u byte answer, %.0f ms per cycle\n", subset.name, (unsigned) frame, cycle);
+        CHECK(frame < last_frame);
+        CHECK(cycle < last);
+        last_frame = frame;
+        last = cycle;
+    }
+}
+
+// Longest loop() of the poll cycle with the init sequence and of a cycle behind a 261 byte
+// gateway frame, on a UART whose writes block while its 128 byte FIFO is full
+struct LoopTimes {
+    uint32_t init;
+    uint32_t gateway;
+};
+
+static LoopTimes longest_loops(size_t tx_budget) {
+    sim::Simulation sim;
+    sim.uart.set_tx_fifo(128);
+    sim.master.set_tx_budget(tx_budget);
+    sim.add_meter(0x01, 0x12345678);
+    sim.add_master_meter(0x01);
+    LoopTimes times;
+    sim.poll();
+    times.init = sim.counters().cycle_loop_max;
+
+    uint8_t payload[252] = {0x0F};
+    uint8_t frame[mbus::MAX_FRAME_LENGTH];
+    const size_t len = mbus::build_long_frame(frame, sizeof(frame), mbus::C_SND_UD, 0x01, 0x51, payload, sizeof(payload));
+    CHECK_EQ(len, mbus::MAX_FRAME_LENGTH);
+    sim.send_external(frame, len);
+    sim.poll();
+    times.gateway = sim.counters().cycle_loop_max;
+    return times;
+}
+
+// The whole request in one write, as before the chunked transmission, against the chunks fed as the FIFO drains
+static void test_tx_blocking() {
+    const LoopTimes whole = longest_loops(mbus::MAX_FRAME_LENGTH);
+    const LoopTimes chunked = longest_loops(MBUS_TX_FIFO_BUDGET);
+    printf("Longest loop() at 2400 baud, 128 byte UART FIFO: init sequence %u us whole frame, %u us chunked; "
+           "261 byte gateway frame %u us whole frame, %u us chunked\n",
+           whole.init, chunked.init, whole.gateway, chunked.gateway);
+    // The 121 byte init frame fits into the FIFO either way, the gateway frame does not
+    CHECK(whole.gateway > 500000);
+    CHECK(chunked.gateway < 1000);
+    CHECK(chunked.init < 1000);
+}
+
+static void test_scan() {
+    sim::Simulation sim;
+    static const uint32_t IDS[] = {0x12345678, 0x12345679, 0x12349999, 0x55500001, 0x98765432};
+    uint32_t seed = 1;
+    for (uint32_t id : IDS) {
+        sim::VirtualMeter *meter = sim.add_meter(0x00, id, seed++);
+        sim::MeterFaults faults;
+        faults.latency = 20 + 3 * seed;
+        meter->set_faults(faults);
+        sim.add_master_meter(mbus::ADDRESS_SECONDARY, 0xFFFFFFFF);
+    }
+    sim.master.rescan();
+    CHECK(sim.run_until(600000));
+    CHECK(!sim.master.is_scanning());
+    CHECK(sim.master.get_found_ids() == std::vector<uint32_t>(std::begin(IDS), std::end(IDS)));
+
+    // Each meter is selected by the ID found for it and read, once right after the scan like after
+    // a boot and then on every poll
+    for (int i = 0; i < 3; i++)
+        CHECK(sim.poll());
+    for (size_t i = 0; i < 5; i++) {
+        CHECK_EQ(sim.master_meter(i)->header.id, IDS[i]);
+        CHECK_EQ(sim.master_meter(i)->readouts, 4u);
+        CHECK_EQ(sim.meter(i)->readouts(), 4u);
+    }
+}
+
+// Random 8 digit BCD IDs, sorted
+static std::vector<uint32_t> random_ids(size_t count, uint32_t seed) {
+    std::vector<uint32_t> ids;
+    while (ids.size() < count) {
+        uint32_t id = 0;
+        for (int digit = 0; digit < 8; digit++) {
+            seed = seed * 1103515245 + 12345;
+            id = id << 4 | (seed >> 16) % 10;
+        }
+        if (std::find(ids.begin(), ids.end(), id) == ids.end())
+            ids.push_back(id);
+    }
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+// Probes and simulated time of a full wildcard scan over random IDs
+static void test_scan_time() {
+    for (size_t count : {1, 5, 20}) {
+        sim::Simulation sim;
+        const std::vector<uint32_t> ids = random_ids(count, count);
+        for (size_t i = 0; i < count; i++) {
+            sim.add_meter(0x00, ids[i], i + 1);
+            sim.add_master_meter(mbus::ADDRESS_SECONDARY, 0xFFFFFFFF);
+        }
+        const uint32_t start = sim.clock.millis();
+        sim.master.rescan();
+        while (sim.master.is_scanning() && sim.clock.millis() - start < 3600000)
+            sim.run_until(sim.clock.millis() + 1000);
+        CHECK(!sim.master.is_scanning());
+        CHECK(sim.master.get_found_ids() == ids);
+        printf("Scan of %2zu meters: %u probes, %.1f s at 2400 baud\n", count, sim.master.get_scan_probes(),
+               (sim.clock.millis() - start) / 1000.0);
+    }
+}
+
+// A scan below a partial wildcard only probes that part of the address space
+static void test_scan_mask() {
+    sim::Simulation sim;
+    sim.add_meter(0x00, 0x12340001, 1);
+    sim.add_meter(0x00, 0x12340002, 2);
+    sim::VirtualMeter *other = sim.add_meter(0x00, 0x55500001, 3);
+    sim.add_master_meter(mbus::ADDRESS_SECONDARY, 0x1234FFFF);
+    sim.add_master_meter(mbus::ADDRESS_SECONDARY, 0x1234FFFF);
+    sim.master.rescan();
+    CHECK(sim.run_until(600000));
+    CHECK(sim.master.get_found_ids() == (std::vector<uint32_t>{0x12340001, 0x12340002}));
+    CHECK_EQ(other->requests(), 0u);
+    CHECK_EQ(sim.master_meter(0)->header.id, 0x12340001u);
+    CHECK_EQ(sim.master_meter(1)->header.id, 0x12340002u);
+}
+
+// Meters switched to a higher rate are sent back to 2400 baud before the first probe, and
+// negotiate the higher rate again afterwards
+static void test_scan_baud_rate() {
+    sim::Simulation sim;
+    sim.master.set_baud_rate(9600);
+    static const uint32_t IDS[] = {0x12345678, 0x98765432};
+    for (size_t i = 0; i < 2; i++) {
+        sim.add_meter(0x00, IDS[i], i + 1);
+        sim.add_master_meter(mbus::ADDRESS_SECONDARY, 0xFFFFFFFF);
+    }
+    sim.master.rescan();
+    CHECK(sim.run_until(600000));
+    CHECK_EQ(sim.meter(0)->baud_rate(), 9600u);
+    CHECK_EQ(sim.meter(1)->baud_rate(), 9600u);
+
+    sim.master.rescan();
+    CHECK(sim.run_until(sim.clock.millis() + 600000));
+    CHECK(sim.master.get_found_ids() == std::vector<uint32_t>(std::begin(IDS), std::end(IDS)));
+    CHECK(sim.poll());
+    for (size_t i = 0; i < 2; i++) {
+        CHECK_EQ(sim.meter(i)->baud_rate(), 9600u);
+        CHECK_EQ(sim.master_meter(i)->header.id, IDS[i]);
+        CHECK_EQ(sim.master_meter(i)->unavailable, 0u);
+    }
+    // Never two meters selected at once
+    CHECK_EQ(sim.counters().errors, 0u);
+}
+
+// IDs stored by an earlier scan resolve the wildcards without scanning
+static void test_scan_restore() {
+    sim::Simulation sim;
+    static const uint32_t IDS[] = {0x12345678, 0x98765432};
+    for (size_t i = 0; i < 2; i++) {
+        sim.add_meter(0x00, IDS[i], i + 1);
+        sim.add_master_meter(mbus::ADDRESS_SECONDARY, 0xFFFFFFFF);
+    }
+    CHECK(!sim.master.restore_scan(IDS, 1));
+    CHECK(sim.master.restore_scan(IDS, 2));
+    CHECK(sim.poll());
+    CHECK_EQ(sim.master.get_scan_probes(), 0);
+    CHECK_EQ(sim.master_meter(0)->header.id, IDS[0]);
+    CHECK_EQ(sim.master_meter(1)->header.id, IDS[1]);
+}
+
+// A meter found by a scan stops answering: once its retries are exhausted the bus is scanned
+// again, and the wildcard resolves to the meter that replaced it
+static void test_scan_replaced() {
+    sim::Simulation sim;
+    sim.add_meter(0x00, 0x12345678, 1);
+    sim::VirtualMeter *old_meter = sim.add_meter(0x00, 0x55500001, 2);
+    sim.add_master_meter(mbus::ADDRESS_SECONDARY, 0xFFFFFFFF);
+    sim.add_master_meter(mbus::ADDRESS_SECONDARY, 0xFFFFFFFF);
+    sim.master.rescan();
+    CHECK(sim.run_until(600000));
+    CHECK_EQ(sim.master_meter(1)->header.id, 0x55500001u);
+
+    sim::MeterFaults faults;
+    faults.no_reply = 1.0f;
+    old_meter->set_faults(faults);
+    old_meter->power_cycle();
+    sim.add_meter(0x00, 0x77700001, 3);
+    sim.poll();
+    CHECK(sim.run_until(sim.clock.millis() + 600000));
+    CHECK(sim.master.get_found_ids() == (std::vector<uint32_t>{0x12345678, 0x77700001}));
+    CHECK(sim.poll());
+    CHECK_EQ(sim.master_meter(1)->header.id, 0x77700001u);
+}
+
+// A recorded session replays to the same readouts
+static void test_record_replay() {
+    sim::Simulation sim;
+    sim::TraceWriter trace;
+    sim.set_trace(&trace);
+    sim::VirtualMeter *meter = sim.add_meter(0x01, 0x12345678, 3);
+    sim::MeterFaults faults;
+    faults.drop_byte = 0.002f;
+    faults.corrupt_byte = 0.002f;
+    meter->set_faults(faults);
+    sim.add_master_meter(0x01);
+    Published published;
+    published.attach(sim);
+    for (int i = 0; i < 200; i++)
+        sim.poll();
+
+    std::vector<sim::TraceEntry> entries = sim::read_trace(trace.text());
+    std::vector<uint32_t> energies;
+    sim::ReplayResult result = sim::replay(entries, [&energies](uint32_t, uint8_t address, const mbus::FixedHeader &,
+                                                                                                                              const mbus::Readout &readout) {
+        CHECK_EQ(address, 0x01);
+        energies.push_back((uint32_t) readout.get(mbus::Quantity::ENERGY));
+    });
+    CHECK(energies == published.energies);
+    CHECK_EQ(result.errors, sim.counters().errors);
+    CHECK_EQ(result.timeouts, sim.counters().timeouts);
+    CHECK_EQ(result.acks, sim.counters().acks);
+    CHECK(result.errors > 0);
+
+    // The init frame of 121 bytes is logged on two lines and joined again
+    CHECK(std::any_of(entries.begin(), entries.end(), [](const sim::TraceEntry &entry) {
+        return entry.event == sim::TraceEvent::TX && entry.data.size() == 9 + sizeof(INIT_PAYLOAD_4);
+    }));
+}
+
+static void test_device_log() {
+    // As printed by the ESPHome logger, with colors
+    static const char *const LOG[] = {
+            "\033[0;36m[12:00:01][I][sensostar.trace:024]: 1000 TX 6803036853FEB8",
+            "[12:00:01][D][SensoStar:300]: unrelated line 1001 RX E5",
+            "[12:00:01][I][sensostar.trace:024]: 1100 RX E5\033[0m",
+            "[12:00:02][I][sensostar.trace:029]: 2100 TIMEOUT 500",
+            "2200 BAUD 9600",
+    };
+    std::string text;
+    for (const char *line : LOG)
+        text += std::string(line) + "\n";
+    std::vector<sim::TraceEntry> entries = sim::read_trace(text);
+    CHECK_EQ(entries.size(), 4u);
+    CHECK_EQ(entries[0].time, 1000u);
+    CHECK(entries[0].event == sim::TraceEvent::TX);
+    CHECK_EQ(entries[0].data.size(), 7u);
+    CHECK(entries[1].event == sim::TraceEvent::RX);
+    CHECK(entries[1].data == std::vector<uint8_t>{0xE5});
+    CHECK(entries[2].event == sim::TraceEvent::TIMEOUT);
+    CHECK_EQ(entries[2].value, 500u);
+    CHECK(entries[3].event == sim::TraceEvent::BAUD);
+    CHECK_EQ(entries[3].value, 9600u);
+}
+
+// A gateway client's readout of the selected meter reaches it at the rate it was switched to
+static void test_gateway_baud_rate() {
+    sim::Simulation sim;
+    sim::VirtualMeter *meter = sim.add_meter(0x01, 0x12345678);
+    sim.add_master_meter(mbus::ADDRESS_SECONDARY, 0x12345678);
+    sim.master.set_baud_rate(9600);
+    for (int i = 0; i < 5; i++)
+        CHECK(sim.poll());
+    CHECK_EQ(meter->baud_rate(), 9600u);
+    const uint32_t answers = meter->readouts() + meter->repeats();
+    const uint32_t published = sim.master_meter(0)->readouts;
+
+    // Answered, a new readout or the last one again depending on the client's FCB, and published as well
+    uint8_t frame[5];
+    mbus::build_short_frame(frame, mbus::C_REQ_UD2, mbus::ADDRESS_SECONDARY);
+    sim.send_external(frame, sizeof(frame));
+    CHECK(sim.run_until(sim.clock.millis() + 2000));
+    CHECK_EQ(meter->readouts() + meter->repeats(), answers + 1);
+    CHECK_EQ(sim.master_meter(0)->readouts, published + 1);
+    CHECK(sim.poll());
+    CHECK_EQ(sim.master_meter(0)->readouts, published + 2);
+}
+
+// A meter configured at 0xFE only takes the answers to requests sent to 0xFE, not the readout of
+// another device on the bus
+static void test_gateway_tee() {
+    sim::Simulation sim;
+    sim.add_meter(0x01, 0x11111111);
+    sim::VirtualMeter *other = sim.add_meter(0x02, 0x22222222);
+    sim.add_master_meter(mbus::ADDRESS_BROADCAST_REPLY);
+    std::vector<uint32_t> ids;
+    sim.set_readout_callback([&ids](size_t, const mbus::FixedHeader &header, const mbus::Readout &) {
+        ids.push_back(header.id);
+    });
+    // The other device stays silent while requests to 0xFE reach it as well
+    sim::MeterFaults silent;
+    silent.no_reply = 1.0f;
+    other->set_faults(silent);
+    for (int i = 0; i < 3; i++)
+        CHECK(sim.poll());
+    CHECK_EQ(ids.size(), 3u);
+
+    uint8_t frame[5];
+    other->set_faults(sim::MeterFaults());
+    mbus::build_short_frame(frame, mbus::C_REQ_UD2, 0x02);
+    sim.send_external(frame, sizeof(frame));
+    CHECK(sim.run_until(sim.clock.millis() + 2000));
+    CHECK_EQ(other->readouts(), 1u);
+    CHECK_EQ(ids.size(), 3u);
+
+    other->set_faults(silent);
+    mbus::build_short_frame(frame, mbus::C_REQ_UD2, mbus::ADDRESS_BROADCAST_REPLY);
+    sim.send_external(frame, sizeof(frame));
+    CHECK(sim.run_until(sim.clock.millis() + 2000));
+    CHECK_EQ(ids.size(), 4u);
+    CHECK(std::count(ids.begin(), ids.end(), 0x11111111u) == 4);
+}
+
+// A client's readout toggles the meter's frame count bit: with either bit, the master's next readouts
+// are new ones and not the client's answer again
+static void test_gateway_fcb() {
+    for (const uint8_t fcb : {(uint8_t) 0, mbus::C_FCB}) {
+        sim::Simulation sim;
+        sim::VirtualMeter *meter = sim.add_meter(0x01, 0x12345678);
+        sim.add_master_meter(0x01);
+        for (int i = 0; i < 3; i++)
+            CHECK(sim.poll());
+
+        uint8_t frame[mbus::MAX_FRAME_LENGTH];
+        const size_t len = mbus::build_long_frame(frame, sizeof(frame), mbus::C_SND_UD | fcb, 0x01,
+                                                  mbus::CI_DATA_SEND, POLL_PAYLOAD, sizeof(POLL_PAYLOAD));
+        sim.send_external(frame, len);
+        CHECK(sim.run_until(sim.clock.millis() + 2000));
+        const uint32_t readouts = meter->readouts();
+        const uint32_t repeats = meter->repeats();
+        for (int i = 0; i < 3; i++)
+            CHECK(sim.poll());
+        CHECK_EQ(meter->repeats(), repeats);
+        CHECK_EQ(meter->readouts(), readouts + 3);
+        CHECK_EQ(sim.master_meter(0)->header.access_number, meter->access_number());
+    }
+}
+
+int main() {
+    test_poll_cycle();
+    test_multi_meter();
+    test_priority();
+    test_lost_responses();
+    test_timeout_backoff();
+    test_adaptive_timeout();
+    test_baud_rate();
+    test_baud_rate_reboot();
+    test_baud_rate_unsupported();
+    test_baud_rate_cycle();
+    test_tx_blocking();
+    test_gateway_baud_rate();
+    test_gateway_tee();
+    test_gateway_fcb();
+    test_selective_readout();
+    test_scan();
+    test_scan_time();
+    test_scan_mask();
+    test_scan_baud_rate();
+    test_scan_restore();
+    test_scan_replaced();
+    test_record_replay();
+    test_device_log();
+    return TEST_RESULT();
+}
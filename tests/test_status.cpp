@@ -0,0 +1,40 @@
+#include <cstring>
+
+#include "status_flags.h"
+#include "test_util.h"
+
+using namespace esphome::sensostar;
+
+static void test_render() {
+    StatusText status;
+    CHECK(strcmp(status.get(0x00), "OK") == 0);
+    CHECK(strcmp(status.get(0x01), "Temperature Sensor 1: Cable Break") == 0);
+    CHECK(strcmp(status.get(0x85),
+                 "Temperature Sensor 1: Cable Break | Temperature Sensor 2: Cable Break | Low Battery") == 0);
+
+    // The buffer fits all flags set
+    const char *all = status.get(0xFF);
+    CHECK_EQ(strlen(all) + 1, STATUS_TEXT_SIZE);
+    CHECK(strncmp(all, STATUS_FLAG_MESSAGES[0], strlen(STATUS_FLAG_MESSAGES[0])) == 0);
+    CHECK(strcmp(all + strlen(all) - strlen("Low Battery"), "Low Battery") == 0);
+}
+
+static void test_cache() {
+    StatusText status;
+    // A cached combination returns the same buffer
+    const char *a = status.get(0x20);
+    CHECK(status.get(0x20) == a);
+    for (uint8_t flags = 1; flags < STATUS_TEXT_CACHE_SLOTS; flags++)
+        status.get(flags);
+    CHECK(status.get(0x20) == a);
+    // One more combination replaces the oldest slot, which renders again on the next use
+    status.get(0x40);
+    CHECK(strcmp(status.get(0x20), "Electronic Defect") == 0);
+    CHECK(strcmp(status.get(0x40), "Reset") == 0);
+}
+
+int main() {
+    test_render();
+    test_cache();
+    return TEST_RESULT();
+}
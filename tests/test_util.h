@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+
+// Minimal check macros for the host tests: a failed check is reported and counted,
+// TEST_RESULT() turns the count into the exit code
+
+static int test_failures = 0;
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      test_failures++; \
+    } \
+  } while (0)
+
+#define CHECK_EQ(a, b) \
+  do { \
+    auto a_ = (a); \
+    auto b_ = (b); \
+    if (!(a_ == b_)) { \
+      fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: %g != %g\n", __FILE__, __LINE__, #a, #b, (double) a_, \
+              (double) b_); \
+      test_failures++; \
+    } \
+  } while (0)
+
+#define CHECK_NEAR(a, b, eps) \
+  do { \
+    double a_ = (a); \
+    double b_ = (b); \
+    if (!(std::fabs(a_ - b_) <= (eps))) { \
+      fprintf(stderr, "%s:%d: CHECK_NEAR(%s, %s) failed: %g != %g\n", __FILE__, __LINE__, #a, #b, a_, b_); \
+      test_failures++; \
+    } \
+  } while (0)
+
+#define TEST_RESULT() \
+  (test_failures == 0 ? (printf("OK\n"), 0) : (fprintf(stderr, "%d check(s) failed\n", test_failures), 1))